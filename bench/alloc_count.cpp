@@ -0,0 +1,23 @@
+#include <cstdlib>
+#include <new>
+#include "alloc_count.h"
+
+size_t allocations = 0;
+size_t allocatedBytes = 0;
+
+void *operator new(size_t size) {
+    allocations++;
+    allocatedBytes += size;
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
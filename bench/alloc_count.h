@@ -0,0 +1,16 @@
+#ifndef SHELL_BENCH_ALLOC_COUNT_H
+#define SHELL_BENCH_ALLOC_COUNT_H
+
+#include <cstddef>
+
+/**
+ * Heap allocation counters for the benchmarks.
+ *
+ * A benchmark that is built with bench/alloc_count.cpp gets an operator new
+ * that counts every call and the bytes asked for. Take the difference of the
+ * counters around the code that is measured.
+ */
+extern size_t allocations;    //< Calls of operator new so far.
+extern size_t allocatedBytes; //< Bytes asked for from operator new so far.
+
+#endif //SHELL_BENCH_ALLOC_COUNT_H
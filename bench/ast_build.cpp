@@ -0,0 +1,201 @@
+/**
+ * AST construction benchmark.
+ *
+ * Parses a set of typical command lines and then turns each parse tree into a
+ * Sequence over and over again, once with CommandVisitor and once with a
+ * visitor that returns its results through antlrcpp::Any, the way the
+ * generated ShellGrammarBaseVisitor does, and builds the line out of heap
+ * objects the way Sequence, Pipeline and SimpleCommand used to be: a
+ * std::string per word and a vector per list. Every heap allocation is
+ * counted, so the difference per line shows what the boxing, the generated
+ * child accessors and the separate allocations cost.
+ * CommandVisitor logs what it visits when PRINT_DEBUG_INFO is on, that output
+ * is sent to /dev/null while measuring.
+ *
+ * usage: ast_build [repetitions]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <CommonTokenStream.h>
+#include "../gen/ShellGrammarBaseVisitor.h"
+#include "../gen/ShellGrammarParser.h"
+#include "CommandVisitor.h"
+#include "Pipeline.h"
+#include "Sequence.h"
+#include "ShellLexer.h"
+#include "SimpleCommand.h"
+#include "alloc_count.h"
+
+static const char *LINES[] = {
+        "ls -la",
+        "cd /usr/local/src",
+        "git status",
+        "make -j8 2>&1 | tee build.log",
+        "grep -rn \"TODO\" src | sort | uniq -c > todo.txt",
+        "cat README.md ; echo done &",
+        "echo \"hello world\" >> /tmp/greeting.txt",
+        "find . -name *.cpp | xargs wc -l | tail -n 1",
+        "sleep 10 & sleep 20 &",
+        "sort < unsorted.txt > sorted.txt 2> errors.txt"
+};
+
+struct HeapRedirect {
+    int fd;
+    IORedirect::Type type;
+    std::string file;
+};
+
+struct HeapCommand {
+    std::string program;
+    std::vector<std::string> arguments;
+    std::vector<HeapRedirect> redirects;
+};
+
+struct HeapPipeline {
+    std::vector<HeapCommand *> commands;
+    bool async = false;
+
+    ~HeapPipeline() {
+        for (HeapCommand *cmd : commands)
+            delete cmd;
+    }
+};
+
+struct HeapSequence {
+    std::vector<HeapPipeline *> pipelines;
+
+    ~HeapSequence() {
+        for (HeapPipeline *pipeline : pipelines)
+            delete pipeline;
+    }
+};
+
+/**
+ * The AST builder as it was written against the generated visitor
+ */
+class BoxedVisitor : public ShellGrammarBaseVisitor {
+public:
+    antlrcpp::Any visitSequence(ShellGrammarParser::SequenceContext *ctx) override {
+        HeapSequence *sequence = new HeapSequence();
+        for (size_t i = 0; i < ctx->pipeline().size(); i++) {
+            HeapPipeline *pipeline = visit(ctx->pipeline(i));
+            if (ctx->seqDelim(i)) {
+                if (ctx->seqDelim(i)->AMPERSAND())
+                    pipeline->async = true;
+            } else if (ctx->lastAmpersand != nullptr) {
+                pipeline->async = true;
+            }
+            sequence->pipelines.push_back(pipeline);
+        }
+        return sequence;
+    }
+
+    antlrcpp::Any visitPipeline(ShellGrammarParser::PipelineContext *ctx) override {
+        HeapPipeline *pipeline = new HeapPipeline();
+        for (size_t i = 0; i < ctx->simpleCommand().size(); i++) {
+            HeapCommand *cmd = visit(ctx->simpleCommand(i));
+            pipeline->commands.push_back(cmd);
+        }
+        return pipeline;
+    }
+
+    antlrcpp::Any visitSimpleCommand(ShellGrammarParser::SimpleCommandContext *ctx) override {
+        HeapCommand *cmd = new HeapCommand();
+        std::string program = visit(ctx->string(0));
+        cmd->program = program;
+        for (size_t i = 1; i < ctx->string().size(); i++) {
+            std::string arg = visit(ctx->string(i));
+            cmd->arguments.push_back(arg);
+        }
+        for (size_t i = 0; i < ctx->ioRedirect().size(); i++) {
+            ShellGrammarParser::IoRedirectContext *ioRedir = ctx->ioRedirect(i);
+            std::string redir = ioRedir->REDIRECT() ? ioRedir->REDIRECT()->getText() : ioRedir->REDIRECTFD()->getText();
+            size_t redirChar = std::isdigit(redir[0]) ? 1 : 0;
+            IORedirect::Type redirType = redir[redirChar] == '<' ? IORedirect::INPUT : IORedirect::OUTPUT;
+            if (redir.size() > redirChar + 1 && redir[redirChar + 1] == '>')
+                redirType = IORedirect::APPEND;
+            int fd = redirChar == 0 ? (redirType == IORedirect::INPUT ? 0 : 1) : redir[0] - '0';
+            std::string outFile;
+            if (ioRedir->REDIRECT()) {
+                std::string s = visit(ioRedir->string());
+                outFile = s;
+            } else {
+                outFile = redir.substr(redir.find('&'));
+            }
+            cmd->redirects.push_back(HeapRedirect{fd, redirType, outFile});
+        }
+        return cmd;
+    }
+
+    antlrcpp::Any visitString(ShellGrammarParser::StringContext *ctx) override {
+        if (ctx->STRING())
+            return ctx->STRING()->getText();
+        std::string str = ctx->QUOTEDSTRING()->getText();
+        return str.substr(1, str.size() - 2);
+    }
+};
+
+struct Result {
+    double micros;
+    double allocations;
+};
+
+template<typename Build>
+static Result measure(std::vector<ShellGrammarParser::SequenceContext *> const &trees, int repetitions, Build build) {
+    unsigned long before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repetitions; r++) {
+        for (ShellGrammarParser::SequenceContext *tree : trees)
+            delete build(tree);
+    }
+    double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    double lines = static_cast<double>(repetitions) * trees.size();
+    return Result{micros / lines, (allocations - before) / lines};
+}
+
+int main(int argc, char **argv) {
+    int repetitions = argc > 1 ? atoi(argv[1]) : 2000;
+
+    // Parse every line once, each with its own parser so the trees stay alive
+    std::vector<std::unique_ptr<ShellLexer>> lexers;
+    std::vector<std::unique_ptr<antlr4::CommonTokenStream>> streams;
+    std::vector<std::unique_ptr<ShellGrammarParser>> parsers;
+    std::vector<ShellGrammarParser::SequenceContext *> trees;
+    for (const char *line : LINES) {
+        lexers.emplace_back(new ShellLexer());
+        lexers.back()->setInput(line);
+        streams.emplace_back(new antlr4::CommonTokenStream(lexers.back().get()));
+        parsers.emplace_back(new ShellGrammarParser(streams.back().get()));
+        trees.push_back(parsers.back()->sequence());
+    }
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+
+    CommandVisitor typed("");
+    BoxedVisitor boxed;
+    Result boxedResult = measure(trees, repetitions, [&](ShellGrammarParser::SequenceContext *tree) {
+        return boxed.visit(tree).as<HeapSequence *>();
+    });
+    Result typedResult = measure(trees, repetitions, [&](ShellGrammarParser::SequenceContext *tree) {
+        return typed.visitSequence(tree);
+    });
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(null);
+
+    printf("%zu lines, %d repetitions\n", trees.size(), repetitions);
+    printf("%-22s %14s %14s\n", "visitor", "us/line", "allocs/line");
+    printf("%-22s %14.2f %14.1f\n", "antlrcpp::Any + heap", boxedResult.micros, boxedResult.allocations);
+    printf("%-22s %14.2f %14.1f\n", "CommandVisitor + arena", typedResult.micros, typedResult.allocations);
+    return 0;
+}
@@ -0,0 +1,245 @@
+/**
+ * Startup cost of the ATNs of the generated recognizers.
+ *
+ * For ShellGrammarLexer and ShellGrammarParser it compares the way their ATN
+ * used to be made in the static initializer of every process, ATNDeserializer
+ * on the serialized ATN with verification, to AtnImage::load() on the tables
+ * made at build time. Both include creating the DFA of every decision. The
+ * two ATNs must serialize to the same thing, otherwise the benchmark fails.
+ *
+ * Counted are, like perf stat does, task clock, cycles, instructions and page
+ * faults through perf_event_open, where the kernel allows it, and heap
+ * allocations. Every value is the median of the repetitions.
+ *
+ * Then every shell given (the one that was built by default, add an older
+ * build to compare) is started with -c '' as often and the median wall clock
+ * time, CPU time and page faults of a run are reported. SHELL_DFA_CACHE is
+ * empty for them.
+ *
+ * usage: atn_startup [-n repetitions] [shell...]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <linux/perf_event.h>
+#include <spawn.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atn/ATNDeserializer.h>
+#include <atn/ATNSerializer.h>
+#include <dfa/DFA.h>
+#include "AtnImage.h"
+#include "ShellGrammarLexerAtn.h"
+#include "ShellGrammarParserAtn.h"
+#include "alloc_count.h"
+
+#ifndef SHELL_BINARY
+#define SHELL_BINARY "./shell"
+#endif
+
+extern char **environ;
+
+/**
+ * The counters of perf stat that this kernel lets us have
+ */
+class Counters {
+public:
+    static const int COUNT = 4;
+
+private:
+    int fds[COUNT];
+
+public:
+    static const char *NAMES[COUNT];
+
+    Counters() {
+        static const uint32_t TYPES[COUNT] = {PERF_TYPE_SOFTWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                              PERF_TYPE_SOFTWARE};
+        static const uint64_t CONFIGS[COUNT] = {PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_HW_CPU_CYCLES,
+                                                PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_SW_PAGE_FAULTS};
+        for (int i = 0; i < COUNT; i++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = TYPES[i];
+            attr.config = CONFIGS[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+    }
+
+    Counters(Counters const &) = delete;
+
+    ~Counters() {
+        for (int fd : fds) {
+            if (fd != -1)
+                close(fd);
+        }
+    }
+
+    bool has(int counter) const { return fds[counter] != -1; }
+
+    void start() {
+        for (int fd : fds) {
+            if (fd != -1) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    void stop(double *values) {
+        for (int i = 0; i < COUNT; i++) {
+            uint64_t value = 0;
+            if (fds[i] != -1) {
+                ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+                if (read(fds[i], &value, sizeof(value)) != sizeof(value))
+                    value = 0;
+            }
+            values[i] = static_cast<double>(value);
+        }
+    }
+};
+
+const char *Counters::NAMES[Counters::COUNT] = {"task_clock_ns", "cycles", "instructions", "page_faults"};
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+static void createDFA(antlr4::atn::ATN const &atn) {
+    std::vector<antlr4::dfa::DFA> decisionToDFA;
+    decisionToDFA.reserve(atn.getNumberOfDecisions());
+    for (size_t i = 0; i < atn.getNumberOfDecisions(); i++)
+        decisionToDFA.emplace_back(atn.getDecisionState(i), i);
+}
+
+/**
+ * Measure one way of making the ATN and print the medians
+ */
+template<typename Make>
+static void measure(const char *name, int repetitions, Counters &counters, Make make) {
+    std::vector<std::vector<double>> samples(Counters::COUNT + 2);
+    for (int r = 0; r < repetitions; r++) {
+        double values[Counters::COUNT];
+        unsigned long allocationsBefore = allocations;
+        auto start = std::chrono::steady_clock::now();
+        counters.start();
+        make();
+        counters.stop(values);
+        samples[0].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        samples[1].push_back(allocations - allocationsBefore);
+        for (int i = 0; i < Counters::COUNT; i++)
+            samples[i + 2].push_back(values[i]);
+    }
+
+    printf("  %-12s %10.1f %10.0f", name, median(samples[0]), median(samples[1]));
+    for (int i = 0; i < Counters::COUNT; i++) {
+        if (counters.has(i))
+            printf(" %14.0f", median(samples[i + 2]));
+        else
+            printf(" %14s", "n/a");
+    }
+    printf("\n");
+}
+
+/**
+ * @return false if the image doesn't make the ATN the serialized one does
+ */
+static bool compare(const char *name, AtnImage const &image, int repetitions, Counters &counters) {
+    std::vector<uint16_t> serialized(image.serialized, image.serialized + image.serializedSize);
+    antlr4::atn::ATN deserialized = antlr4::atn::ATNDeserializer().deserialize(serialized);
+    antlr4::atn::ATN loaded = image.load();
+    if (antlr4::atn::ATNSerializer::getSerialized(&deserialized) != antlr4::atn::ATNSerializer::getSerialized(&loaded)) {
+        fprintf(stderr, "%s: the image is not the same ATN\n", name);
+        return false;
+    }
+
+    printf("%s: %zu states, %zu decisions\n", name, loaded.states.size(), loaded.getNumberOfDecisions());
+    printf("  %-12s %10s %10s", "", "wall_us", "allocs");
+    for (const char *counter : Counters::NAMES)
+        printf(" %14s", counter);
+    printf("\n");
+    measure("deserialize", repetitions, counters, [&] {
+        antlr4::atn::ATN atn = antlr4::atn::ATNDeserializer().deserialize(serialized);
+        createDFA(atn);
+    });
+    measure("image", repetitions, counters, [&] {
+        antlr4::atn::ATN atn = image.load();
+        createDFA(atn);
+    });
+    return true;
+}
+
+/**
+ * Start the shell with -c '' repeatedly and print the medians
+ */
+static void startShell(const char *path, int repetitions) {
+    std::vector<std::string> environment = {"SHELL_DFA_CACHE="};
+    for (char **variable = environ; *variable != nullptr; variable++) {
+        if (strncmp(*variable, "SHELL_DFA_CACHE=", 16) != 0)
+            environment.push_back(*variable);
+    }
+    std::vector<char *> envp;
+    for (std::string &variable : environment)
+        envp.push_back(&variable[0]);
+    envp.push_back(nullptr);
+    char *argv[] = {const_cast<char *>(path), const_cast<char *>("-c"), const_cast<char *>(""), nullptr};
+
+    std::vector<double> wall, cpu, faults;
+    for (int r = 0; r < repetitions; r++) {
+        auto start = std::chrono::steady_clock::now();
+        pid_t pid;
+        if (posix_spawn(&pid, path, nullptr, nullptr, argv, envp.data()) != 0) {
+            perror(path);
+            return;
+        }
+        int status;
+        struct rusage usage;
+        if (wait4(pid, &status, 0, &usage) != pid)
+            return;
+        wall.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        cpu.push_back(usage.ru_utime.tv_sec * 1e6 + usage.ru_utime.tv_usec +
+                      usage.ru_stime.tv_sec * 1e6 + usage.ru_stime.tv_usec);
+        faults.push_back(usage.ru_minflt + usage.ru_majflt);
+    }
+    printf("  %-40s %10.0f %10.0f %12.0f\n", path, median(wall), median(cpu), median(faults));
+}
+
+int main(int argc, char **argv) {
+    int repetitions = 200;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n': repetitions = std::max(1, atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: atn_startup [-n repetitions] [shell...]\n");
+                return 2;
+        }
+    }
+
+    Counters counters;
+    if (!compare("ShellGrammarLexer", ShellGrammarLexerAtn, repetitions, counters) ||
+        !compare("ShellGrammarParser", ShellGrammarParserAtn, repetitions, counters))
+        return 1;
+
+    printf("\nshell -c '', %d runs\n  %-40s %10s %10s %12s\n", repetitions, "", "wall_us", "cpu_us", "page_faults");
+    if (optind == argc) {
+        startShell(SHELL_BINARY, repetitions);
+    } else {
+        for (int i = optind; i < argc; i++)
+            startShell(argv[i], repetitions);
+    }
+    return 0;
+}
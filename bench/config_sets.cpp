@@ -0,0 +1,251 @@
+/**
+ * ATNConfigSet benchmark.
+ *
+ * Closure adds every config it reaches to an ATNConfigSet, which either keeps
+ * it or merges its context into the config with the same state, alternative
+ * and predicate. This benchmark measures that on the configs prediction
+ * really makes:
+ *  - dfa:   warms the DFA of ShellGrammarLexer and ShellGrammarParser, then
+ *           adds the configs of every DFA state to a new set, each of them
+ *           twice so half the adds merge.
+ *  - large: the decisions of ShellGrammar are small, so this adds a config
+ *           for every state of the parser ATN and three alternatives to a
+ *           single set, twice, the second time with another context so the
+ *           contexts are merged. That is the size of set closure makes for
+ *           the decisions of larger grammars.
+ *           Both are compared to the lookup the runtime used before, a
+ *           std::unordered_map from the hash code to the config, and report
+ *           nanoseconds and calls of operator new per add.
+ *  - cold:  lexes and parses lines with the DFAs cleared before every line, so
+ *           every decision runs closure, with SLL and with full LL prediction.
+ *           Reported are microseconds and calls of operator new per line.
+ *
+ * usage: config_sets [repetitions]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <ANTLRInputStream.h>
+#include <CommonTokenStream.h>
+#include <atn/ATNConfig.h>
+#include <atn/ATNConfigSet.h>
+#include <atn/LexerATNConfig.h>
+#include <atn/LexerATNSimulator.h>
+#include <atn/OrderedATNConfigSet.h>
+#include <atn/ParserATNSimulator.h>
+#include <atn/PredictionContext.h>
+#include <atn/SemanticContext.h>
+#include <dfa/DFA.h>
+#include "../gen/ShellGrammarLexer.h"
+#include "../gen/ShellGrammarParser.h"
+#include "alloc_count.h"
+
+using antlr4::atn::ATNConfig;
+
+static const char *WORDS[] = {"ls", "-la", "grep", "src", "main.cpp", "cat", "sort", "-rn", "uniq", "wc",
+                              "/usr/local/bin", "README.md", "--verbose", "build", "x", "caf\xc3\xa9",
+                              "\"quoted text\"", "2>&1", "2>", ">>", "<"};
+
+static double nanosSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * The configs to add to one set, with their contexts, and whether they belong to the lexer
+ */
+struct Adds {
+    std::vector<Ref<ATNConfig>> configs;
+    std::vector<Ref<antlr4::atn::PredictionContext>> contexts; //< Merging replaces them, so they are restored.
+    bool lexer;
+};
+
+/**
+ * The lookup ATNConfigSet used before, for comparison: configs by hash code alone
+ */
+class MapConfigSet {
+private:
+    std::vector<Ref<ATNConfig>> configs;
+    std::unordered_map<size_t, ATNConfig *> lookup;
+    bool ordered;
+
+    size_t hash(ATNConfig *config) const {
+        if (ordered)
+            return config->hashCode();
+        size_t hashCode = 7;
+        hashCode = 31 * hashCode + config->state->stateNumber;
+        hashCode = 31 * hashCode + config->alt;
+        hashCode = 31 * hashCode + config->semanticContext->hashCode();
+        return hashCode;
+    }
+
+public:
+    explicit MapConfigSet(bool ordered) : ordered(ordered) {}
+
+    void add(Ref<ATNConfig> const &config, antlr4::atn::PredictionContextMergeCache *mergeCache) {
+        ATNConfig *&existing = lookup[hash(config.get())];
+        if (existing == nullptr) {
+            existing = config.get();
+            configs.push_back(config);
+            return;
+        }
+        existing->reachesIntoOuterContext = std::max(existing->reachesIntoOuterContext,
+                                                     config->reachesIntoOuterContext);
+        // Like the sets of the lexer (full context) and of the parser DFA (SLL)
+        existing->context = antlr4::atn::PredictionContext::merge(existing->context, config->context, !ordered,
+                                                                  mergeCache);
+    }
+};
+
+static void collect(antlr4::dfa::DFA const &dfa, bool lexer, std::vector<Adds> &adds) {
+    for (antlr4::dfa::DFAState *state : dfa.states) {
+        if (state->configs == nullptr || state->configs->configs.empty())
+            continue;
+        Adds entry;
+        entry.lexer = lexer;
+        for (int round = 0; round < 2; round++) {
+            for (Ref<ATNConfig> const &config : state->configs->configs) {
+                if (lexer)
+                    entry.configs.push_back(std::make_shared<antlr4::atn::LexerATNConfig>(
+                            static_cast<antlr4::atn::LexerATNConfig &>(*config)));
+                else
+                    entry.configs.push_back(std::make_shared<ATNConfig>(*config));
+            }
+        }
+        for (Ref<ATNConfig> const &config : entry.configs)
+            entry.contexts.push_back(config->context);
+        adds.push_back(entry);
+    }
+}
+
+/**
+ * Add the configs of every entry to a new set of type Set
+ */
+template<typename Set, typename Make>
+static void addAll(std::vector<Adds> &adds, antlr4::atn::PredictionContextMergeCache &mergeCache, Make make) {
+    for (Adds &entry : adds) {
+        for (size_t i = 0; i < entry.configs.size(); i++)
+            entry.configs[i]->context = entry.contexts[i];
+        std::unique_ptr<Set> set(make(entry.lexer));
+        for (Ref<ATNConfig> const &config : entry.configs)
+            set->add(config, &mergeCache);
+        mergeCache.clear();
+    }
+}
+
+/**
+ * Print the time in units of nanoseconds and the calls of operator new per item
+ */
+template<typename Run>
+static void measure(const char *name, size_t repetitions, size_t perRun, double unit, Run run) {
+    size_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < repetitions; r++)
+        run();
+    double nanos = nanosSince(start);
+    printf("%-14s %12.1f %14.2f\n", name, nanos / unit / (repetitions * perRun),
+           static_cast<double>(allocations - before) / (repetitions * perRun));
+}
+
+int main(int argc, char **argv) {
+    size_t repetitions = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200;
+    if (repetitions == 0) {
+        fprintf(stderr, "usage: config_sets [repetitions]\n");
+        return 2;
+    }
+
+    antlr4::ANTLRInputStream empty;
+    ShellGrammarLexer lexer(&empty);
+    antlr4::CommonTokenStream tokens(&lexer);
+    ShellGrammarParser parser(&tokens);
+    lexer.removeErrorListeners();
+    parser.removeErrorListeners();
+    auto *lexerInterpreter = lexer.getInterpreter<antlr4::atn::LexerATNSimulator>();
+    auto *parserInterpreter = parser.getInterpreter<antlr4::atn::ParserATNSimulator>();
+
+    std::mt19937 random(7);
+    std::vector<std::string> lines;
+    for (int i = 0; i < 500; i++) {
+        std::string line = WORDS[random() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+        for (unsigned n = random() % 8; n > 0; n--) {
+            line += " ";
+            line += WORDS[random() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+            if (random() % 6 == 0)
+                line += random() % 2 == 0 ? " | " : " ; ";
+        }
+        lines.push_back(line);
+    }
+
+    // The lexer rewinds its previous input when it gets a new one, so there is just one
+    antlr4::ANTLRInputStream input;
+    auto parseLine = [&](std::string const &line) {
+        input.load(line);
+        lexer.setInputStream(&input);
+        tokens.setTokenSource(&lexer);
+        parser.setTokenStream(&tokens);
+        parser.sequence();
+    };
+    for (std::string const &line : lines)
+        parseLine(line);
+
+    std::vector<Adds> adds;
+    for (size_t mode = 0; mode < lexer.getATN().modeToStartState.size(); mode++)
+        collect(lexerInterpreter->getDFA(mode), true, adds);
+    for (antlr4::dfa::DFA const &dfa : parserInterpreter->decisionToDFA)
+        collect(dfa, false, adds);
+
+    std::vector<Ref<antlr4::atn::PredictionContext>> contexts;
+    for (Adds const &entry : adds) {
+        if (!entry.lexer)
+            contexts.insert(contexts.end(), entry.contexts.begin(), entry.contexts.end());
+    }
+    std::vector<Adds> large(1);
+    large[0].lexer = false;
+    for (size_t round = 0; round < 2; round++) {
+        for (antlr4::atn::ATNState *state : parser.getATN().states) {
+            for (size_t alt = 1; alt <= 3; alt++) {
+                Ref<antlr4::atn::PredictionContext> context = contexts[(state->stateNumber + alt + round) % contexts.size()];
+                large[0].configs.push_back(std::make_shared<ATNConfig>(state, alt, context));
+                large[0].contexts.push_back(context);
+            }
+        }
+    }
+
+    size_t addCount = 0;
+    for (Adds const &entry : adds)
+        addCount += entry.configs.size();
+    printf("%zu DFA states, %zu adds; large set: %zu adds\n", adds.size(), addCount, large[0].configs.size());
+    printf("%-14s %12s %14s\n", "", "ns_per_add", "allocs_per_add");
+    antlr4::atn::PredictionContextMergeCache mergeCache;
+    auto makeSet = [](bool lexer) {
+        return lexer ? new antlr4::atn::OrderedATNConfigSet() : new antlr4::atn::ATNConfigSet(false);
+    };
+    auto makeMap = [](bool lexer) { return new MapConfigSet(lexer); };
+    measure("dfa", repetitions, addCount, 1, [&] { addAll<antlr4::atn::ATNConfigSet>(adds, mergeCache, makeSet); });
+    measure("dfa_map", repetitions, addCount, 1, [&] { addAll<MapConfigSet>(adds, mergeCache, makeMap); });
+    measure("large", repetitions, large[0].configs.size(), 1, [&] {
+        addAll<antlr4::atn::ATNConfigSet>(large, mergeCache, makeSet);
+    });
+    measure("large_map", repetitions, large[0].configs.size(), 1, [&] {
+        addAll<MapConfigSet>(large, mergeCache, makeMap);
+    });
+
+    printf("%-14s %12s %14s\n", "", "us_per_line", "allocs_per_line");
+    size_t coldLines = std::max<size_t>(1, repetitions / 10);
+    auto cold = [&] {
+        for (size_t i = 0; i < coldLines; i++) {
+            lexerInterpreter->clearDFA();
+            parserInterpreter->clearDFA();
+            parseLine(lines[i % lines.size()]);
+        }
+    };
+    parserInterpreter->setPredictionMode(antlr4::atn::PredictionMode::SLL);
+    measure("cold_sll", 1, coldLines, 1e3, cold);
+    parserInterpreter->setPredictionMode(antlr4::atn::PredictionMode::LL);
+    measure("cold_ll", 1, coldLines, 1e3, cold);
+    return 0;
+}
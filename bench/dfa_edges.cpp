@@ -0,0 +1,150 @@
+/**
+ * DFA edge table benchmark.
+ *
+ * Warms the DFA of ShellGrammarLexer and ShellGrammarParser on a corpus of
+ * command lines, some of them with non-ASCII words, and then compares the
+ * edge tables of the states they made (antlr4::dfa::DFAEdges) to the
+ * std::unordered_map<size_t, DFAState *> the runtime used before, filled with
+ * the same edges:
+ *  - memory:  bytes per state, the table itself plus what it allocated
+ *  - lookup:  nanoseconds per lookup of a mix of existing and missing edges,
+ *             the way getExistingTargetState looks them up, without the lock
+ * End to end lexing and parsing times are what parser_micro measures.
+ *
+ * usage: dfa_edges [lookups]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <ANTLRInputStream.h>
+#include <CommonTokenStream.h>
+#include <atn/LexerATNSimulator.h>
+#include <atn/ParserATNSimulator.h>
+#include <dfa/DFA.h>
+#include "../gen/ShellGrammarLexer.h"
+#include "../gen/ShellGrammarParser.h"
+#include "alloc_count.h"
+
+static const char *WORDS[] = {"ls", "-la", "grep", "src", "main.cpp", "cat", "sort", "-rn", "uniq", "wc",
+                              "/usr/local/bin", "README.md", "--verbose", "build", "x", "caf\xc3\xa9",
+                              "\xe6\x97\xa5\xe6\x9c\xac", "\"quoted text\"", "2>&1", "2>", ">>", "<"};
+
+typedef std::unordered_map<size_t, antlr4::dfa::DFAState *> EdgeMap;
+
+struct Query {
+    size_t state;
+    size_t symbol;
+};
+
+static void collect(antlr4::dfa::DFA const &dfa, std::vector<antlr4::dfa::DFAState *> &states) {
+    for (antlr4::dfa::DFAState *state : dfa.states)
+        states.push_back(state);
+}
+
+/**
+ * Compare the edge tables of the states with maps of the same edges
+ */
+static void compare(const char *name, std::vector<antlr4::dfa::DFAState *> const &states, size_t lookups) {
+    size_t edges = 0, tableBytes = 0;
+    std::vector<EdgeMap *> maps;
+    size_t before = allocatedBytes;
+    for (antlr4::dfa::DFAState *state : states) {
+        EdgeMap *map = new EdgeMap();
+        state->edges.forEach([&](size_t symbol, antlr4::dfa::DFAState *target) { (*map)[symbol] = target; });
+        maps.push_back(map);
+    }
+    size_t mapBytes = allocatedBytes - before;
+    for (antlr4::dfa::DFAState *state : states) {
+        edges += state->edges.size();
+        tableBytes += sizeof(antlr4::dfa::DFAEdges) + state->edges.allocatedSize();
+    }
+
+    // Nine in ten lookups find an edge, as in a warm DFA
+    std::mt19937 random(42);
+    std::vector<Query> queries;
+    for (size_t i = 0; i < 1 << 16; i++) {
+        size_t index = random() % states.size();
+        std::vector<size_t> symbols;
+        states[index]->edges.forEach([&](size_t symbol, antlr4::dfa::DFAState *) { symbols.push_back(symbol); });
+        if (symbols.empty() || random() % 10 == 0)
+            queries.push_back({index, random() % 256});
+        else
+            queries.push_back({index, symbols[random() % symbols.size()]});
+    }
+
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        Query const &query = queries[i & (queries.size() - 1)];
+        found += states[query.state]->edges.get(query.symbol) != nullptr;
+    }
+    double tableNanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    size_t mapFound = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        Query const &query = queries[i & (queries.size() - 1)];
+        EdgeMap const &map = *maps[query.state];
+        auto iterator = map.find(query.symbol);
+        mapFound += iterator != map.end() && iterator->second != nullptr;
+    }
+    double mapNanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    if (found != mapFound)
+        fprintf(stderr, "%s: the edge table found %zu edges, the map %zu\n", name, found, mapFound);
+    printf("%-8s %7zu %7zu %14.1f %14.1f %14.2f %14.2f\n", name, states.size(), edges,
+           static_cast<double>(tableBytes) / states.size(), static_cast<double>(mapBytes) / states.size(),
+           tableNanos / lookups, mapNanos / lookups);
+
+    for (EdgeMap *map : maps)
+        delete map;
+}
+
+int main(int argc, char **argv) {
+    size_t lookups = argc > 1 ? strtoul(argv[1], nullptr, 10) : 50000000;
+    if (lookups == 0) {
+        fprintf(stderr, "usage: dfa_edges [lookups]\n");
+        return 2;
+    }
+
+    antlr4::ANTLRInputStream empty;
+    ShellGrammarLexer lexer(&empty);
+    antlr4::CommonTokenStream tokens(&lexer);
+    ShellGrammarParser parser(&tokens);
+    lexer.removeErrorListeners();
+    parser.removeErrorListeners();
+
+    std::mt19937 random(7);
+    for (int i = 0; i < 2000; i++) {
+        std::string line = WORDS[random() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+        for (unsigned n = random() % 8; n > 0; n--) {
+            line += " ";
+            line += WORDS[random() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+            if (random() % 6 == 0)
+                line += random() % 2 == 0 ? " | " : " ; ";
+        }
+        antlr4::ANTLRInputStream input(line);
+        lexer.setInputStream(&input);
+        tokens.setTokenSource(&lexer);
+        parser.setTokenStream(&tokens);
+        parser.sequence();
+    }
+
+    std::vector<antlr4::dfa::DFAState *> lexerStates, parserStates;
+    auto *lexerInterpreter = lexer.getInterpreter<antlr4::atn::LexerATNSimulator>();
+    for (size_t mode = 0; mode < lexer.getATN().modeToStartState.size(); mode++)
+        collect(lexerInterpreter->getDFA(mode), lexerStates);
+    for (antlr4::dfa::DFA const &dfa : parser.getInterpreter<antlr4::atn::ParserATNSimulator>()->decisionToDFA)
+        collect(dfa, parserStates);
+
+    printf("%-8s %7s %7s %14s %14s %14s %14s\n", "", "states", "edges", "table_bytes", "map_bytes", "table_ns",
+           "map_ns");
+    compare("lexer", lexerStates, lookups);
+    compare("parser", parserStates, lookups);
+    return 0;
+}
@@ -0,0 +1,86 @@
+/**
+ * History search benchmark.
+ *
+ * Writes a synthetic history of N entries to a temporary file, then times
+ * indexing it (HistoryStore) and building the trigram index (HistorySearch),
+ * followed by the latency of finding the most recent match for common, rare
+ * and absent queries. Queries should stay well below a millisecond no matter
+ * how long the history is.
+ *
+ * usage: history_search [entries] [queries]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "HistorySearch.h"
+#include "HistoryStore.h"
+
+static const char *COMMANDS[] = {"ls", "cd", "git", "make", "grep", "cat", "vim", "ssh", "docker", "python3"};
+static const char *ARGUMENTS[] = {"-la", "status", "commit -m", "src/", "build", "--help", "origin", "main",
+                                  "test", "release", "logs", "-rn", "README.md", "host", "run"};
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void writeHistory(std::string const &path, size_t entries) {
+    FILE *file = fopen(path.c_str(), "w");
+    std::mt19937 random(42);
+    for (size_t i = 0; i < entries; i++) {
+        fprintf(file, "%s %s %s-%u\n", COMMANDS[random() % 10], ARGUMENTS[random() % 15],
+                ARGUMENTS[random() % 15], static_cast<unsigned>(random() % 100000));
+    }
+    // something to look for that is rare and old
+    fprintf(file, "echo needle in a haystack\n");
+    for (size_t i = 0; i < entries / 10; i++)
+        fprintf(file, "%s %s\n", COMMANDS[random() % 10], ARGUMENTS[random() % 15]);
+    fclose(file);
+}
+
+int main(int argc, char **argv) {
+    size_t entries = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    int queries = argc > 2 ? atoi(argv[2]) : 1000;
+
+    char directory[] = "/tmp/history_search.XXXXXX";
+    if (mkdtemp(directory) == nullptr) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    std::string path = std::string(directory) + "/history.txt";
+    writeHistory(path, entries);
+
+    auto start = std::chrono::steady_clock::now();
+    HistoryStore store(path);
+    size_t size = store.size();
+    printf("offset index of %zu entries: %.1f ms\n", size, elapsedMs(start));
+
+    HistorySearch search(&store);
+    start = std::chrono::steady_clock::now();
+    search.findBefore("warm up", size);
+    printf("trigram index: %.1f ms\n", elapsedMs(start));
+
+    printf("%-24s %10s %10s %10s\n", "query", "p50 us", "p99 us", "match");
+    const char *patterns[] = {"git status", "docker logs", "needle", "no such entry", "ls"};
+    for (const char *pattern : patterns) {
+        std::vector<double> samples;
+        long match = -1;
+        for (int i = 0; i < queries; i++) {
+            auto queryStart = std::chrono::steady_clock::now();
+            match = search.findBefore(pattern, size);
+            samples.push_back(elapsedMs(queryStart) * 1000);
+        }
+        std::sort(samples.begin(), samples.end());
+        printf("%-24s %10.1f %10.1f %10ld\n", pattern, samples[samples.size() / 2],
+               samples[samples.size() * 99 / 100], match);
+    }
+
+    unlink(path.c_str());
+    unlink((std::string(directory) + "/history.idx").c_str());
+    rmdir(directory);
+    return 0;
+}
@@ -0,0 +1,209 @@
+/**
+ * Lexer benchmark.
+ *
+ * First checks that ShellLexer produces the same tokens and errors as the
+ * generated ShellGrammarLexer, with every scanner this CPU supports, for a
+ * number of random lines made of the characters the grammar cares about.
+ * Then lexes a large pasted input of realistic commands with both lexers and
+ * reports the throughput. Exits with a failure on the first difference.
+ *
+ * usage: lexer_scan [random lines] [megabytes of pasted input]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <ANTLRInputStream.h>
+#include <BaseErrorListener.h>
+#include "../gen/ShellGrammarLexer.h"
+#include "ShellLexer.h"
+
+static const char *PIECES[] = {
+        "ls", "echo", "a", "word", "-la", "src/main.cpp", "\xc3\xa9", "\xe6\x97\xa5\xe6\x9c\xac", "\xf0\x9f\x90\x9a",
+        ";", "&", "|", ">", ">>", "<", "2>", "1>&2", ">&", "&1", "2>>", "<&0", "12>",
+        "\"", "\"quoted text\"", "\\", "\\ ", "\\\"", "\\\\", "#",
+        " ", "  ", "\t", "\r", "\n", "\r\n", "0", "9",
+        "a-rather-long-argument-that-spans-more-than-thirty-two-bytes",
+        "\"a quoted string that is longer than thirty-two bytes\""
+};
+
+static const char *LINES[] = {
+        "ls -la /usr/local/bin | grep shell > /tmp/found.txt",
+        "git commit -m \"Fix the build on older compilers\" && git push origin main",
+        "make -j8 2>&1 | tee build.log",
+        "cat README.md ; echo done &",
+        "find . -name \\*.cpp | xargs grep -n \"TODO\" >> todo.txt",
+        "echo \"quoted \\\"inner\\\" text\" 2> errors.log < input.txt",
+        "printf \"%s\\n\" caf\xc3\xa9 na\xc3\xafve \xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e"
+};
+
+struct Record {
+    size_t type;
+    std::string text;
+    size_t start;
+    size_t stop;
+    size_t line;
+    size_t charPositionInLine;
+
+    bool operator==(Record const &other) const {
+        return type == other.type && text == other.text && start == other.start && stop == other.stop &&
+               line == other.line && charPositionInLine == other.charPositionInLine;
+    }
+};
+
+class ErrorRecorder : public antlr4::BaseErrorListener {
+public:
+    std::vector<std::string> errors;
+
+    void syntaxError(antlr4::Recognizer * /*recognizer*/, antlr4::Token * /*offendingSymbol*/,
+                     size_t line, size_t charPositionInLine, const std::string &msg,
+                     std::exception_ptr /*e*/) override {
+        errors.push_back(std::to_string(line) + ":" + std::to_string(charPositionInLine) + " " + msg);
+    }
+};
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void collect(antlr4::TokenSource *source, std::vector<Record> *records) {
+    records->clear();
+    while (true) {
+        std::unique_ptr<antlr4::Token> token = source->nextToken();
+        records->push_back(Record{token->getType(), token->getText(), token->getStartIndex(), token->getStopIndex(),
+                                  token->getLine(), token->getCharPositionInLine()});
+        if (token->getType() == antlr4::Token::EOF)
+            break;
+    }
+}
+
+static void print(const char *name, std::vector<Record> const &records, std::vector<std::string> const &errors) {
+    fprintf(stderr, "%s:\n", name);
+    for (Record const &r : records) {
+        fprintf(stderr, "  %3ld '%s' %zu-%ld %zu:%zu\n", static_cast<long>(r.type), r.text.c_str(), r.start,
+                static_cast<long>(r.stop), r.line, r.charPositionInLine);
+    }
+    for (std::string const &error : errors)
+        fprintf(stderr, "  error %s\n", error.c_str());
+}
+
+static bool compare(std::vector<std::string> const &lines) {
+    antlr4::ANTLRInputStream input;
+    ShellGrammarLexer antlrLexer(&input);
+    ShellLexer shellLexer;
+    ErrorRecorder antlrErrors;
+    ErrorRecorder shellErrors;
+    antlrLexer.removeErrorListeners();
+    antlrLexer.addErrorListener(&antlrErrors);
+    shellLexer.setErrorListener(&shellErrors);
+
+    std::vector<Record> expected;
+    std::vector<Record> actual;
+    for (std::string const &line : lines) {
+        antlrErrors.errors.clear();
+        input.load(line);
+        antlrLexer.setInputStream(&input);
+        collect(&antlrLexer, &expected);
+
+        shellErrors.errors.clear();
+        shellLexer.setInput(line);
+        collect(&shellLexer, &actual);
+
+        if (expected != actual || antlrErrors.errors != shellErrors.errors) {
+            fprintf(stderr, "different tokens for '%s'\n", line.c_str());
+            print("ShellGrammarLexer", expected, antlrErrors.errors);
+            print("ShellLexer", actual, shellErrors.errors);
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string pastedInput(size_t bytes) {
+    std::string text;
+    std::mt19937 random(7);
+    while (text.size() < bytes) {
+        text += LINES[random() % (sizeof(LINES) / sizeof(LINES[0]))];
+        text += '\n';
+    }
+    return text;
+}
+
+int main(int argc, char **argv) {
+    size_t randomLines = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+    size_t megabytes = argc > 2 ? strtoul(argv[2], nullptr, 10) : 8;
+
+    std::vector<std::string> lines;
+    std::mt19937 random(42);
+    for (size_t i = 0; i < randomLines; i++) {
+        std::string line;
+        size_t pieces = random() % 24;
+        for (size_t j = 0; j < pieces; j++)
+            line += PIECES[random() % (sizeof(PIECES) / sizeof(PIECES[0]))];
+        lines.push_back(line);
+    }
+    for (const char *line : LINES)
+        lines.push_back(line);
+
+    std::vector<ShellLexer::Scanner> scanners;
+    for (ShellLexer::Scanner scanner : {ShellLexer::SCALAR, ShellLexer::SSE2, ShellLexer::AVX2}) {
+        if (ShellLexer::setScanner(scanner))
+            scanners.push_back(scanner);
+    }
+
+    for (ShellLexer::Scanner scanner : scanners) {
+        ShellLexer::setScanner(scanner);
+        auto start = std::chrono::steady_clock::now();
+        if (!compare(lines)) {
+            fprintf(stderr, "scanner %s differs from ShellGrammarLexer\n", ShellLexer::getScannerName(scanner));
+            return EXIT_FAILURE;
+        }
+        printf("%s: %zu random lines lex identically (%.0f ms)\n", ShellLexer::getScannerName(scanner),
+               lines.size(), elapsedMs(start));
+    }
+
+    std::string text = pastedInput(megabytes << 20);
+    double megabytesRead = text.size() / 1048576.0;
+    printf("\n%zu bytes of pasted input\n", text.size());
+    printf("%-20s %10s %12s %12s\n", "lexer", "ms", "MB/s", "Mtokens/s");
+
+    {
+        auto start = std::chrono::steady_clock::now();
+        antlr4::ANTLRInputStream input(text);
+        ShellGrammarLexer lexer(&input);
+        size_t tokens = 0;
+        while (lexer.nextToken()->getType() != antlr4::Token::EOF)
+            tokens++;
+        double ms = elapsedMs(start);
+        printf("%-20s %10.1f %12.1f %12.2f\n", "ShellGrammarLexer", ms, megabytesRead * 1000 / ms, tokens / ms / 1000);
+    }
+
+    for (ShellLexer::Scanner scanner : scanners) {
+        ShellLexer::setScanner(scanner);
+        ShellLexer lexer;
+
+        auto start = std::chrono::steady_clock::now();
+        lexer.setInput(text);
+        size_t tokens = 0;
+        while (lexer.nextToken()->getType() != antlr4::Token::EOF)
+            tokens++;
+        double ms = elapsedMs(start);
+        std::string name = std::string("ShellLexer ") + ShellLexer::getScannerName(scanner);
+        printf("%-20s %10.1f %12.1f %12.2f\n", name.c_str(), ms, megabytesRead * 1000 / ms, tokens / ms / 1000);
+
+        // Only finding the tokens, without creating antlr4::Tokens for them
+        start = std::chrono::steady_clock::now();
+        lexer.setInput(text);
+        ShellLexer::Span span;
+        tokens = 0;
+        while (lexer.scan(&span))
+            tokens++;
+        ms = elapsedMs(start);
+        name = std::string("  scan() ") + ShellLexer::getScannerName(scanner);
+        printf("%-20s %10.1f %12.1f %12.2f\n", name.c_str(), ms, megabytesRead * 1000 / ms, tokens / ms / 1000);
+    }
+
+    return 0;
+}
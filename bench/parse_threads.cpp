@@ -0,0 +1,219 @@
+/**
+ * Multithreaded parse benchmark.
+ *
+ * Every thread has its own ShellGrammarLexer and ShellGrammarParser. As with
+ * any generated recognizers, they all share the static DFAs of the grammar.
+ * Each thread lexes and parses the same number of generated command lines,
+ * so with perfect scaling the lines per second grow with the thread count.
+ * Two cases are timed for 1, 2, 4, ... up to the maximum number of threads:
+ *  - warm: the DFAs were built beforehand, prediction only reads them
+ *  - cold: the DFAs are cleared first, so the threads build them together
+ * Reported are lines per second over all threads and the speedup over one
+ * thread. Every thread counts its tokens and syntax errors, and the benchmark
+ * fails unless they match a run on one thread.
+ *
+ * usage: parse_threads [-n lines per thread] [-t maximum threads]
+ */
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <ANTLRInputStream.h>
+#include <CommonTokenStream.h>
+#include <atn/LexerATNSimulator.h>
+#include <atn/ParserATNSimulator.h>
+#include "../gen/ShellGrammarLexer.h"
+#include "../gen/ShellGrammarParser.h"
+
+static const char *WORDS[] = {"ls", "-la", "grep", "src", "main.cpp", "cat", "sort", "-rn", "uniq", "wc",
+                              "/usr/local/bin", "README.md", "--verbose", "build", "x", "caf\xc3\xa9",
+                              "\"quoted text\"", "\"a \\\"b\\\" c\""};
+static const char *REDIRECTS[] = {" > out.txt", " >> log.txt", " < in.txt", " 2> err.txt", " 2>&1"};
+
+// Where the lines of a thread start, so threads don't parse the same line at the same time
+static const size_t STRIDE = 7919;
+
+static std::vector<std::string> generate() {
+    std::mt19937 random(42);
+    std::vector<std::string> lines;
+    for (int i = 0; i < 1000; i++) {
+        std::string line = WORDS[random() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+        for (unsigned n = random() % 6; n > 0; n--) {
+            line += " ";
+            line += WORDS[random() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+            if (random() % 5 == 0)
+                line += REDIRECTS[random() % 5];
+            if (random() % 6 == 0)
+                line += random() % 2 == 0 ? " | " : " ; ";
+        }
+        if (random() % 8 == 0)
+            line += " &";
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+/**
+ * The lexer and parser of one thread
+ */
+class Worker {
+private:
+    antlr4::ANTLRInputStream empty;
+    ShellGrammarLexer lexer;
+    antlr4::CommonTokenStream tokens;
+    ShellGrammarParser parser;
+
+public:
+    size_t tokenCount;
+    size_t syntaxErrors;
+
+    Worker() : lexer(&empty), tokens(&lexer), parser(&tokens), tokenCount(0), syntaxErrors(0) {
+        lexer.removeErrorListeners();
+        parser.removeErrorListeners();
+    }
+
+    Worker(Worker const &) = delete;
+
+    /**
+     * Lex and parse count lines, starting at first
+     */
+    void run(std::vector<std::string> const &lines, size_t first, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            antlr4::ANTLRInputStream input(lines[(first + i) % lines.size()]);
+            lexer.setInputStream(&input);
+            tokens.setTokenSource(&lexer);
+            parser.setTokenStream(&tokens);
+            parser.sequence();
+            tokenCount += tokens.size();
+            syntaxErrors += parser.getNumberOfSyntaxErrors();
+        }
+    }
+
+    void clearDFA() {
+        lexer.getInterpreter<antlr4::atn::LexerATNSimulator>()->clearDFA();
+        parser.getInterpreter<antlr4::atn::ParserATNSimulator>()->clearDFA();
+    }
+};
+
+struct Result {
+    double seconds;
+    size_t tokens;
+    size_t syntaxErrors;
+};
+
+/**
+ * Start the threads together and time them until the last one is done
+ */
+static Result runThreads(std::vector<std::string> const &lines, size_t threadCount, size_t count) {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<Worker *> workers(threadCount);
+    size_t ready = 0, finished = 0;
+    bool go = false, collected = false;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; t++) {
+        threads.emplace_back([&, t] {
+            Worker worker;
+            std::unique_lock<std::mutex> lock(mutex);
+            workers[t] = &worker;
+            ready++;
+            changed.notify_all();
+            changed.wait(lock, [&] { return go; });
+            lock.unlock();
+
+            worker.run(lines, t * STRIDE, count);
+
+            lock.lock();
+            finished++;
+            changed.notify_all();
+            changed.wait(lock, [&] { return collected; });
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&] { return ready == threadCount; });
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    changed.notify_all();
+    changed.wait(lock, [&] { return finished == threadCount; });
+    Result result = {std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), 0, 0};
+    for (Worker *worker : workers) {
+        result.tokens += worker->tokenCount;
+        result.syntaxErrors += worker->syntaxErrors;
+    }
+    collected = true;
+    changed.notify_all();
+    lock.unlock();
+
+    for (std::thread &thread : threads)
+        thread.join();
+    return result;
+}
+
+int main(int argc, char **argv) {
+    size_t count = 20000;
+    size_t maxThreads = 32;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:")) != -1) {
+        switch (opt) {
+            case 'n': count = std::max(1L, atol(optarg)); break;
+            case 't': maxThreads = std::max(1L, atol(optarg)); break;
+            default:
+                fprintf(stderr, "usage: parse_threads [-n lines per thread] [-t maximum threads]\n");
+                return 2;
+        }
+    }
+
+    std::vector<std::string> lines = generate();
+
+    // Tokens and syntax errors of every line, parsed on this thread
+    std::vector<size_t> lineTokens, lineErrors;
+    Worker reference;
+    for (size_t i = 0; i < lines.size(); i++) {
+        size_t tokens = reference.tokenCount, errors = reference.syntaxErrors;
+        reference.run(lines, i, 1);
+        lineTokens.push_back(reference.tokenCount - tokens);
+        lineErrors.push_back(reference.syntaxErrors - errors);
+    }
+
+    printf("%zu lines per thread, %u hardware threads\n", count, std::thread::hardware_concurrency());
+    printf("%-6s %8s %14s %8s\n", "", "threads", "lines_per_s", "speedup");
+    for (int cold = 0; cold < 2; cold++) {
+        double single = 0;
+        for (size_t threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+            if (cold)
+                reference.clearDFA();
+            Result result = runThreads(lines, threadCount, count);
+
+            // Every thread ran the same lines, starting somewhere else
+            size_t tokens = 0, errors = 0;
+            for (size_t t = 0; t < threadCount; t++) {
+                for (size_t i = 0; i < count; i++) {
+                    tokens += lineTokens[(t * STRIDE + i) % lines.size()];
+                    errors += lineErrors[(t * STRIDE + i) % lines.size()];
+                }
+            }
+            if (result.tokens != tokens || result.syntaxErrors != errors) {
+                fprintf(stderr, "%zu threads: %zu tokens and %zu syntax errors, expected %zu and %zu\n",
+                        threadCount, result.tokens, result.syntaxErrors, tokens, errors);
+                return 1;
+            }
+
+            double linesPerSecond = threadCount * count / result.seconds;
+            if (threadCount == 1)
+                single = linesPerSecond;
+            printf("%-6s %8zu %14.0f %8.2f\n", cold ? "cold" : "warm", threadCount, linesPerSecond,
+                   linesPerSecond / single);
+        }
+    }
+    return 0;
+}
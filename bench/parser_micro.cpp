@@ -0,0 +1,303 @@
+/**
+ * Parser microbenchmark for the ANTLR runtime.
+ *
+ * Generates synthetic corpora of ShellGrammar input that stress different
+ * parts of the runtime: short everyday lines, pipelines of 1000 stages, long
+ * quoted strings and commands with many redirects. For every corpus it times,
+ * line by line and separately:
+ *  - lex:       ShellGrammarLexer turning the line into tokens (LexerATNSimulator)
+ *  - parse_sll: ShellGrammarParser::sequence() on those tokens with SLL prediction,
+ *               the way LineParser parses first
+ *  - parse_ll:  the same with full LL prediction (ParserATNSimulator,
+ *               PredictionContext and ATNConfigSet in full-context mode)
+ *  - visit:     CommandVisitor building the Sequence from the parse tree
+ * Lexing and parsing are measured warm, with the DFA built by earlier lines,
+ * and cold, with the DFA of lexer or parser cleared before every line. The
+ * PredictionContext cache of the generated recognizers is not cleared.
+ * Besides the time, lexing and parsing report the calls of operator new per
+ * token, counted in the last repetition.
+ *
+ * The result of each measurement is the median of the repetitions. They are
+ * printed as JSON, with an optional label such as a commit id, so runs of
+ * different commits can be compared.
+ *
+ * usage: parser_micro [-r repetitions] [-l label]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ANTLRInputStream.h>
+#include <CommonTokenStream.h>
+#include <atn/LexerATNSimulator.h>
+#include <atn/ParserATNSimulator.h>
+#include "../gen/ShellGrammarLexer.h"
+#include "../gen/ShellGrammarParser.h"
+#include "CommandVisitor.h"
+#include "Sequence.h"
+#include "alloc_count.h"
+
+static const char *WORDS[] = {"ls", "-la", "grep", "src", "main.cpp", "cat", "sort", "-rn", "uniq", "wc",
+                              "/usr/local/bin", "README.md", "--verbose", "build", "x"};
+
+struct Corpus {
+    std::string name;
+    std::vector<std::string> lines;
+};
+
+static std::string word(std::mt19937 &random) {
+    return WORDS[random() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+}
+
+/**
+ * The corpora, the same for every run
+ */
+static std::vector<Corpus> generate() {
+    std::mt19937 random(42);
+    std::vector<Corpus> corpora(4);
+
+    corpora[0].name = "short";
+    for (int i = 0; i < 500; i++) {
+        std::string line = word(random);
+        for (unsigned n = random() % 4; n > 0; n--)
+            line += " " + word(random);
+        if (random() % 3 == 0)
+            line += " | " + word(random) + " " + word(random);
+        if (random() % 4 == 0)
+            line += " > out.txt";
+        if (random() % 5 == 0)
+            line += " ; " + word(random) + " &";
+        corpora[0].lines.push_back(line);
+    }
+
+    corpora[1].name = "pipeline";
+    for (int i = 0; i < 5; i++) {
+        std::string line = word(random);
+        for (int stage = 1; stage < 1000; stage++)
+            line += " | " + word(random) + " " + word(random);
+        corpora[1].lines.push_back(line);
+    }
+
+    corpora[2].name = "quoted";
+    for (int i = 0; i < 50; i++) {
+        std::string text;
+        while (text.size() < 4096)
+            text += word(random) + (random() % 8 == 0 ? " \\\"" : " ");
+        corpora[2].lines.push_back("echo \"" + text + "\" \"" + text.substr(0, 512) + "\" > quoted.txt");
+    }
+
+    static const char *REDIRECTS[] = {" > ", " >> ", " < ", " 2> ", " 2>> "};
+    corpora[3].name = "redirects";
+    for (int i = 0; i < 50; i++) {
+        std::string line = word(random);
+        for (int r = 0; r < 100; r++) {
+            if (random() % 4 == 0)
+                line += " 2>&1";
+            else
+                line += REDIRECTS[random() % 5] + word(random) + ".txt";
+        }
+        corpora[3].lines.push_back(line);
+    }
+
+    return corpora;
+}
+
+static double nanosSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+/**
+ * Everything needed to lex and parse the lines of one corpus
+ */
+class Bench {
+private:
+    std::vector<std::unique_ptr<antlr4::ANTLRInputStream>> inputs;
+    std::vector<std::unique_ptr<antlr4::CommonTokenStream>> streams;
+    antlr4::ANTLRInputStream empty;
+    ShellGrammarLexer lexer;
+    antlr4::CommonTokenStream lexed;      //< Tokens of the line that is being lexed.
+    ShellGrammarParser parser;
+    CommandVisitor visitor;
+
+public:
+    size_t tokens;
+    size_t bytes;
+    size_t syntaxErrors;     //< Lines that did not parse, there should be none.
+    size_t allocations;      //< Calls of operator new while lexing or parsing, in the last run.
+
+    explicit Bench(Corpus const &corpus)
+            : lexer(&empty), lexed(&lexer), parser(&lexed), visitor(""), tokens(0), bytes(0), syntaxErrors(0),
+              allocations(0) {
+        lexer.removeErrorListeners();
+        parser.removeErrorListeners();
+        for (const std::string &line : corpus.lines) {
+            inputs.emplace_back(new antlr4::ANTLRInputStream(line));
+            streams.emplace_back(new antlr4::CommonTokenStream(&lexer));
+            bytes += line.size();
+        }
+
+        // Lex every line once, the parser works on these tokens
+        for (size_t i = 0; i < inputs.size(); i++) {
+            lexer.setInputStream(inputs[i].get());
+            streams[i]->setTokenSource(&lexer);
+            streams[i]->fill();
+            tokens += streams[i]->size();
+        }
+    }
+
+    double lex(bool cold) {
+        double nanos = 0;
+        allocations = 0;
+        for (auto &input : inputs) {
+            if (cold)
+                lexer.getInterpreter<antlr4::atn::LexerATNSimulator>()->clearDFA();
+            input->reset();
+            size_t before = ::allocations;
+            auto start = std::chrono::steady_clock::now();
+            lexer.setInputStream(input.get());
+            lexed.setTokenSource(&lexer);
+            lexed.fill();
+            nanos += nanosSince(start);
+            allocations += ::allocations - before;
+        }
+        return nanos;
+    }
+
+    double parse(bool cold, antlr4::atn::PredictionMode mode) {
+        auto *interpreter = parser.getInterpreter<antlr4::atn::ParserATNSimulator>();
+        interpreter->setPredictionMode(mode);
+        double nanos = 0;
+        allocations = 0;
+        for (auto &stream : streams) {
+            if (cold)
+                interpreter->clearDFA();
+            // setTokenStream() resets the parser before it takes the stream, so rewind it here
+            stream->seek(0);
+            size_t before = ::allocations;
+            auto start = std::chrono::steady_clock::now();
+            parser.setTokenStream(stream.get());
+            parser.sequence();
+            nanos += nanosSince(start);
+            allocations += ::allocations - before;
+            if (parser.getNumberOfSyntaxErrors() != 0)
+                syntaxErrors++;
+        }
+        return nanos;
+    }
+
+    double visit() {
+        parser.getInterpreter<antlr4::atn::ParserATNSimulator>()->setPredictionMode(antlr4::atn::PredictionMode::SLL);
+        double nanos = 0;
+        for (auto &stream : streams) {
+            stream->seek(0);
+            parser.setTokenStream(stream.get());
+            ShellGrammarParser::SequenceContext *tree = parser.sequence();
+            auto start = std::chrono::steady_clock::now();
+            delete visitor.visitSequence(tree);
+            nanos += nanosSince(start);
+        }
+        return nanos;
+    }
+};
+
+template<typename Measure>
+static double measure(int repetitions, Measure run) {
+    std::vector<double> samples;
+    for (int r = 0; r < repetitions; r++)
+        samples.push_back(run());
+    return median(samples);
+}
+
+int main(int argc, char **argv) {
+    int repetitions = 5;
+    std::string label;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:l:")) != -1) {
+        switch (opt) {
+            case 'r': repetitions = std::max(1, atoi(optarg)); break;
+            case 'l': label = optarg; break;
+            default:
+                fprintf(stderr, "usage: parser_micro [-r repetitions] [-l label]\n");
+                return 2;
+        }
+    }
+
+    std::vector<Corpus> corpora = generate();
+
+    // CommandVisitor logs what it visits when PRINT_DEBUG_INFO is on
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+
+    std::string json = "{\n  \"label\": \"" + label + "\",\n  \"repetitions\": " + std::to_string(repetitions) +
+                       ",\n  \"corpora\": [";
+    for (size_t c = 0; c < corpora.size(); c++) {
+        Bench bench(corpora[c]);
+        auto lines = static_cast<double>(corpora[c].lines.size());
+        auto sll = antlr4::atn::PredictionMode::SLL;
+        auto ll = antlr4::atn::PredictionMode::LL;
+
+        // Warm runs go last, after a run that has built the DFA again
+        auto tokens = static_cast<double>(bench.tokens);
+        double lexCold = measure(repetitions, [&] { return bench.lex(true); });
+        double lexColdAllocs = bench.allocations / tokens;
+        bench.lex(false);
+        double lexWarm = measure(repetitions, [&] { return bench.lex(false); });
+        double lexWarmAllocs = bench.allocations / tokens;
+        double sllCold = measure(repetitions, [&] { return bench.parse(true, sll); });
+        double sllColdAllocs = bench.allocations / tokens;
+        bench.parse(false, sll);
+        double sllWarm = measure(repetitions, [&] { return bench.parse(false, sll); });
+        double sllWarmAllocs = bench.allocations / tokens;
+        double llCold = measure(repetitions, [&] { return bench.parse(true, ll); });
+        double llColdAllocs = bench.allocations / tokens;
+        bench.parse(false, ll);
+        double llWarm = measure(repetitions, [&] { return bench.parse(false, ll); });
+        double llWarmAllocs = bench.allocations / tokens;
+        double visit = measure(repetitions, [&] { return bench.visit(); });
+
+        if (bench.syntaxErrors != 0) {
+            fprintf(stderr, "%s: %zu syntax errors\n", corpora[c].name.c_str(), bench.syntaxErrors);
+            return 1;
+        }
+
+        char text[2048];
+        snprintf(text, sizeof(text),
+                 "%s\n    {\n"
+                 "      \"name\": \"%s\", \"lines\": %zu, \"bytes\": %zu, \"tokens\": %zu,\n"
+                 "      \"lex\": {\"cold_ns_per_line\": %.0f, \"warm_ns_per_line\": %.0f, \"warm_mb_per_s\": %.1f,\n"
+                 "              \"cold_allocs_per_token\": %.2f, \"warm_allocs_per_token\": %.2f},\n"
+                 "      \"parse_sll\": {\"cold_ns_per_line\": %.0f, \"warm_ns_per_line\": %.0f,\n"
+                 "                    \"cold_allocs_per_token\": %.2f, \"warm_allocs_per_token\": %.2f},\n"
+                 "      \"parse_ll\": {\"cold_ns_per_line\": %.0f, \"warm_ns_per_line\": %.0f,\n"
+                 "                   \"cold_allocs_per_token\": %.2f, \"warm_allocs_per_token\": %.2f},\n"
+                 "      \"visit\": {\"ns_per_line\": %.0f}\n"
+                 "    }",
+                 c == 0 ? "" : ",", corpora[c].name.c_str(), corpora[c].lines.size(), bench.bytes, bench.tokens,
+                 lexCold / lines, lexWarm / lines, bench.bytes / (lexWarm / 1e3), lexColdAllocs, lexWarmAllocs,
+                 sllCold / lines, sllWarm / lines, sllColdAllocs, sllWarmAllocs,
+                 llCold / lines, llWarm / lines, llColdAllocs, llWarmAllocs, visit / lines);
+        json += text;
+    }
+    json += "\n  ]\n}\n";
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(null);
+
+    fputs(json.c_str(), stdout);
+    return 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * Pipeline setup benchmark.
+ *
+ * Builds pipelines of 'sleep 0 | ... | sleep 0' with up to 1000 stages and
+ * times Pipeline::execute(), i.e. creating the pipes and starting every stage,
+ * for both launch backends. The time per stage should stay flat as the
+ * pipeline grows: setting up a stage costs a constant number of system calls.
+ *
+ * usage: pipeline_setup [repetitions] [stages...]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <sys/wait.h>
+#include "Launcher.h"
+#include "Pipeline.h"
+#include "Shell.h"
+#include "SimpleCommand.h"
+
+static double measure(Launcher::Backend backend, Pipeline *pipeline, Shell *shell, int repetitions) {
+    Launcher::setBackend(backend);
+    std::vector<double> samples;
+
+    for (int i = 0; i < repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<pid_t> pids = pipeline->execute(shell, false);
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+
+        if (pids.size() != pipeline->getCommands().size()) {
+            fprintf(stderr, "only %zu of %zu stages started\n", pids.size(), pipeline->getCommands().size());
+            exit(EXIT_FAILURE);
+        }
+        for (pid_t pid : pids) {
+            int status;
+            waitpid(pid, &status, 0);
+        }
+    }
+
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+int main(int argc, char **argv) {
+    int repetitions = argc > 1 ? atoi(argv[1]) : 5;
+    std::vector<size_t> stageCounts;
+    for (int i = 2; i < argc; i++)
+        stageCounts.push_back(strtoul(argv[i], nullptr, 10));
+    if (stageCounts.empty())
+        stageCounts = {10, 100, 250, 500, 1000};
+
+    Shell shell;
+
+    printf("%8s %14s %14s %14s %14s\n", "stages", "fork p50 us", "fork us/stage", "spawn p50 us", "spawn us/stage");
+    for (size_t stages : stageCounts) {
+        Arena arena;
+        ArenaArray<SimpleCommand> commands(&arena, stages);
+        // Not 'true': builtins always run through fork
+        for (SimpleCommand &cmd : commands)
+            cmd = SimpleCommand(&arena, {"sleep", "0"});
+        Pipeline pipeline(commands);
+
+        double forkMedian = measure(Launcher::FORK, &pipeline, &shell, repetitions);
+        double spawnMedian = measure(Launcher::SPAWN, &pipeline, &shell, repetitions);
+
+        printf("%8zu %14.0f %14.1f %14.0f %14.1f\n", stages,
+               forkMedian, forkMedian / stages, spawnMedian, spawnMedian / stages);
+    }
+
+    return 0;
+}
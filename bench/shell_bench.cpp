@@ -0,0 +1,225 @@
+/**
+ * End-to-end replay benchmark.
+ *
+ * Runs a corpus of command lines (bench/corpus/commands.txt by default) a
+ * number of times through the same front-end and executor as a script: one
+ * LineParser for the whole text and every statement executed by the Shell
+ * before the next one is parsed. Each repetition starts in an empty scratch
+ * directory, the corpus only uses local commands.
+ *
+ * Reported are the p50, p99 and p99.9 latency per line (parsing and executing
+ * it, including waiting for its processes), lines per second, processes
+ * started per line and heap allocations of the shell per line. The output of
+ * the commands goes to /dev/null.
+ *
+ * With -b the results are compared with those saved earlier with -s, and the
+ * benchmark fails when any of them is worse by more than the threshold (-t, in
+ * percent).
+ *
+ * usage: shell_bench [-n repetitions] [-s save] [-b baseline] [-t percent] [corpus]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "LineParser.h"
+#include "Metrics.h"
+#include "Sequence.h"
+#include "Shell.h"
+#include "alloc_count.h"
+
+#ifndef SHELL_BENCH_CORPUS
+#define SHELL_BENCH_CORPUS "bench/corpus/commands.txt"
+#endif
+
+struct Result {
+    const char *name;
+    double value;
+    bool higherIsWorse;
+};
+
+static int removeEntry(const char *path, const struct stat *, int, struct FTW *) {
+    return remove(path);
+}
+
+static double percentile(std::vector<double> const &sorted, double p) {
+    size_t index = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[index == 0 ? 0 : index - 1];
+}
+
+/**
+ * Read the results saved by an earlier run, one 'name value' per line
+ * @return false if the file can't be read
+ */
+static bool readBaseline(std::string const &path, std::vector<Result> *pResults) {
+    std::ifstream file(path.c_str());
+    if (!file)
+        return false;
+    std::string name;
+    double value;
+    while (file >> name >> value) {
+        for (Result &result : *pResults) {
+            if (name == result.name)
+                result.value = value;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int repetitions = 20;
+    double threshold = 10;
+    std::string savePath, baselinePath, corpusPath = SHELL_BENCH_CORPUS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:b:t:")) != -1) {
+        switch (opt) {
+            case 'n': repetitions = atoi(optarg); break;
+            case 's': savePath = optarg; break;
+            case 'b': baselinePath = optarg; break;
+            case 't': threshold = atof(optarg); break;
+            default:
+                fprintf(stderr, "usage: shell_bench [-n repetitions] [-s save] [-b baseline] [-t percent] [corpus]\n");
+                return 2;
+        }
+    }
+    if (optind < argc)
+        corpusPath = argv[optind];
+
+    std::ifstream file(corpusPath.c_str(), std::ios::binary);
+    if (!file) {
+        fprintf(stderr, "%s: %s\n", corpusPath.c_str(), strerror(errno));
+        return 2;
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+    std::string corpus = text.str();
+
+    char scratch[] = "/tmp/shell_bench.XXXXXX";
+    if (mkdtemp(scratch) == nullptr) {
+        perror("mkdtemp");
+        return 2;
+    }
+
+    // The process count comes from the launch stage of the metrics
+    Metrics::enable();
+    Shell shell(false);
+    LineParser parser(shell.getHomeString());
+    std::ostream quiet(nullptr);
+
+    fflush(stdout);
+    int savedOut = dup(STDOUT_FILENO);
+    int savedErr = dup(STDERR_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+
+    std::vector<double> samples;
+    unsigned long allocationsBefore = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repetitions; r++) {
+        // Start over in an empty scratch directory, so every repetition does the same work
+        nftw(scratch, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+        if (mkdir(scratch, 0700) != 0 || chdir(scratch) != 0)
+            break;
+        parser.startScript(corpus, corpusPath);
+
+        while (true) {
+            auto lineStart = std::chrono::steady_clock::now();
+            Sequence *sequence;
+            if (!parser.nextStatement(&sequence))
+                break;
+            if (sequence != nullptr) {
+                sequence->execute(&shell);
+                delete sequence;
+            }
+            samples.push_back(std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - lineStart).count());
+            shell.getJobTable().reap(quiet);
+        }
+        shell.getJobTable().waitAll();
+        shell.getJobTable().reap(quiet);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    unsigned long allocated = allocations - allocationsBefore;
+
+    std::cout.flush();
+    fflush(stdout);
+    dup2(savedOut, STDOUT_FILENO);
+    dup2(savedErr, STDERR_FILENO);
+    close(savedOut);
+    close(savedErr);
+    close(null);
+    nftw(scratch, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+
+    if (samples.empty()) {
+        fprintf(stderr, "%s: no command lines\n", corpusPath.c_str());
+        return 2;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    auto lines = static_cast<double>(samples.size());
+    std::vector<Result> results = {
+            {"p50_us", percentile(samples, 50), true},
+            {"p99_us", percentile(samples, 99), true},
+            {"p999_us", percentile(samples, 99.9), true},
+            {"lines_per_s", lines / seconds, false},
+            {"forks_per_line", Metrics::getCount(Metrics::LAUNCH) / lines, true},
+            {"allocs_per_line", allocated / lines, true},
+    };
+
+    printf("%s: %zu lines, %d repetitions\n", corpusPath.c_str(), samples.size(), repetitions);
+    for (const Result &result : results)
+        printf("%-16s %12.1f\n", result.name, result.value);
+
+    if (!savePath.empty()) {
+        std::ofstream save(savePath.c_str(), std::ios::trunc);
+        for (const Result &result : results)
+            save << result.name << ' ' << result.value << '\n';
+        if (!save) {
+            fprintf(stderr, "%s: could not be written\n", savePath.c_str());
+            return 2;
+        }
+    }
+
+    if (baselinePath.empty())
+        return 0;
+
+    std::vector<Result> baseline = results;
+    for (Result &result : baseline)
+        result.value = NAN;
+    if (!readBaseline(baselinePath, &baseline)) {
+        fprintf(stderr, "%s: %s\n", baselinePath.c_str(), strerror(errno));
+        return 2;
+    }
+
+    // A result is worse when it moved the wrong way by more than the threshold
+    bool regressed = false;
+    printf("\n%-16s %12s %12s %9s\n", "compared to", "baseline", "now", "change");
+    for (size_t i = 0; i < results.size(); i++) {
+        double before = baseline[i].value, now = results[i].value;
+        if (std::isnan(before))
+            continue;
+        double change = before == 0 ? (now == 0 ? 0 : INFINITY) : (now - before) / before * 100;
+        bool worse = results[i].higherIsWorse ? change > threshold : change < -threshold;
+        printf("%-16s %12.1f %12.1f %+8.1f%%%s\n", results[i].name, before, now, change,
+               worse ? "  REGRESSION" : "");
+        regressed |= worse;
+    }
+    if (regressed) {
+        printf("worse than %s by more than %.0f%%\n", baselinePath.c_str(), threshold);
+        return 1;
+    }
+    return 0;
+}
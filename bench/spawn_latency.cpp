@@ -0,0 +1,73 @@
+/**
+ * Spawn latency microbenchmark.
+ *
+ * Starts a single external command ('sleep 0') through Launcher with both the
+ * fork and the spawn backend while the shell process carries heaps of
+ * different sizes, and prints the per-command cost. fork() has to copy the page
+ * tables of the whole heap, so its cost grows with it; posix_spawn() should not.
+ *
+ * usage: spawn_latency [iterations] [heap MiB...]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <sys/wait.h>
+#include "Launcher.h"
+#include "Shell.h"
+#include "SimpleCommand.h"
+
+static double measure(Launcher::Backend backend, SimpleCommand *cmd, Shell *shell,
+                      int iterations, std::vector<double> *samples) {
+    Launcher::setBackend(backend);
+    samples->clear();
+
+    for (int i = 0; i < iterations; i++) {
+        auto start = std::chrono::steady_clock::now();
+        pid_t pid = Launcher::launch(cmd, shell, -1, -1, -1, -1, false);
+        if (pid < 0) {
+            fprintf(stderr, "could not start %s\n", cmd->getCommand());
+            exit(EXIT_FAILURE);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        auto end = std::chrono::steady_clock::now();
+        samples->push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+
+    std::sort(samples->begin(), samples->end());
+    return (*samples)[samples->size() / 2];
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    std::vector<size_t> heapSizes;
+    for (int i = 2; i < argc; i++)
+        heapSizes.push_back(strtoul(argv[i], nullptr, 10));
+    if (heapSizes.empty())
+        heapSizes = {0, 64, 256, 1024};
+
+    Shell shell;
+    Arena arena;
+    // Not 'true': builtins always run through fork
+    SimpleCommand cmd(&arena, {"sleep", "0"});
+    std::vector<double> samples;
+
+    printf("%10s %12s %12s %12s %12s\n", "heap MiB", "fork p50 us", "fork p99 us", "spawn p50 us", "spawn p99 us");
+    for (size_t mib : heapSizes) {
+        // Touch every page so it is really mapped and has to be dealt with on fork
+        std::vector<char> heap(mib << 20);
+        memset(heap.data(), 1, heap.size());
+
+        double forkMedian = measure(Launcher::FORK, &cmd, &shell, iterations, &samples);
+        double forkP99 = samples[samples.size() * 99 / 100];
+        double spawnMedian = measure(Launcher::SPAWN, &cmd, &shell, iterations, &samples);
+        double spawnP99 = samples[samples.size() * 99 / 100];
+
+        printf("%10zu %12.1f %12.1f %12.1f %12.1f\n", mib, forkMedian, forkP99, spawnMedian, spawnP99);
+    }
+
+    return 0;
+}
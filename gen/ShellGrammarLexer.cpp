@@ -3,12 +3,15 @@
 
 
 #include "ShellGrammarLexer.h"
+#include "ShellGrammarLexerAtn.h"
 
 
 using namespace antlr4;
 
 
 ShellGrammarLexer::ShellGrammarLexer(CharStream *input) : Lexer(input) {
+  // The ATN is made when the first instance is, not in every process that links this in
+  static Initializer initializer;
   _interpreter = new atn::LexerATNSimulator(this, _atn, _decisionToDFA, _sharedContextCache);
 }
 
@@ -167,8 +170,8 @@ ShellGrammarLexer::Initializer::Initializer() {
     0x54, 0x3, 0x8, 0x2, 0x2, 
   };
 
-  atn::ATNDeserializer deserializer;
-  _atn = deserializer.deserialize(_serializedATN);
+  // Made from _serializedATN at build time, see AtnImage
+  _atn = ShellGrammarLexerAtn.load();
 
   size_t count = _atn.getNumberOfDecisions();
   _decisionToDFA.reserve(count);
@@ -177,4 +180,3 @@ ShellGrammarLexer::Initializer::Initializer() {
   }
 }
 
-ShellGrammarLexer::Initializer ShellGrammarLexer::_init;
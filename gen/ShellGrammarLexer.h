@@ -52,6 +52,5 @@ private:
   struct Initializer {
     Initializer();
   };
-  static Initializer _init;
 };
 
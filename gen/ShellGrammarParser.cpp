@@ -5,12 +5,15 @@
 #include "ShellGrammarVisitor.h"
 
 #include "ShellGrammarParser.h"
+#include "ShellGrammarParserAtn.h"
 
 
 using namespace antlrcpp;
 using namespace antlr4;
 
 ShellGrammarParser::ShellGrammarParser(TokenStream *input) : Parser(input) {
+  // The ATN is made when the first instance is, not in every process that links this in
+  static Initializer initializer;
   _interpreter = new atn::ParserATNSimulator(this, _atn, _decisionToDFA, _sharedContextCache);
 }
 
@@ -535,8 +538,8 @@ ShellGrammarParser::Initializer::Initializer() {
     0x2, 0x8, 0x14, 0x18, 0x23, 0x29, 0x2e, 0x34, 
   };
 
-  atn::ATNDeserializer deserializer;
-  _atn = deserializer.deserialize(_serializedATN);
+  // Made from _serializedATN at build time, see AtnImage
+  _atn = ShellGrammarParserAtn.load();
 
   size_t count = _atn.getNumberOfDecisions();
   _decisionToDFA.reserve(count);
@@ -545,4 +548,3 @@ ShellGrammarParser::Initializer::Initializer() {
   }
 }
 
-ShellGrammarParser::Initializer ShellGrammarParser::_init;
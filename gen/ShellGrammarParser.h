@@ -143,6 +143,5 @@ private:
   struct Initializer {
     Initializer();
   };
-  static Initializer _init;
 };
 
@@ -45,10 +45,8 @@ bool ATNConfigSet::add(const Ref<ATNConfig> &config, PredictionContextMergeCache
     dipsIntoOuterContext = true;
   }
 
-  size_t hash = getHash(config.get());
-  ATNConfig *existing = _configLookup[hash];
+  ATNConfig *existing = findOrInsert(config.get(), getHash(config.get()), static_cast<uint32_t>(configs.size()));
   if (existing == nullptr) {
-    _configLookup[hash] = config.get();
     _cachedHashCode = 0;
     configs.push_back(config); // track order here
 
@@ -123,7 +121,7 @@ void ATNConfigSet::optimizeConfigs(ATNSimulator *interpreter) {
   if (_readonly) {
     throw IllegalStateException("This set is readonly");
   }
-  if (_configLookup.empty())
+  if (_lookupSize == 0)
     return;
 
   for (auto &config : configs) {
@@ -172,7 +170,7 @@ void ATNConfigSet::clear() {
   }
   configs.clear();
   _cachedHashCode = 0;
-  _configLookup.clear();
+  clearLookup(false);
 }
 
 bool ATNConfigSet::isReadonly() {
@@ -181,7 +179,7 @@ bool ATNConfigSet::isReadonly() {
 
 void ATNConfigSet::setReadonly(bool readonly) {
   _readonly = readonly;
-  _configLookup.clear();
+  clearLookup(true);
 }
 
 std::string ATNConfigSet::toString() {
@@ -218,6 +216,100 @@ size_t ATNConfigSet::getHash(ATNConfig *c) {
   return hashCode;
 }
 
+bool ATNConfigSet::equalKeys(ATNConfig *a, ATNConfig *b) {
+  return a->state->stateNumber == b->state->stateNumber && a->alt == b->alt &&
+    (a->semanticContext == b->semanticContext || *a->semanticContext == *b->semanticContext);
+}
+
+namespace {
+
+  const uint32_t EMPTY_SLOT = std::numeric_limits<uint32_t>::max();
+
+  // getHash() is a plain polynomial, so mix its bits before they pick a slot. Every step can be undone, so the
+  // spread hashes of two configs are equal exactly if their hashes are.
+  size_t spread(size_t hash) {
+    hash ^= hash >> 15;
+    hash *= 0x2c1b3c6dU;
+    hash ^= hash >> 12;
+    return hash;
+  }
+
+}
+
+ATNConfig* ATNConfigSet::findOrInsert(ATNConfig *config, size_t hash, uint32_t index) {
+  if (4 * (_lookupSize + 1) > 3 * _lookupIndexes.size()) {
+    growLookup();
+  }
+
+  hash = spread(hash);
+  size_t mask = _lookupIndexes.size() - 1;
+  size_t slot = hash & mask;
+  size_t distance = 0;
+
+  // Entries are ordered by how far they are from their home slot, so the search ends at the first entry that is
+  // closer to its home than config would be.
+  while (_lookupIndexes[slot] != EMPTY_SLOT) {
+    size_t residentDistance = (slot - _lookupHashes[slot]) & mask;
+    if (residentDistance < distance) {
+      break;
+    }
+    if (_lookupHashes[slot] == hash) {
+      ATNConfig *resident = configs[_lookupIndexes[slot]].get();
+      if (equalKeys(resident, config)) {
+        return resident;
+      }
+    }
+    slot = (slot + 1) & mask;
+    distance++;
+  }
+
+  _lookupSize++;
+  place(hash, index, slot, distance);
+  return nullptr;
+}
+
+void ATNConfigSet::place(size_t hash, uint32_t index, size_t slot, size_t distance) {
+  // Take the first slot whose entry is closer to its home, and move that entry along the same way.
+  size_t mask = _lookupIndexes.size() - 1;
+  while (_lookupIndexes[slot] != EMPTY_SLOT) {
+    size_t residentDistance = (slot - _lookupHashes[slot]) & mask;
+    if (residentDistance < distance) {
+      std::swap(hash, _lookupHashes[slot]);
+      std::swap(index, _lookupIndexes[slot]);
+      distance = residentDistance;
+    }
+    slot = (slot + 1) & mask;
+    distance++;
+  }
+  _lookupHashes[slot] = hash;
+  _lookupIndexes[slot] = index;
+}
+
+void ATNConfigSet::growLookup() {
+  std::vector<size_t> hashes(std::max<size_t>(16, 2 * _lookupIndexes.size()));
+  std::vector<uint32_t> indexes(hashes.size(), EMPTY_SLOT);
+  hashes.swap(_lookupHashes);
+  indexes.swap(_lookupIndexes);
+
+  size_t mask = _lookupIndexes.size() - 1;
+  for (size_t i = 0; i < indexes.size(); i++) {
+    if (indexes[i] != EMPTY_SLOT) {
+      place(hashes[i], indexes[i], hashes[i] & mask, 0);
+    }
+  }
+}
+
+void ATNConfigSet::clearLookup(bool release) {
+  if (release) {
+    // Read-only sets live on in DFA states, so they give the memory back.
+    std::vector<size_t>().swap(_lookupHashes);
+    std::vector<uint32_t>().swap(_lookupIndexes);
+  } else {
+    std::fill(_lookupIndexes.begin(), _lookupIndexes.end(), EMPTY_SLOT);
+  }
+  _lookupSize = 0;
+}
+
 void ATNConfigSet::InitializeInstanceFields() {
   uniqueAlt = 0;
   hasSemanticContext = false;
@@ -225,4 +317,5 @@ void ATNConfigSet::InitializeInstanceFields() {
 
   _readonly = false;
   _cachedHashCode = 0;
+  _lookupSize = 0;
 }
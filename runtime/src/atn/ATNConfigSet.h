@@ -95,13 +95,26 @@ namespace atn {
     bool _readonly;
 
     virtual size_t getHash(ATNConfig *c); // Hash differs depending on set type.
+    virtual bool equalKeys(ATNConfig *a, ATNConfig *b); // Equality to go with getHash().
 
   private:
     size_t _cachedHashCode;
 
     /// All configs but hashed by (s, i, _, pi) not including context. Wiped out
     /// when we go readonly as this set becomes a DFA state.
-    std::unordered_map<size_t, ATNConfig *> _configLookup;
+    ///
+    /// An open addressing table with robin hood probing, kept in two arrays:
+    /// the hash code of every config, computed once when it is added, and its
+    /// position in configs. Growing the table reuses the hash codes.
+    std::vector<size_t> _lookupHashes;
+    std::vector<uint32_t> _lookupIndexes;
+    size_t _lookupSize;
+
+    /// Returns the config with the key of config, or adds index (of config) and returns null.
+    ATNConfig* findOrInsert(ATNConfig *config, size_t hash, uint32_t index);
+    void place(size_t hash, uint32_t index, size_t slot, size_t distance);
+    void growLookup();
+    void clearLookup(bool release);
 
     void InitializeInstanceFields();
   };
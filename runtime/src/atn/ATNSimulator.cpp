@@ -36,7 +36,9 @@ PredictionContextCache& ATNSimulator::getSharedContextCache() {
 
 Ref<PredictionContext> ATNSimulator::getCachedContext(Ref<PredictionContext> const& context) {
   // This function must only be called with an active state lock, as we are going to change a shared structure.
-  std::map<Ref<PredictionContext>, Ref<PredictionContext>> visited;
+  // The cache keeps its nodes for good, so they go to the heap rather than the arena of the current prediction.
+  PredictionArena::Scope heap(nullptr);
+  std::unordered_map<PredictionContext *, Ref<PredictionContext>> visited;
   return PredictionContext::getCachedContext(context, _sharedContextCache, visited);
 }
 
@@ -9,6 +9,7 @@
 #include "misc/IntervalSet.h"
 #include "support/CPPUtils.h"
 #include "atn/PredictionContext.h"
+#include "atn/PredictionArena.h"
 
 namespace antlr4 {
 namespace atn {
@@ -57,7 +58,7 @@ namespace atn {
 
   protected:
     static antlrcpp::SingleWriteMultipleReadLock _stateLock; // Lock for DFA states.
-    static antlrcpp::SingleWriteMultipleReadLock _edgeLock; // Lock for the sparse edge map in DFA states.
+    static antlrcpp::SingleWriteMultipleReadLock _edgeLock; // Lock for the edge tables of DFA states.
 
     /// <summary>
     /// The context cache maps all PredictionContext objects that are equals()
@@ -81,6 +82,10 @@ namespace atn {
     ///  so it's not worth the complexity.
     /// </summary>
     PredictionContextCache &_sharedContextCache;
+
+    /// Holds the configs and contexts made during a prediction. Subclasses make
+    /// it current while they predict; see PredictionArena.
+    PredictionArena _arena;
   };
 
 } // namespace atn
@@ -47,7 +47,6 @@ void LexerATNSimulator::SimState::InitializeInstanceFields() {
   charPos = INVALID_INDEX;
 }
 
-int LexerATNSimulator::match_calls = 0;
 
 
 LexerATNSimulator::LexerATNSimulator(const ATN &atn, std::vector<dfa::DFA> &decisionToDFA,
@@ -69,7 +68,8 @@ void LexerATNSimulator::copyState(LexerATNSimulator *simulator) {
 }
 
 size_t LexerATNSimulator::match(CharStream *input, size_t mode) {
-  match_calls++;
+  // Configs and contexts of this match go to the arena; what the DFA keeps is copied in addDFAState().
+  PredictionArena::Scope arena(&_arena);
   _mode = mode;
   ssize_t mark = input->mark();
 
@@ -80,10 +80,11 @@ size_t LexerATNSimulator::match(CharStream *input, size_t mode) {
   _startIndex = input->index();
   _prevAccept.reset();
   const dfa::DFA &dfa = _decisionToDFA[mode];
-  if (dfa.s0 == nullptr) {
+  dfa::DFAState *s0 = dfa.s0.load(std::memory_order_acquire);
+  if (s0 == nullptr) {
     return matchATN(input);
   } else {
-    return execATN(input, dfa.s0);
+    return execATN(input, s0);
   }
 }
 
@@ -113,7 +114,7 @@ size_t LexerATNSimulator::matchATN(CharStream *input) {
 
   dfa::DFAState *next = addDFAState(s0_closure.release());
   if (!suppressEdge) {
-    _decisionToDFA[_mode].s0 = next;
+    _decisionToDFA[_mode].s0.store(next, std::memory_order_release);
   }
 
   size_t predict = execATN(input, next);
@@ -182,19 +183,14 @@ size_t LexerATNSimulator::execATN(CharStream *input, dfa::DFAState *ds0) {
 
 dfa::DFAState *LexerATNSimulator::getExistingTargetState(dfa::DFAState *s, size_t t) {
   dfa::DFAState* retval = nullptr;
-  _edgeLock.readLock();
-  if (t <= MAX_DFA_EDGE) {
-    auto iterator = s->edges.find(t - MIN_DFA_EDGE);
+  if (t != Token::EOF) {
+    retval = s->edges.get(t - MIN_DFA_EDGE); // Takes no lock, see DFAEdges.
 #if DEBUG_ATN == 1
-    if (iterator != s->edges.end()) {
-      std::cout << std::string("reuse state ") << s->stateNumber << std::string(" edge to ") << iterator->second->stateNumber << std::endl;
+    if (retval != nullptr) {
+      std::cout << std::string("reuse state ") << s->stateNumber << std::string(" edge to ") << retval->stateNumber << std::endl;
     }
 #endif
-
-    if (iterator != s->edges.end())
-	retval = iterator->second;
   }
-  _edgeLock.readUnlock();
   return retval;
 }
 
@@ -262,7 +258,7 @@ void LexerATNSimulator::getReachableConfigSet(CharStream *input, ATNConfigSet *c
         }
 
         bool treatEofAsEpsilon = t == Token::EOF;
-        Ref<LexerATNConfig> config = std::make_shared<LexerATNConfig>(std::static_pointer_cast<LexerATNConfig>(c),
+        Ref<LexerATNConfig> config = PredictionArena::make<LexerATNConfig>(std::static_pointer_cast<LexerATNConfig>(c),
           target, lexerActionExecutor);
 
         if (closure(input, config, reach, currentAltReachedAcceptState, true, treatEofAsEpsilon)) {
@@ -306,7 +302,7 @@ std::unique_ptr<ATNConfigSet> LexerATNSimulator::computeStartState(CharStream *i
   std::unique_ptr<ATNConfigSet> configs(new OrderedATNConfigSet());
   for (size_t i = 0; i < p->transitions.size(); i++) {
     ATNState *target = p->transitions[i]->target;
-    Ref<LexerATNConfig> c = std::make_shared<LexerATNConfig>(target, (int)(i + 1), initialContext);
+    Ref<LexerATNConfig> c = PredictionArena::make<LexerATNConfig>(target, (int)(i + 1), initialContext);
     closure(input, c, configs.get(), false, false, false);
   }
 
@@ -333,7 +329,7 @@ bool LexerATNSimulator::closure(CharStream *input, const Ref<LexerATNConfig> &co
         configs->add(config);
         return true;
       } else {
-        configs->add(std::make_shared<LexerATNConfig>(config, config->state, PredictionContext::EMPTY));
+        configs->add(PredictionArena::make<LexerATNConfig>(config, config->state, PredictionContext::EMPTY));
         currentAltReachedAcceptState = true;
       }
     }
@@ -343,7 +339,7 @@ bool LexerATNSimulator::closure(CharStream *input, const Ref<LexerATNConfig> &co
         if (config->context->getReturnState(i) != PredictionContext::EMPTY_RETURN_STATE) {
           std::weak_ptr<PredictionContext> newContext = config->context->getParent(i); // "pop" return state
           ATNState *returnState = atn.states[config->context->getReturnState(i)];
-          Ref<LexerATNConfig> c = std::make_shared<LexerATNConfig>(config, returnState, newContext.lock());
+          Ref<LexerATNConfig> c = PredictionArena::make<LexerATNConfig>(config, returnState, newContext.lock());
           currentAltReachedAcceptState = closure(input, c, configs, currentAltReachedAcceptState, speculative, treatEofAsEpsilon);
         }
       }
@@ -379,7 +375,7 @@ Ref<LexerATNConfig> LexerATNSimulator::getEpsilonTarget(CharStream *input, const
     case Transition::RULE: {
       RuleTransition *ruleTransition = static_cast<RuleTransition*>(t);
       Ref<PredictionContext> newContext = SingletonPredictionContext::create(config->context, ruleTransition->followState->stateNumber);
-      c = std::make_shared<LexerATNConfig>(config, t->target, newContext);
+      c = PredictionArena::make<LexerATNConfig>(config, t->target, newContext);
       break;
     }
 
@@ -413,7 +409,7 @@ Ref<LexerATNConfig> LexerATNSimulator::getEpsilonTarget(CharStream *input, const
 
       configs->hasSemanticContext = true;
       if (evaluatePredicate(input, pt->ruleIndex, pt->predIndex, speculative)) {
-        c = std::make_shared<LexerATNConfig>(config, t->target);
+        c = PredictionArena::make<LexerATNConfig>(config, t->target);
       }
       break;
     }
@@ -434,17 +430,17 @@ Ref<LexerATNConfig> LexerATNSimulator::getEpsilonTarget(CharStream *input, const
         // the split operation.
         Ref<LexerActionExecutor> lexerActionExecutor = LexerActionExecutor::append(config->getLexerActionExecutor(),
           atn.lexerActions[static_cast<ActionTransition *>(t)->actionIndex]);
-        c = std::make_shared<LexerATNConfig>(config, t->target, lexerActionExecutor);
+        c = PredictionArena::make<LexerATNConfig>(config, t->target, lexerActionExecutor);
         break;
       }
       else {
         // ignore actions in referenced rules
-        c = std::make_shared<LexerATNConfig>(config, t->target);
+        c = PredictionArena::make<LexerATNConfig>(config, t->target);
         break;
       }
 
     case Transition::EPSILON:
-      c = std::make_shared<LexerATNConfig>(config, t->target);
+      c = PredictionArena::make<LexerATNConfig>(config, t->target);
       break;
 
     case Transition::ATOM:
@@ -452,7 +448,7 @@ Ref<LexerATNConfig> LexerATNSimulator::getEpsilonTarget(CharStream *input, const
     case Transition::SET:
       if (treatEofAsEpsilon) {
         if (t->matches(Token::EOF, Lexer::MIN_CHAR_VALUE, Lexer::MAX_CHAR_VALUE)) {
-          c = std::make_shared<LexerATNConfig>(config, t->target);
+          c = PredictionArena::make<LexerATNConfig>(config, t->target);
           break;
         }
       }
@@ -525,13 +521,14 @@ dfa::DFAState *LexerATNSimulator::addDFAEdge(dfa::DFAState *from, size_t t, ATNC
 }
 
 void LexerATNSimulator::addDFAEdge(dfa::DFAState *p, size_t t, dfa::DFAState *q) {
-  if (/*t < MIN_DFA_EDGE ||*/ t > MAX_DFA_EDGE) { // MIN_DFA_EDGE is 0
-    // Only track edges within the DFA bounds
+  if (t == Token::EOF) {
+    // Only track edges for characters
     return;
   }
 
+  // Characters up to MAX_DFA_EDGE go to the array of the edge table, others to its overflow list.
   _edgeLock.writeLock();
-  p->edges[t - MIN_DFA_EDGE] = q; // connect
+  p->edges.set(t - MIN_DFA_EDGE, q, MAX_DFA_EDGE - MIN_DFA_EDGE + 1); // connect
   _edgeLock.writeUnlock();
 }
 
@@ -569,7 +566,13 @@ dfa::DFAState *LexerATNSimulator::addDFAState(ATNConfigSet *configs) {
   }
 
   proposed->stateNumber = (int)dfa.states.size();
+
+  // The state outlives the match, so its configs and their contexts move from the arena to the heap.
+  proposed->configs->optimizeConfigs(this);
   proposed->configs->setReadonly(true);
+  for (auto &config : proposed->configs->configs) {
+    config = std::make_shared<LexerATNConfig>(static_cast<LexerATNConfig &>(*config));
+  }
 
   dfa.states.insert(proposed);
   _stateLock.writeUnlock();
@@ -39,7 +39,7 @@ namespace atn {
 
   public:
     static const size_t MIN_DFA_EDGE = 0;
-    static const size_t MAX_DFA_EDGE = 127; // forces unicode to stay in ATN
+    static const size_t MAX_DFA_EDGE = 127; // others go to the overflow list of the edge table
 
   protected:
     /// <summary>
@@ -82,8 +82,6 @@ namespace atn {
     SimState _prevAccept;
 
   public:
-    static int match_calls;
-
     LexerATNSimulator(const ATN &atn, std::vector<dfa::DFA> &decisionToDFA, PredictionContextCache &sharedContextCache);
     LexerATNSimulator(Lexer *recog, const ATN &atn, std::vector<dfa::DFA> &decisionToDFA, PredictionContextCache &sharedContextCache);
     virtual ~LexerATNSimulator () {}
@@ -10,3 +10,7 @@ using namespace antlr4::atn;
 size_t OrderedATNConfigSet::getHash(ATNConfig *c) {
   return c->hashCode();
 }
+
+bool OrderedATNConfigSet::equalKeys(ATNConfig *a, ATNConfig *b) {
+  return *a == *b;
+}
@@ -14,6 +14,7 @@ namespace atn {
   class ANTLR4CPP_PUBLIC OrderedATNConfigSet : public ATNConfigSet {
   protected:
     virtual size_t getHash(ATNConfig *c) override;
+    virtual bool equalKeys(ATNConfig *a, ATNConfig *b) override;
   };
 
 } // namespace atn
@@ -75,6 +75,8 @@ size_t ParserATNSimulator::adaptivePredict(TokenStream *input, size_t decision,
       << input->LT(1)->getLine() << ":" << input->LT(1)->getCharPositionInLine() << std::endl;
 #endif
 
+  // Configs and contexts of this prediction go to the arena; what the DFA keeps is copied in addDFAState().
+  PredictionArena::Scope arena(&_arena);
   _input = input;
   _startIndex = input->index();
   _outerContext = outerContext;
@@ -100,7 +102,7 @@ size_t ParserATNSimulator::adaptivePredict(TokenStream *input, size_t decision,
     s0 = dfa.getPrecedenceStartState(parser->getPrecedence());
   } else {
     // the start state for a "regular" DFA is just s0
-    s0 = dfa.s0;
+    s0 = dfa.s0.load(std::memory_order_acquire);
   }
 
   if (s0 == nullptr) {
@@ -116,8 +118,8 @@ size_t ParserATNSimulator::adaptivePredict(TokenStream *input, size_t decision,
        * appropriate start state for the precedence level rather
        * than simply setting DFA.s0.
        */
-      dfa.s0->configs = std::move(s0_closure); // not used for prediction but useful to know start configs anyway
-      dfa::DFAState *newState = new dfa::DFAState(applyPrecedenceFilter(dfa.s0->configs.get())); /* mem-check: managed by the DFA or deleted below */
+      dfa.s0.load()->configs = std::move(s0_closure); // not used for prediction but useful to know start configs anyway
+      dfa::DFAState *newState = new dfa::DFAState(applyPrecedenceFilter(dfa.s0.load()->configs.get())); /* mem-check: managed by the DFA or deleted below */
       s0 = addDFAState(dfa, newState);
       dfa.setPrecedenceStartState(parser->getPrecedence(), s0, _edgeLock);
       if (s0 != newState) {
@@ -127,8 +129,9 @@ size_t ParserATNSimulator::adaptivePredict(TokenStream *input, size_t decision,
       dfa::DFAState *newState = new dfa::DFAState(std::move(s0_closure)); /* mem-check: managed by the DFA or deleted below */
       s0 = addDFAState(dfa, newState);
 
-      delete dfa.s0; // Delete existing s0 DFA state, if there's any. 
-      dfa.s0 = s0;
+      // Another thread may have set s0 meanwhile. That state is in the DFA and equal to this one, so
+      // addDFAState returned it and it stays.
+      dfa.s0.store(s0, std::memory_order_release);
       if (s0 != newState) {
         delete newState; // If there was already a state with this config set we don't need the new one.
       }
@@ -257,12 +260,7 @@ size_t ParserATNSimulator::execATN(dfa::DFA &dfa, dfa::DFAState *s0, TokenStream
 }
 
 dfa::DFAState *ParserATNSimulator::getExistingTargetState(dfa::DFAState *previousD, size_t t) {
-  dfa::DFAState* retval;
-  _edgeLock.readLock();
-  auto iterator = previousD->edges.find(t);
-  retval = (iterator == previousD->edges.end()) ? nullptr : iterator->second;
-  _edgeLock.readUnlock();
-  return retval;
+  return previousD->edges.get(t); // Takes no lock, see DFAEdges.
 }
 
 dfa::DFAState *ParserATNSimulator::computeTargetState(dfa::DFA &dfa, dfa::DFAState *previousD, size_t t) {
@@ -466,7 +464,7 @@ std::unique_ptr<ATNConfigSet> ParserATNSimulator::computeReachSet(ATNConfigSet *
       Transition *trans = c->state->transitions[ti];
       ATNState *target = getReachableTarget(trans, (int)t);
       if (target != nullptr) {
-        intermediate->add(std::make_shared<ATNConfig>(c, target), &mergeCache);
+        intermediate->add(PredictionArena::make<ATNConfig>(c, target), &mergeCache);
       }
     }
   }
@@ -573,7 +571,7 @@ ATNConfigSet* ParserATNSimulator::removeAllConfigsNotInRuleStopState(ATNConfigSe
       misc::IntervalSet nextTokens = atn.nextTokens(config->state);
       if (nextTokens.contains(Token::EPSILON)) {
         ATNState *endOfRuleState = atn.ruleToStopState[config->state->ruleIndex];
-        result->add(std::make_shared<ATNConfig>(config, endOfRuleState), &mergeCache);
+        result->add(PredictionArena::make<ATNConfig>(config, endOfRuleState), &mergeCache);
       }
     }
   }
@@ -588,7 +586,7 @@ std::unique_ptr<ATNConfigSet> ParserATNSimulator::computeStartState(ATNState *p,
 
   for (size_t i = 0; i < p->transitions.size(); i++) {
     ATNState *target = p->transitions[i]->target;
-    Ref<ATNConfig> c = std::make_shared<ATNConfig>(target, (int)i + 1, initialContext);
+    Ref<ATNConfig> c = PredictionArena::make<ATNConfig>(target, (int)i + 1, initialContext);
     ATNConfig::Set closureBusy;
     closure(c, configs.get(), closureBusy, true, fullCtx, false);
   }
@@ -613,7 +611,7 @@ std::unique_ptr<ATNConfigSet> ParserATNSimulator::applyPrecedenceFilter(ATNConfi
 
     statesFromAlt1[config->state->stateNumber] = config->context;
     if (updatedContext != config->semanticContext) {
-      configSet->add(std::make_shared<ATNConfig>(config, updatedContext), &mergeCache);
+      configSet->add(PredictionArena::make<ATNConfig>(config, updatedContext), &mergeCache);
     }
     else {
       configSet->add(config, &mergeCache);
@@ -834,7 +832,7 @@ void ParserATNSimulator::closureCheckingStopState(Ref<ATNConfig> const& config,
       for (size_t i = 0; i < config->context->size(); i++) {
         if (config->context->getReturnState(i) == PredictionContext::EMPTY_RETURN_STATE) {
           if (fullCtx) {
-            configs->add(std::make_shared<ATNConfig>(config, config->state, PredictionContext::EMPTY), &mergeCache);
+            configs->add(PredictionArena::make<ATNConfig>(config, config->state, PredictionContext::EMPTY), &mergeCache);
             continue;
           } else {
             // we have no context info, just chase follow links (if greedy)
@@ -847,7 +845,7 @@ void ParserATNSimulator::closureCheckingStopState(Ref<ATNConfig> const& config,
         }
         ATNState *returnState = atn.states[config->context->getReturnState(i)];
         std::weak_ptr<PredictionContext> newContext = config->context->getParent(i); // "pop" return state
-        Ref<ATNConfig> c = std::make_shared<ATNConfig>(returnState, config->alt, newContext.lock(), config->semanticContext);
+        Ref<ATNConfig> c = PredictionArena::make<ATNConfig>(returnState, config->alt, newContext.lock(), config->semanticContext);
         // While we have context to pop back from, we may have
         // gotten that context AFTER having falling off a rule.
         // Make sure we track that we are now out of context.
@@ -1045,7 +1043,7 @@ Ref<ATNConfig> ParserATNSimulator::getEpsilonTarget(Ref<ATNConfig> const& config
       return actionTransition(config, static_cast<ActionTransition*>(t));
 
     case Transition::EPSILON:
-      return std::make_shared<ATNConfig>(config, t->target);
+      return PredictionArena::make<ATNConfig>(config, t->target);
 
     case Transition::ATOM:
     case Transition::RANGE:
@@ -1054,7 +1052,7 @@ Ref<ATNConfig> ParserATNSimulator::getEpsilonTarget(Ref<ATNConfig> const& config
       // transition is traversed
       if (treatEofAsEpsilon) {
         if (t->matches(Token::EOF, 0, 1)) {
-          return std::make_shared<ATNConfig>(config, t->target);
+          return PredictionArena::make<ATNConfig>(config, t->target);
         }
       }
 
@@ -1070,7 +1068,7 @@ Ref<ATNConfig> ParserATNSimulator::actionTransition(Ref<ATNConfig> const& config
     std::cout << "ACTION edge " << t->ruleIndex << ":" << t->actionIndex << std::endl;
 #endif
 
-  return std::make_shared<ATNConfig>(config, t->target);
+  return PredictionArena::make<ATNConfig>(config, t->target);
 }
 
 Ref<ATNConfig> ParserATNSimulator::precedenceTransition(Ref<ATNConfig> const& config, PrecedencePredicateTransition *pt,
@@ -1096,14 +1094,14 @@ Ref<ATNConfig> ParserATNSimulator::precedenceTransition(Ref<ATNConfig> const& co
       bool predSucceeds = evalSemanticContext(pt->getPredicate(), _outerContext, config->alt, fullCtx);
       _input->seek(currentPosition);
       if (predSucceeds) {
-        c = std::make_shared<ATNConfig>(config, pt->target); // no pred context
+        c = PredictionArena::make<ATNConfig>(config, pt->target); // no pred context
       }
     } else {
       Ref<SemanticContext> newSemCtx = SemanticContext::And(config->semanticContext, predicate);
-      c = std::make_shared<ATNConfig>(config, pt->target, newSemCtx);
+      c = PredictionArena::make<ATNConfig>(config, pt->target, newSemCtx);
     }
   } else {
-    c = std::make_shared<ATNConfig>(config, pt->target);
+    c = PredictionArena::make<ATNConfig>(config, pt->target);
   }
 
 #if DEBUG_DFA == 1
@@ -1135,14 +1133,14 @@ Ref<ATNConfig> ParserATNSimulator::predTransition(Ref<ATNConfig> const& config,
       bool predSucceeds = evalSemanticContext(pt->getPredicate(), _outerContext, config->alt, fullCtx);
       _input->seek(currentPosition);
       if (predSucceeds) {
-        c = std::make_shared<ATNConfig>(config, pt->target); // no pred context
+        c = PredictionArena::make<ATNConfig>(config, pt->target); // no pred context
       }
     } else {
       Ref<SemanticContext> newSemCtx = SemanticContext::And(config->semanticContext, predicate);
-      c = std::make_shared<ATNConfig>(config, pt->target, newSemCtx);
+      c = PredictionArena::make<ATNConfig>(config, pt->target, newSemCtx);
     }
   } else {
-    c = std::make_shared<ATNConfig>(config, pt->target);
+    c = PredictionArena::make<ATNConfig>(config, pt->target);
   }
 
 #if DEBUG_DFA == 1
@@ -1159,7 +1157,7 @@ Ref<ATNConfig> ParserATNSimulator::ruleTransition(Ref<ATNConfig> const& config,
 
   atn::ATNState *returnState = t->followState;
   Ref<PredictionContext> newContext = SingletonPredictionContext::create(config->context, returnState->stateNumber);
-  return std::make_shared<ATNConfig>(config, t->target, newContext);
+  return PredictionArena::make<ATNConfig>(config, t->target, newContext);
 }
 
 BitSet ParserATNSimulator::getConflictingAlts(ATNConfigSet *configs) {
@@ -1251,7 +1249,7 @@ dfa::DFAState *ParserATNSimulator::addDFAEdge(dfa::DFA &dfa, dfa::DFAState *from
 
   {
     _edgeLock.writeLock();
-    from->edges[t] = to; // connect
+    from->edges.set(t, to, atn.maxTokenType + 1); // connect
     _edgeLock.writeUnlock();
   }
 
@@ -1282,6 +1280,11 @@ dfa::DFAState *ParserATNSimulator::addDFAState(dfa::DFA &dfa, dfa::DFAState *D)
   if (!D->configs->isReadonly()) {
     D->configs->optimizeConfigs(this);
     D->configs->setReadonly(true);
+
+    // The state outlives the prediction, so its configs move from the arena to the heap.
+    for (auto &config : D->configs->configs) {
+      config = std::make_shared<ATNConfig>(*config);
+    }
   }
 
   dfa.states.insert(D);
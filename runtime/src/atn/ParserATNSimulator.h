@@ -191,7 +191,10 @@ namespace atn {
    * {@link #addDFAEdge} method could be racing to set the field
    * but in either case the DFA simulator works; if {@code null}, and requests ATN
    * simulation. It could also race trying to get {@code dfa.edges[t]}, but either
-   * way it will work because it's not doing a test and set operation.</p>
+   * way it will work because it's not doing a test and set operation. Here the
+   * edges are a {@link DFAEdges} table of atomic pointers, published with release
+   * stores, and {@link DFA#s0} is atomic as well, so these races are well defined
+   * and the DFA simulation takes no lock.</p>
    *
    * <p>
    * <strong>Starting with SLL then failing to combined SLL/LL (Two-Stage
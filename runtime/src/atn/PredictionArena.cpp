@@ -0,0 +1,122 @@
+﻿/* Copyright (c) 2012-2017 The ANTLR Project. All rights reserved.
+ * Use of this file is governed by the BSD 3-clause license that
+ * can be found in the LICENSE.txt file in the project root.
+ */
+
+#include "atn/PredictionArena.h"
+
+using namespace antlr4::atn;
+
+namespace {
+
+  const size_t BLOCK_SIZE = 32 * 1024;
+
+  // Larger objects go to the heap, so they don't waste most of a block.
+  const size_t MAX_OBJECT_SIZE = 1024;
+
+  // Added to the live count of the block being filled, so it doesn't drop to 0 (and the block isn't freed)
+  // while objects are still allocated from it.
+  const size_t BIAS = size_t(1) << (sizeof(size_t) * 8 - 2);
+
+  thread_local PredictionArena *currentArena = nullptr;
+
+}
+
+/// Header of a block. Every allocation is prefixed with a pointer to its block, or null if it came from the heap.
+struct PredictionArena::Block {
+  std::atomic<size_t> live;
+  size_t padding;
+
+  char* begin() {
+    return reinterpret_cast<char *>(this + 1);
+  }
+};
+
+PredictionArena::Scope::Scope(PredictionArena *arena) : _arena(arena), _previous(currentArena) {
+  currentArena = arena;
+}
+
+PredictionArena::Scope::~Scope() {
+  currentArena = _previous;
+  if (_arena != nullptr && _arena != _previous) {
+    _arena->rewind();
+  }
+}
+
+PredictionArena::PredictionArena() : _block(nullptr), _next(nullptr), _end(nullptr), _count(0), _allocatedSize(0) {
+}
+
+PredictionArena::~PredictionArena() {
+  retire();
+}
+
+PredictionArena* PredictionArena::current() {
+  return currentArena;
+}
+
+void PredictionArena::rewind() {
+  if (_block != nullptr && _count > 0 && _block->live.load(std::memory_order_acquire) == BIAS - _count) {
+    // Nothing in the block is alive, so no other thread can touch its count.
+    _block->live.store(BIAS, std::memory_order_relaxed);
+    _next = _block->begin();
+    _count = 0;
+  }
+}
+
+void* PredictionArena::allocate(size_t size) {
+  size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+  PredictionArena *arena = currentArena;
+  if (arena == nullptr || size > MAX_OBJECT_SIZE) {
+    Block **prefix = static_cast<Block **>(::operator new(sizeof(Block *) + size));
+    *prefix = nullptr;
+    return prefix + 1;
+  }
+  return arena->allocateInBlock(size);
+}
+
+void PredictionArena::deallocate(void *p) {
+  Block **prefix = static_cast<Block **>(p) - 1;
+  Block *block = *prefix;
+  if (block == nullptr) {
+    ::operator delete(prefix);
+  } else if (block->live.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    block->~Block();
+    ::operator delete(block);
+  }
+}
+
+void* PredictionArena::allocateInBlock(size_t size) {
+  size_t needed = sizeof(Block *) + size;
+  if (_block != nullptr && static_cast<size_t>(_end - _next) < needed) {
+    rewind();
+  }
+  if (_block == nullptr || static_cast<size_t>(_end - _next) < needed) {
+    retire();
+    _block = new (::operator new(BLOCK_SIZE)) Block();
+    _block->live.store(BIAS, std::memory_order_relaxed);
+    _next = _block->begin();
+    _end = reinterpret_cast<char *>(_block) + BLOCK_SIZE;
+    _count = 0;
+    _allocatedSize += BLOCK_SIZE;
+  }
+
+  Block **prefix = reinterpret_cast<Block **>(_next);
+  *prefix = _block;
+  _next += needed;
+  _count++;
+  return prefix + 1;
+}
+
+void PredictionArena::retire() {
+  if (_block == nullptr) {
+    return;
+  }
+
+  // From now on the count only goes down, to 0 when the last object in the block is released.
+  size_t bias = BIAS - _count;
+  if (_block->live.fetch_sub(bias, std::memory_order_acq_rel) == bias) {
+    _block->~Block();
+    ::operator delete(_block);
+  }
+  _block = nullptr;
+}
@@ -0,0 +1,116 @@
+﻿/* Copyright (c) 2012-2017 The ANTLR Project. All rights reserved.
+ * Use of this file is governed by the BSD 3-clause license that
+ * can be found in the LICENSE.txt file in the project root.
+ */
+
+#pragma once
+
+#include "antlr4-common.h"
+
+namespace antlr4 {
+namespace atn {
+
+  /// Bump allocator for the ATNConfig and PredictionContext objects made
+  /// during a single prediction.
+  ///
+  /// Closure makes many small configs and contexts, and almost all of them
+  /// are dropped when adaptivePredict() or match() returns. A simulator owns
+  /// an arena and makes it current for its thread while it predicts (see
+  /// Scope), and make() then carves the objects (with their shared_ptr
+  /// control blocks) out of large blocks instead of calling the allocator for
+  /// each one. When the prediction is over and nothing in the current block
+  /// is alive any more, the block is reused from its start.
+  ///
+  /// Objects may outlive the prediction; they stay Ref<>s like any other.
+  /// Every block counts its live objects and is freed when the last one goes,
+  /// so a survivor only keeps its block around. The simulators copy whatever
+  /// they store in the DFA or the context cache to the heap, so blocks don't
+  /// get pinned for good. A block is filled by one thread, but its objects
+  /// may be released on any.
+  class ANTLR4CPP_PUBLIC PredictionArena {
+  public:
+    /// Standard allocator on the current arena of the thread, or on the heap
+    /// if there is none. Memory can be returned on any thread.
+    template<typename T>
+    class Allocator {
+    public:
+      typedef T value_type;
+
+      Allocator() {}
+      template<typename U>
+      Allocator(const Allocator<U> &) {}
+
+      T* allocate(size_t n) {
+        static_assert(alignof(T) <= alignof(void *), "PredictionArena aligns to pointers only");
+        return static_cast<T *>(PredictionArena::allocate(n * sizeof(T)));
+      }
+
+      void deallocate(T *p, size_t) {
+        PredictionArena::deallocate(p);
+      }
+
+      template<typename U>
+      bool operator == (const Allocator<U> &) const { return true; }
+      template<typename U>
+      bool operator != (const Allocator<U> &) const { return false; }
+    };
+
+    /// Makes arena the current one of this thread for the lifetime of the
+    /// scope; null suspends the current arena. If arena was not current
+    /// before, it is rewound at the end.
+    class ANTLR4CPP_PUBLIC Scope {
+    public:
+      Scope(PredictionArena *arena);
+      Scope(const Scope &other) = delete;
+      ~Scope();
+
+      Scope& operator = (const Scope &other) = delete;
+
+    private:
+      PredictionArena *_arena;
+      PredictionArena *_previous;
+    };
+
+    PredictionArena();
+    PredictionArena(const PredictionArena &other) = delete;
+    ~PredictionArena();
+
+    PredictionArena& operator = (const PredictionArena &other) = delete;
+
+    /// The current arena of this thread, or null.
+    static PredictionArena* current();
+
+    /// std::make_shared<T>(args...), in the current arena if there is one.
+    template<typename T, typename... Args>
+    static Ref<T> make(Args&&... args) {
+      if (current() == nullptr) {
+        return std::make_shared<T>(std::forward<Args>(args)...);
+      }
+      return std::allocate_shared<T>(Allocator<T>(), std::forward<Args>(args)...);
+    }
+
+    /// Starts over at the beginning of the current block if everything in it
+    /// has been released.
+    void rewind();
+
+    /// Bytes of the blocks allocated so far.
+    size_t allocatedSize() const { return _allocatedSize; }
+
+  private:
+    struct Block;
+
+    static void* allocate(size_t size);
+    static void deallocate(void *p);
+
+    void* allocateInBlock(size_t size);
+    void retire();
+
+    Block *_block;
+    char *_next;
+    char *_end;
+    size_t _count; // Allocations in _block.
+    size_t _allocatedSize;
+  };
+
+} // namespace atn
+} // namespace antlr4
@@ -6,6 +6,7 @@
 #include "atn/EmptyPredictionContext.h"
 #include "misc/MurmurHash.h"
 #include "atn/ArrayPredictionContext.h"
+#include "atn/PredictionArena.h"
 #include "RuleContext.h"
 #include "ParserRuleContext.h"
 #include "atn/RuleTransition.h"
@@ -20,12 +21,12 @@ using namespace antlr4::atn;
 
 using namespace antlrcpp;
 
-size_t PredictionContext::globalNodeCount = 0;
+std::atomic<size_t> PredictionContext::globalNodeCount(0);
 const Ref<PredictionContext> PredictionContext::EMPTY = std::make_shared<EmptyPredictionContext>();
 
 //----------------- PredictionContext ----------------------------------------------------------------------------------
 
-PredictionContext::PredictionContext(size_t cachedHashCode) : id(globalNodeCount++), cachedHashCode(cachedHashCode)  {
+PredictionContext::PredictionContext(size_t cachedHashCode) : id(globalNodeCount.fetch_add(1, std::memory_order_relaxed)), cachedHashCode(cachedHashCode)  {
 }
 
 PredictionContext::~PredictionContext() {
@@ -120,13 +121,13 @@ Ref<PredictionContext> PredictionContext::merge(const Ref<PredictionContext> &a,
   // convert singleton so both are arrays to normalize
   Ref<ArrayPredictionContext> left;
   if (is<SingletonPredictionContext>(a)) {
-    left = std::make_shared<ArrayPredictionContext>(std::dynamic_pointer_cast<SingletonPredictionContext>(a));
+    left = PredictionArena::make<ArrayPredictionContext>(std::dynamic_pointer_cast<SingletonPredictionContext>(a));
   } else {
     left = std::dynamic_pointer_cast<ArrayPredictionContext>(a);
   }
   Ref<ArrayPredictionContext> right;
   if (is<SingletonPredictionContext>(b)) {
-    right = std::make_shared<ArrayPredictionContext>(std::dynamic_pointer_cast<SingletonPredictionContext>(b));
+    right = PredictionArena::make<ArrayPredictionContext>(std::dynamic_pointer_cast<SingletonPredictionContext>(b));
   } else {
     right = std::dynamic_pointer_cast<ArrayPredictionContext>(b);
   }
@@ -191,7 +192,7 @@ Ref<PredictionContext> PredictionContext::mergeSingletons(const Ref<SingletonPre
         payloads[1] = a->returnState;
       }
       std::vector<Ref<PredictionContext>> parents = { singleParent, singleParent };
-      Ref<PredictionContext> a_ = std::make_shared<ArrayPredictionContext>(parents, payloads);
+      Ref<PredictionContext> a_ = PredictionArena::make<ArrayPredictionContext>(parents, payloads);
       if (mergeCache != nullptr) {
         mergeCache->put(a, b, a_);
       }
@@ -205,11 +206,11 @@ Ref<PredictionContext> PredictionContext::mergeSingletons(const Ref<SingletonPre
     if (a->returnState > b->returnState) { // sort by payload
       std::vector<size_t> payloads = { b->returnState, a->returnState };
       std::vector<Ref<PredictionContext>> parents = { b->parent, a->parent };
-      a_ = std::make_shared<ArrayPredictionContext>(parents, payloads);
+      a_ = PredictionArena::make<ArrayPredictionContext>(parents, payloads);
     } else {
       std::vector<size_t> payloads = {a->returnState, b->returnState};
       std::vector<Ref<PredictionContext>> parents = { a->parent, b->parent };
-      a_ = std::make_shared<ArrayPredictionContext>(parents, payloads);
+      a_ = PredictionArena::make<ArrayPredictionContext>(parents, payloads);
     }
 
     if (mergeCache != nullptr) {
@@ -235,13 +236,13 @@ Ref<PredictionContext> PredictionContext::mergeRoot(const Ref<SingletonPredictio
     if (a == EMPTY) { // $ + x = [$,x]
       std::vector<size_t> payloads = { b->returnState, EMPTY_RETURN_STATE };
       std::vector<Ref<PredictionContext>> parents = { b->parent, nullptr };
-      Ref<PredictionContext> joined = std::make_shared<ArrayPredictionContext>(parents, payloads);
+      Ref<PredictionContext> joined = PredictionArena::make<ArrayPredictionContext>(parents, payloads);
       return joined;
     }
     if (b == EMPTY) { // x + $ = [$,x] ($ is always first if present)
       std::vector<size_t> payloads = { a->returnState, EMPTY_RETURN_STATE };
       std::vector<Ref<PredictionContext>> parents = { a->parent, nullptr };
-      Ref<PredictionContext> joined = std::make_shared<ArrayPredictionContext>(parents, payloads);
+      Ref<PredictionContext> joined = PredictionArena::make<ArrayPredictionContext>(parents, payloads);
       return joined;
     }
   }
@@ -332,7 +333,7 @@ Ref<PredictionContext> PredictionContext::mergeArrays(const Ref<ArrayPredictionC
     mergedReturnStates.resize(k);
   }
 
-  Ref<ArrayPredictionContext> M = std::make_shared<ArrayPredictionContext>(mergedParents, mergedReturnStates);
+  Ref<ArrayPredictionContext> M = PredictionArena::make<ArrayPredictionContext>(mergedParents, mergedReturnStates);
 
   // if we created same array as a or b, return that instead
   // TO_DO: track whether this is possible above during merge sort for speed
@@ -352,7 +353,7 @@ Ref<PredictionContext> PredictionContext::mergeArrays(const Ref<ArrayPredictionC
   // ml: this part differs from Java code. We have to recreate the context as the parents array is copied on creation.
   if (combineCommonParents(mergedParents)) {
     mergedReturnStates.resize(mergedParents.size());
-    M = std::make_shared<ArrayPredictionContext>(mergedParents, mergedReturnStates);
+    M = PredictionArena::make<ArrayPredictionContext>(mergedParents, mergedReturnStates);
   }
 
   if (mergeCache != nullptr) {
@@ -443,63 +444,47 @@ std::string PredictionContext::toDOTString(const Ref<PredictionContext> &context
 
 // The "visited" map is just a temporary structure to control the retrieval process (which is recursive).
 Ref<PredictionContext> PredictionContext::getCachedContext(const Ref<PredictionContext> &context,
-  PredictionContextCache &contextCache, std::map<Ref<PredictionContext>, Ref<PredictionContext>> &visited) {
+  PredictionContextCache &contextCache, std::unordered_map<PredictionContext *, Ref<PredictionContext>> &visited) {
   if (context->isEmpty()) {
     return context;
   }
 
   {
-    auto iterator = visited.find(context);
+    auto iterator = visited.find(context.get());
     if (iterator != visited.end())
       return iterator->second; // Not necessarly the same as context.
   }
 
-  auto iterator = contextCache.find(context);
-  if (iterator != contextCache.end()) {
-    visited[context] = *iterator;
-
-    return *iterator;
+  // Found right away if there is a node equal to context. That is cheap enough not to be remembered.
+  Ref<PredictionContext> cached = contextCache.find(*context);
+  if (cached) {
+    return cached;
   }
 
-  bool changed = false;
-
+  // With cached parents, a node equal to context in the cache has the same parent pointers.
   std::vector<Ref<PredictionContext>> parents(context->size());
+  std::vector<size_t> returnStates(parents.size());
   for (size_t i = 0; i < parents.size(); i++) {
-    Ref<PredictionContext> parent = getCachedContext(context->getParent(i), contextCache, visited);
-    if (changed || parent != context->getParent(i)) {
-      if (!changed) {
-        parents.clear();
-        for (size_t j = 0; j < context->size(); j++) {
-          parents.push_back(context->getParent(j));
-        }
-
-        changed = true;
-      }
-
-      parents[i] = parent;
-    }
+    parents[i] = getCachedContext(context->getParent(i), contextCache, visited);
+    returnStates[i] = context->getReturnState(i);
   }
 
-  if (!changed) {
-    contextCache.insert(context);
-    visited[context] = context;
-
-    return context;
-  }
-
-  Ref<PredictionContext> updated;
-  if (parents.empty()) {
-    updated = EMPTY;
-  } else if (parents.size() == 1) {
-    updated = SingletonPredictionContext::create(parents[0], context->getReturnState(0));
-    contextCache.insert(updated);
-  } else {
-    updated = std::make_shared<ArrayPredictionContext>(parents, std::dynamic_pointer_cast<ArrayPredictionContext>(context)->returnStates);
-    contextCache.insert(updated);
+  Ref<PredictionContext> updated = contextCache.find(context->hashCode(), parents, returnStates);
+  if (!updated) {
+    // The cache gets a copy, as context may live in the arena of the prediction that made it.
+    if (parents.empty()) {
+      updated = EMPTY;
+    } else if (parents.size() == 1) {
+      updated = SingletonPredictionContext::create(parents[0], returnStates[0]);
+    } else {
+      updated = PredictionArena::make<ArrayPredictionContext>(parents, returnStates);
+    }
+    if (!updated->isEmpty()) {
+      contextCache.insert(updated);
+    }
   }
 
-  visited[updated] = updated;
-  visited[context] = updated;
+  visited[context.get()] = updated;
 
   return updated;
 }
@@ -609,54 +594,157 @@ std::vector<std::string> PredictionContext::toStrings(Recognizer *recognizer, co
   return result;
 }
 
+//----------------- PredictionContextCache -----------------------------------------------------------------------------
+
+PredictionContextCache::PredictionContextCache() : _size(0) {
+}
+
+template<typename Equal>
+Ref<PredictionContext> PredictionContextCache::find(size_t hashCode, size_t size, Equal equal) const {
+  if (_contexts.empty()) {
+    return nullptr;
+  }
+
+  size_t mask = _contexts.size() - 1;
+  for (size_t i = hashCode & mask; _contexts[i] != nullptr; i = (i + 1) & mask) {
+    if (_hashCodes[i] != hashCode || _contexts[i]->size() != size) {
+      continue;
+    }
+
+    PredictionContext *candidate = _contexts[i].get();
+    bool same = true;
+    for (size_t j = 0; same && j < size; j++) {
+      same = equal(candidate, j);
+    }
+    if (same) {
+      return _contexts[i];
+    }
+  }
+  return nullptr;
+}
+
+Ref<PredictionContext> PredictionContextCache::find(const PredictionContext &context) const {
+  return find(context.hashCode(), context.size(), [&context](PredictionContext *candidate, size_t j) {
+    if (candidate->getReturnState(j) != context.getReturnState(j)) {
+      return false;
+    }
+    Ref<PredictionContext> parent = candidate->getParent(j);
+    Ref<PredictionContext> other = context.getParent(j);
+    return parent == other || (parent && other && parent->hashCode() == other->hashCode() && *parent == *other);
+  });
+}
+
+Ref<PredictionContext> PredictionContextCache::find(size_t hashCode, const std::vector<Ref<PredictionContext>> &parents,
+                                                    const std::vector<size_t> &returnStates) const {
+  return find(hashCode, parents.size(), [&](PredictionContext *candidate, size_t j) {
+    return candidate->getReturnState(j) == returnStates[j] && candidate->getParent(j) == parents[j];
+  });
+}
+
+void PredictionContextCache::insert(Ref<PredictionContext> const& context) {
+  if (2 * (_size + 1) > _contexts.size()) {
+    grow();
+  }
+
+  size_t mask = _contexts.size() - 1;
+  size_t i = context->hashCode() & mask;
+  while (_contexts[i] != nullptr) {
+    i = (i + 1) & mask;
+  }
+  _hashCodes[i] = context->hashCode();
+  _contexts[i] = context;
+  _size++;
+}
+
+size_t PredictionContextCache::size() const {
+  return _size;
+}
+
+bool PredictionContextCache::empty() const {
+  return _size == 0;
+}
+
+void PredictionContextCache::grow() {
+  std::vector<Ref<PredictionContext>> contexts(std::max<size_t>(64, 2 * _contexts.size()));
+  std::vector<size_t> hashCodes(contexts.size());
+  contexts.swap(_contexts);
+  hashCodes.swap(_hashCodes);
+
+  size_t mask = _contexts.size() - 1;
+  for (size_t i = 0; i < contexts.size(); i++) {
+    if (contexts[i] != nullptr) {
+      size_t j = hashCodes[i] & mask;
+      while (_contexts[j] != nullptr) {
+        j = (j + 1) & mask;
+      }
+      _hashCodes[j] = hashCodes[i];
+      _contexts[j] = std::move(contexts[i]);
+    }
+  }
+}
+
 //----------------- PredictionContextMergeCache ------------------------------------------------------------------------
 
+PredictionContextMergeCache::PredictionContextMergeCache() {
+}
+
+size_t PredictionContextMergeCache::slot(Ref<PredictionContext> const& key1, Ref<PredictionContext> const& key2) {
+  size_t hash = MurmurHash::update(MurmurHash::initialize(), key1->hashCode());
+  hash = MurmurHash::finish(MurmurHash::update(hash, key2->hashCode()), 2);
+  return hash & (CAPACITY - 1);
+}
+
+bool PredictionContextMergeCache::matches(Ref<PredictionContext> const& key, Ref<PredictionContext> const& other) {
+  return key == other || (key->hashCode() == other->hashCode() && *key == *other);
+}
+
 Ref<PredictionContext> PredictionContextMergeCache::put(Ref<PredictionContext> const& key1, Ref<PredictionContext> const& key2,
                                                         Ref<PredictionContext> const& value) {
-  Ref<PredictionContext> previous;
+  if (_entries.empty()) {
+    _entries.resize(CAPACITY);
+  }
 
-  auto iterator = _data.find(key1);
-  if (iterator == _data.end())
-    _data[key1][key2] = value;
-  else {
-    auto iterator2 = iterator->second.find(key2);
-    if (iterator2 != iterator->second.end())
-      previous = iterator2->second;
-    iterator->second[key2] = value;
+  Entry &entry = _entries[slot(key1, key2)];
+  Ref<PredictionContext> previous;
+  if (entry.value == nullptr) {
+    _used.push_back(static_cast<size_t>(&entry - _entries.data()));
+  } else if (matches(entry.key1, key1) && matches(entry.key2, key2)) {
+    previous = entry.value;
   }
 
+  entry.key1 = key1;
+  entry.key2 = key2;
+  entry.value = value;
   return previous;
 }
 
-Ref<PredictionContext> PredictionContextMergeCache::get(Ref<PredictionContext> const& key1, Ref<PredictionContext> const& key2) {
-  auto iterator = _data.find(key1);
-  if (iterator == _data.end())
+Ref<PredictionContext> PredictionContextMergeCache::get(Ref<PredictionContext> const& key1, Ref<PredictionContext> const& key2) const {
+  if (_entries.empty()) {
     return nullptr;
+  }
 
-  auto iterator2 = iterator->second.find(key2);
-  if (iterator2 == iterator->second.end())
+  const Entry &entry = _entries[slot(key1, key2)];
+  if (entry.value == nullptr || !matches(entry.key1, key1) || !matches(entry.key2, key2)) {
     return nullptr;
-
-  return iterator2->second;
+  }
+  return entry.value;
 }
 
 void PredictionContextMergeCache::clear() {
-  _data.clear();
+  for (size_t i : _used) {
+    _entries[i] = Entry();
+  }
+  _used.clear();
 }
 
 std::string PredictionContextMergeCache::toString() const {
   std::string result;
-  for (auto pair : _data)
-    for (auto pair2 : pair.second)
-      result += pair2.second->toString() + "\n";
+  for (size_t i : _used)
+    result += _entries[i].value->toString() + "\n";
 
   return result;
 }
 
 size_t PredictionContextMergeCache::count() const {
-  size_t result = 0;
-  for (auto entry : _data)
-    result += entry.second.size();
-  return result;
+  return _used.size();
 }
-
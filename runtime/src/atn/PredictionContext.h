@@ -14,10 +14,9 @@ namespace atn {
 
   struct PredictionContextHasher;
   struct PredictionContextComparer;
+  class PredictionContextCache;
   class PredictionContextMergeCache;
 
-  typedef std::unordered_set<Ref<PredictionContext>, PredictionContextHasher, PredictionContextComparer> PredictionContextCache;
-
   class ANTLR4CPP_PUBLIC PredictionContext {
   public:
     /// Represents $ in local context prediction, which means wildcard.
@@ -36,7 +35,7 @@ namespace atn {
     static const size_t INITIAL_HASH = 1;
 
   public:
-    static size_t globalNodeCount;
+    static std::atomic<size_t> globalNodeCount;
     const size_t id;
 
     /// <summary>
@@ -201,9 +200,13 @@ namespace atn {
   public:
     static std::string toDOTString(const Ref<PredictionContext> &context);
 
+    /// Returns the node of contextCache that is equal to context, adding it
+    /// and its parents (as heap copies) if needed. The cache holds a single
+    /// node per context graph, so cached nodes are equal if and only if they
+    /// are the same object.
     static Ref<PredictionContext> getCachedContext(const Ref<PredictionContext> &context,
       PredictionContextCache &contextCache,
-      std::map<Ref<PredictionContext>, Ref<PredictionContext>> &visited);
+      std::unordered_map<PredictionContext *, Ref<PredictionContext>> &visited);
 
     // ter's recursive version of Sam's getAllNodes()
     static std::vector<Ref<PredictionContext>> getAllContextNodes(const Ref<PredictionContext> &context);
@@ -232,21 +235,78 @@ namespace atn {
     }
   };
 
-  class PredictionContextMergeCache {
+  /// The context graphs shared by all DFA states of a grammar, hash-consed:
+  /// every node is in the table once, and its parents are nodes of the table
+  /// as well. So a node made of cached parents is looked up by its cached hash
+  /// code, return states and parent pointers, without comparing the graphs
+  /// below it.
+  ///
+  /// The table is open addressing with linear probing, the hash codes in one
+  /// array and the nodes in another, and never more than half full. Nodes are
+  /// never removed. Access must be serialized, as ATNSimulator::_stateLock does.
+  class ANTLR4CPP_PUBLIC PredictionContextCache {
+  public:
+    PredictionContextCache();
+
+    /// Returns the node equal to context, or null. Parents are compared by
+    /// pointer first, so only the part of context that is not made of cached
+    /// nodes is walked.
+    Ref<PredictionContext> find(const PredictionContext &context) const;
+
+    /// Returns the node with this hash code, parents and return states, or null.
+    Ref<PredictionContext> find(size_t hashCode, const std::vector<Ref<PredictionContext>> &parents,
+                                const std::vector<size_t> &returnStates) const;
+
+    /// Adds a node that find() does not know yet.
+    void insert(Ref<PredictionContext> const& context);
+
+    size_t size() const;
+    bool empty() const;
+
+  private:
+    std::vector<size_t> _hashCodes;
+    std::vector<Ref<PredictionContext>> _contexts;
+    size_t _size;
+
+    template<typename Equal>
+    Ref<PredictionContext> find(size_t hashCode, size_t size, Equal equal) const;
+    void grow();
+  };
+
+  /// Remembers the results of merging two contexts during a single prediction.
+  ///
+  /// The cache is direct mapped: a pair of contexts has one slot, picked by
+  /// their hash codes, and a newer pair in the same slot replaces the older
+  /// one. So lookups are a single probe, and the cache never holds more than
+  /// CAPACITY results however long a prediction runs. clear() releases the
+  /// slots that were used; it is called after every prediction, so the cache
+  /// doesn't keep contexts of the arena of the prediction alive.
+  class ANTLR4CPP_PUBLIC PredictionContextMergeCache {
   public:
+    static const size_t CAPACITY = 512;
+
+    PredictionContextMergeCache();
+
     Ref<PredictionContext> put(Ref<PredictionContext> const& key1, Ref<PredictionContext> const& key2,
                                Ref<PredictionContext> const& value);
-    Ref<PredictionContext> get(Ref<PredictionContext> const& key1, Ref<PredictionContext> const& key2);
+    Ref<PredictionContext> get(Ref<PredictionContext> const& key1, Ref<PredictionContext> const& key2) const;
 
     void clear();
     std::string toString() const;
     size_t count() const;
 
   private:
-    std::unordered_map<Ref<PredictionContext>,
-      std::unordered_map<Ref<PredictionContext>, Ref<PredictionContext>, PredictionContextHasher, PredictionContextComparer>,
-      PredictionContextHasher, PredictionContextComparer> _data;
+    struct Entry {
+      Ref<PredictionContext> key1;
+      Ref<PredictionContext> key2;
+      Ref<PredictionContext> value;
+    };
+
+    std::vector<Entry> _entries; // Made by the first put().
+    std::vector<size_t> _used; // Slots filled since the last clear().
 
+    static size_t slot(Ref<PredictionContext> const& key1, Ref<PredictionContext> const& key2);
+    static bool matches(Ref<PredictionContext> const& key, Ref<PredictionContext> const& other);
   };
 
 } // namespace atn
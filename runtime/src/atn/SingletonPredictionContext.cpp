@@ -4,6 +4,7 @@
  */
 
 #include "atn/EmptyPredictionContext.h"
+#include "atn/PredictionArena.h"
 
 #include "atn/SingletonPredictionContext.h"
 
@@ -24,7 +25,7 @@ Ref<SingletonPredictionContext> SingletonPredictionContext::create(Ref<Predictio
     // someone can pass in the bits of an array ctx that mean $
     return std::dynamic_pointer_cast<SingletonPredictionContext>(EMPTY);
   }
-  return std::make_shared<SingletonPredictionContext>(parent, returnState);
+  return PredictionArena::make<SingletonPredictionContext>(parent, returnState);
 }
 
 size_t SingletonPredictionContext::size() const {
@@ -25,9 +25,10 @@ DFA::DFA(atn::DecisionState *atnStartState, size_t decision)
   if (is<atn::StarLoopEntryState *>(atnStartState)) {
     if (static_cast<atn::StarLoopEntryState *>(atnStartState)->isPrecedenceDecision) {
       _precedenceDfa = true;
-      s0 = new DFAState(std::unique_ptr<atn::ATNConfigSet>(new atn::ATNConfigSet()));
-      s0->isAcceptState = false;
-      s0->requiresFullContext = false;
+      DFAState *start = new DFAState(std::unique_ptr<atn::ATNConfigSet>(new atn::ATNConfigSet()));
+      start->isAcceptState = false;
+      start->requiresFullContext = false;
+      s0 = start;
     }
   }
 }
@@ -38,7 +39,7 @@ DFA::DFA(DFA &&other) : atnStartState(other.atnStartState), decision(other.decis
 
   other.atnStartState = nullptr;
   other.decision = 0;
-  s0 = other.s0;
+  s0 = other.s0.load();
   other.s0 = nullptr;
   _precedenceDfa = other._precedenceDfa;
   other._precedenceDfa = false;
@@ -53,7 +54,7 @@ DFA::~DFA() {
   }
 
   if (!s0InList)
-    delete s0;
+    delete s0.load();
 }
 
 bool DFA::isPrecedenceDfa() const {
@@ -63,11 +64,7 @@ bool DFA::isPrecedenceDfa() const {
 DFAState* DFA::getPrecedenceStartState(int precedence) const {
   assert(_precedenceDfa); // Only precedence DFAs may contain a precedence start state.
 
-  auto iterator = s0->edges.find(precedence);
-  if (iterator == s0->edges.end())
-    return nullptr;
-
-  return iterator->second;
+  return s0.load(std::memory_order_relaxed)->edges.get(precedence); // s0 of a precedence DFA never changes.
 }
 
 void DFA::setPrecedenceStartState(int precedence, DFAState *startState, SingleWriteMultipleReadLock &lock) {
@@ -81,7 +78,7 @@ void DFA::setPrecedenceStartState(int precedence, DFAState *startState, SingleWr
 
   {
     lock.writeLock();
-    s0->edges[precedence] = startState;
+    s0.load(std::memory_order_relaxed)->edges.set(precedence, startState, 0);
     lock.writeUnlock();
   }
 }
@@ -22,7 +22,10 @@ namespace dfa {
     /// From which ATN state did we create this DFA?
     atn::DecisionState *atnStartState;
     std::unordered_set<DFAState *, DFAState::Hasher, DFAState::Comparer> states; // States are owned by this class.
-    DFAState *s0;
+
+    /// Read without a lock by the simulators, so it is published with a release store once
+    /// the state it points to is complete.
+    std::atomic<DFAState *> s0;
     size_t decision;
 
     DFA(atn::DecisionState *atnStartState);
@@ -0,0 +1,103 @@
+﻿/* Copyright (c) 2012-2017 The ANTLR Project. All rights reserved.
+ * Use of this file is governed by the BSD 3-clause license that
+ * can be found in the LICENSE.txt file in the project root.
+ */
+
+#include "dfa/DFAEdges.h"
+
+using namespace antlr4::dfa;
+
+DFAEdges::DFAEdges() : _dense(nullptr), _denseSize(0), _overflow(nullptr) {
+}
+
+DFAEdges::~DFAEdges() {
+  delete[] _dense.load();
+  delete _overflow.load();
+}
+
+void DFAEdges::set(size_t symbol, DFAState *target, size_t denseSymbols) {
+  std::atomic<DFAState *> *dense = _dense.load(std::memory_order_relaxed);
+  if (dense == nullptr) {
+    _denseSize = denseSymbols + 1;
+    dense = new std::atomic<DFAState *>[_denseSize]();
+    _dense.store(dense, std::memory_order_release);
+  }
+
+  size_t slot = symbol + 1;
+  if (slot < _denseSize) {
+    dense[slot].store(target, std::memory_order_release);
+    return;
+  }
+
+  Overflow *overflow = _overflow.load(std::memory_order_relaxed);
+  if (overflow != nullptr && overflow->set(slot, target)) {
+    return;
+  }
+
+  // Full or not there yet: publish a larger copy that has the new edge.
+  Overflow *larger = new Overflow(overflow == nullptr ? 8 : overflow->capacity * 2);
+  if (overflow != nullptr) {
+    for (size_t i = 0; i < overflow->capacity; i++) {
+      size_t key = overflow->entries[i].key.load(std::memory_order_relaxed);
+      if (key != 0) {
+        larger->set(key, overflow->entries[i].target.load(std::memory_order_relaxed));
+      }
+    }
+  }
+  larger->set(slot, target);
+  larger->replaced.reset(overflow);
+  _overflow.store(larger, std::memory_order_release);
+}
+
+size_t DFAEdges::size() const {
+  size_t count = 0;
+  forEach([&count](size_t, DFAState *) { count++; });
+  return count;
+}
+
+size_t DFAEdges::allocatedSize() const {
+  size_t bytes = _dense.load() == nullptr ? 0 : _denseSize * sizeof(std::atomic<DFAState *>);
+  for (Overflow *overflow = _overflow.load(); overflow != nullptr; overflow = overflow->replaced.get()) {
+    bytes += sizeof(Overflow) + overflow->capacity * sizeof(Overflow::Entry);
+  }
+  return bytes;
+}
+
+DFAEdges::Overflow::Overflow(size_t capacity) : capacity(capacity), count(0), entries(new Entry[capacity]) {
+}
+
+bool DFAEdges::Overflow::set(size_t slot, DFAState *target) {
+  size_t mask = capacity - 1;
+  size_t i = hash(slot) & mask;
+  for (; ; i = (i + 1) & mask) {
+    size_t key = entries[i].key.load(std::memory_order_relaxed);
+    if (key == slot) {
+      entries[i].target.store(target, std::memory_order_release);
+      return true;
+    }
+    if (key == 0) {
+      break;
+    }
+  }
+
+  if ((count + 1) * 2 > capacity) {
+    return false;
+  }
+  // The target first, so a reader that finds the key finds the target too.
+  entries[i].target.store(target, std::memory_order_relaxed);
+  entries[i].key.store(slot, std::memory_order_release);
+  count++;
+  return true;
+}
+
+std::vector<std::pair<size_t, DFAState *>> DFAEdges::Overflow::sorted() const {
+  std::vector<std::pair<size_t, DFAState *>> result;
+  for (size_t i = 0; i < capacity; i++) {
+    size_t key = entries[i].key.load(std::memory_order_acquire);
+    if (key != 0) {
+      result.push_back({ key, entries[i].target.load(std::memory_order_acquire) });
+    }
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
@@ -0,0 +1,130 @@
+﻿/* Copyright (c) 2012-2017 The ANTLR Project. All rights reserved.
+ * Use of this file is governed by the BSD 3-clause license that
+ * can be found in the LICENSE.txt file in the project root.
+ */
+
+#pragma once
+
+#include "antlr4-common.h"
+
+namespace antlr4 {
+namespace dfa {
+
+  class DFAState;
+
+  /// The outgoing edges of a DFA state, by symbol.
+  ///
+  /// The symbols a recognizer sees most are kept in an array indexed by the
+  /// symbol, shifted up by 1 so (-1) <seealso cref="Token#EOF"/> maps to slot 0:
+  /// the characters 0..127 of a lexer, every token type of a parser. The array
+  /// is made when the first edge is added, with the size the caller asks for,
+  /// so states without edges cost no more than the table itself. Other symbols
+  /// (code points beyond ASCII, precedence levels) go to an overflow hash table.
+  ///
+  /// get() takes no lock, so threads that share a DFA can follow its edges at
+  /// the same time. Edges, the array and the overflow table are published
+  /// with release stores and read with acquire loads, so a reader that finds
+  /// a target also sees everything that was set on it before it was linked.
+  /// Edges are never removed; a full overflow table is replaced by a larger
+  /// copy, and the old one is kept until the table is destroyed, as readers
+  /// may still be probing it. Calls of set() must be serialized by the caller,
+  /// as ATNSimulator::_edgeLock does. size(), allocatedSize() and forEach()
+  /// must not run concurrently with set().
+  class ANTLR4CPP_PUBLIC DFAEdges {
+  public:
+    DFAEdges();
+    DFAEdges(const DFAEdges &other) = delete;
+    ~DFAEdges();
+
+    DFAEdges& operator = (const DFAEdges &other) = delete;
+
+    /// Returns the target of the edge for symbol, or null if there is none.
+    DFAState* get(size_t symbol) const {
+      std::atomic<DFAState *> *dense = _dense.load(std::memory_order_acquire);
+      if (dense == nullptr) {
+        return nullptr;
+      }
+      size_t slot = symbol + 1;
+      if (slot < _denseSize) {
+        return dense[slot].load(std::memory_order_acquire);
+      }
+      Overflow *overflow = _overflow.load(std::memory_order_acquire);
+      return overflow == nullptr ? nullptr : overflow->get(slot);
+    }
+
+    /// Adds or replaces the edge for symbol. If this is the first edge, the
+    /// array gets room for EOF and the symbols 0..denseSymbols-1.
+    void set(size_t symbol, DFAState *target, size_t denseSymbols);
+
+    /// The number of edges.
+    size_t size() const;
+
+    /// Bytes allocated for the edges, besides the table itself.
+    size_t allocatedSize() const;
+
+    /// Calls f(symbol, target) for every edge, in ascending order of slot,
+    /// that is EOF first.
+    template<typename Function>
+    void forEach(Function f) const {
+      std::atomic<DFAState *> *dense = _dense.load(std::memory_order_acquire);
+      for (size_t slot = 0; dense != nullptr && slot < _denseSize; slot++) {
+        DFAState *target = dense[slot].load(std::memory_order_acquire);
+        if (target != nullptr) {
+          f(slot - 1, target);
+        }
+      }
+      Overflow *overflow = _overflow.load(std::memory_order_acquire);
+      if (overflow != nullptr) {
+        for (auto &edge : overflow->sorted()) {
+          f(edge.first - 1, edge.second);
+        }
+      }
+    }
+
+  private:
+    /// Open addressing on the slot, with linear probing and at most half of
+    /// the entries used, so a probe always ends at an empty entry. Slot 0 is
+    /// always in the array, so a key of 0 marks an empty entry.
+    class Overflow {
+    public:
+      explicit Overflow(size_t capacity);
+
+      DFAState* get(size_t slot) const {
+        size_t mask = capacity - 1;
+        for (size_t i = hash(slot) & mask; ; i = (i + 1) & mask) {
+          size_t key = entries[i].key.load(std::memory_order_acquire);
+          if (key == slot) {
+            return entries[i].target.load(std::memory_order_acquire);
+          }
+          if (key == 0) {
+            return nullptr;
+          }
+        }
+      }
+
+      struct Entry {
+        std::atomic<size_t> key { 0 };
+        std::atomic<DFAState *> target { nullptr };
+      };
+
+      const size_t capacity;
+      size_t count;
+      std::unique_ptr<Entry[]> entries;
+      std::unique_ptr<Overflow> replaced; // The smaller table this one replaced.
+
+      static size_t hash(size_t slot) {
+        return slot * 0x9E3779B97F4A7C15ULL >> 32;
+      }
+
+      /// Sets the target of slot, if the table has room for it.
+      bool set(size_t slot, DFAState *target);
+      std::vector<std::pair<size_t, DFAState *>> sorted() const;
+    };
+
+    std::atomic<std::atomic<DFAState *> *> _dense;
+    size_t _denseSize; // Written before _dense is published.
+    std::atomic<Overflow *> _overflow;
+  };
+
+} // namespace dfa
+} // namespace antlr4
@@ -28,14 +28,13 @@ std::string DFASerializer::toString() const {
   std::stringstream ss;
   std::vector<DFAState *> states = _dfa->getStates();
   for (auto s : states) {
-    for (size_t i = 0; i < s->edges.size(); i++) {
-      DFAState *t = s->edges[i];
-      if (t != nullptr && t->stateNumber != INT32_MAX) {
+    s->edges.forEach([&](size_t i, DFAState *t) {
+      if (t->stateNumber != INT32_MAX) {
         ss << getStateString(s);
         std::string label = getEdgeLabel(i);
         ss << "-" << label << "->" << getStateString(t) << "\n";
       }
-    }
+    });
   }
 
   return ss.str();
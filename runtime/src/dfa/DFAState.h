@@ -6,6 +6,7 @@
 #pragma once
 
 #include "antlr4-common.h"
+#include "dfa/DFAEdges.h"
 
 namespace antlr4 {
 namespace dfa {
@@ -55,11 +56,8 @@ namespace dfa {
 
     std::unique_ptr<atn::ATNConfigSet> configs;
 
-    /// {@code edges[symbol]} points to target of symbol. Shift up by 1 so (-1)
-    ///  <seealso cref="Token#EOF"/> maps to {@code edges[0]}.
-    // ml: this is a sparse list, so we use a map instead of a vector.
-    //     Watch out: we no longer have the -1 offset, as it isn't needed anymore.
-    std::unordered_map<size_t, DFAState *> edges;
+    /// {@code edges.get(symbol)} points to target of symbol.
+    DFAEdges edges;
 
     bool isAcceptState;
 
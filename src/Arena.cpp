@@ -0,0 +1,58 @@
+#include <cstdlib>
+#include <cstring>
+#include "Arena.h"
+
+/**
+ * Allocate memory that lives as long as the arena
+ * @param size the number of bytes
+ * @param alignment a power of two the address is a multiple of
+ * @return the memory, which is not initialised
+ */
+void *Arena::allocate(size_t size, size_t alignment) {
+    if (blocks != nullptr) {
+        char *data = reinterpret_cast<char *>(blocks + 1);
+        size_t offset = (reinterpret_cast<size_t>(data) + blocks->used + alignment - 1) & ~(alignment - 1);
+        offset -= reinterpret_cast<size_t>(data);
+        if (offset + size <= blocks->size) {
+            blocks->used = offset + size;
+            return data + offset;
+        }
+    }
+
+    // Start a new block, big enough for anything that does not fit a normal one
+    size_t blockSize = size + alignment > BLOCK_SIZE ? size + alignment : BLOCK_SIZE;
+    Block *block = static_cast<Block *>(malloc(sizeof(Block) + blockSize));
+    if (block == nullptr)
+        throw std::bad_alloc();
+    block->next = blocks;
+    block->size = blockSize;
+    block->used = 0;
+    blocks = block;
+    bytes += sizeof(Block) + blockSize;
+    return allocate(size, alignment);
+}
+
+/**
+ * Copy a string into the arena
+ * @param text the characters
+ * @param length the number of characters
+ * @return the NUL terminated copy
+ */
+char *Arena::copy(const char *text, size_t length) {
+    char *result = static_cast<char *>(allocate(length + 1, 1));
+    memcpy(result, text, length);
+    result[length] = '\0';
+    return result;
+}
+
+/**
+ * Free all memory of the arena at once
+ */
+void Arena::release() {
+    while (blocks != nullptr) {
+        Block *next = blocks->next;
+        free(blocks);
+        blocks = next;
+    }
+    bytes = 0;
+}
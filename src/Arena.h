@@ -0,0 +1,102 @@
+#ifndef SHELL_ARENA_H
+#define SHELL_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+/**
+ * A region of memory that objects are carved out of one after the other, and
+ * that is only ever freed as a whole.
+ *
+ * Everything a parsed line consists of - its pipelines, their commands, the
+ * argv array and strings of every command and its redirects - is allocated in
+ * the arena of the Sequence, which frees it all with one call when the line is
+ * done (or when its plan is dropped from the PlanCache). Building a line takes
+ * a couple of allocations instead of several per word, and the line ends up in
+ * a few adjacent blocks of memory.
+ * Objects in an arena are never destroyed, so only types that need no
+ * destructor can be put in one.
+ */
+class Arena {
+private:
+    struct Block {
+        Block *next;
+        size_t size;      //< Bytes of data that follow the header.
+        size_t used;
+    };
+
+    static const size_t BLOCK_SIZE = 1024;
+
+    Block *blocks;        //< The block that is being filled, the older ones follow.
+    size_t bytes;         //< Total size of all blocks.
+
+public:
+    Arena()
+            : blocks(nullptr), bytes(0) {}
+
+    ~Arena() { release(); }
+
+    Arena(Arena const &) = delete;
+
+    Arena &operator=(Arena const &) = delete;
+
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    /**
+     * Allocate an array of value-initialised objects
+     * @param count the number of elements
+     * @return the first element, or nullptr if count is 0
+     */
+    template<typename T>
+    T *newArray(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        if (count == 0)
+            return nullptr;
+        T *items = static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+        for (size_t i = 0; i < count; i++)
+            new(items + i) T();
+        return items;
+    }
+
+    char *copy(const char *text, size_t length);
+
+    size_t getBytes() const { return bytes; }
+
+    void release();
+};
+
+/**
+ * An array in an arena: a pointer and the number of elements, which can be
+ * used in a range-based for loop.
+ */
+template<typename T>
+class ArenaArray {
+private:
+    T *items;
+    size_t count;
+
+public:
+    ArenaArray()
+            : items(nullptr), count(0) {}
+
+    ArenaArray(Arena *arena, size_t n)
+            : items(arena->newArray<T>(n)), count(n) {}
+
+    T *begin() const { return items; }
+
+    T *end() const { return items + count; }
+
+    T &operator[](size_t i) const { return items[i]; }
+
+    T &front() const { return items[0]; }
+
+    T &back() const { return items[count - 1]; }
+
+    size_t size() const { return count; }
+
+    bool empty() const { return count == 0; }
+};
+
+
+#endif //SHELL_ARENA_H
@@ -0,0 +1,176 @@
+#include <vector>
+#include <atn/ATNDeserializer.h>
+#include <atn/ATNType.h>
+#include <atn/ActionTransition.h>
+#include <atn/AtomTransition.h>
+#include <atn/BlockEndState.h>
+#include <atn/BlockStartState.h>
+#include <atn/DecisionState.h>
+#include <atn/EpsilonTransition.h>
+#include <atn/LoopEndState.h>
+#include <atn/NotSetTransition.h>
+#include <atn/PlusBlockStartState.h>
+#include <atn/PlusLoopbackState.h>
+#include <atn/PrecedencePredicateTransition.h>
+#include <atn/PredicateTransition.h>
+#include <atn/RangeTransition.h>
+#include <atn/RuleStartState.h>
+#include <atn/RuleStopState.h>
+#include <atn/RuleTransition.h>
+#include <atn/SetTransition.h>
+#include <atn/StarLoopEntryState.h>
+#include <atn/StarLoopbackState.h>
+#include <atn/TokensStartState.h>
+#include <atn/WildcardTransition.h>
+#include <misc/IntervalSet.h>
+#include "AtnImage.h"
+
+using namespace antlr4::atn;
+
+/**
+ * ATNDeserializer makes the lexer actions, but keeps that to itself
+ */
+class LexerActionFactory : public ATNDeserializer {
+public:
+    using ATNDeserializer::lexerActionFactory;
+};
+
+static size_t stateIndex(uint16_t value) {
+    return value == AtnImage::NONE ? INVALID_INDEX : value;
+}
+
+static bool isDecisionState(uint8_t type) {
+    switch (type) {
+        case ATNState::BLOCK_START:
+        case ATNState::PLUS_BLOCK_START:
+        case ATNState::STAR_BLOCK_START:
+        case ATNState::TOKEN_START:
+        case ATNState::STAR_LOOP_ENTRY:
+        case ATNState::PLUS_LOOP_BACK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Make the ATN the tables describe. They come from a verified ATN, so nothing
+ * is checked here.
+ * @return the ATN, equal to what ATNDeserializer makes of the serialized one
+ */
+ATN AtnImage::load() const {
+    ATN atn(static_cast<ATNType>(grammarType), maxTokenType);
+
+    atn.states.reserve(stateCount);
+    for (size_t i = 0; i < stateCount; i++)
+        atn.addState(ATNDeserializer::stateFactory(states[i].type, stateIndex(states[i].ruleIndex)));
+
+    for (size_t i = 0; i < stateCount; i++) {
+        const State &image = states[i];
+        ATNState *state = atn.states[i];
+        switch (image.type) {
+            case ATNState::BLOCK_START:
+            case ATNState::STAR_BLOCK_START:
+                static_cast<BlockStartState *>(state)->endState = static_cast<BlockEndState *>(atn.states[image.endState]);
+                break;
+            case ATNState::PLUS_BLOCK_START:
+                static_cast<BlockStartState *>(state)->endState = static_cast<BlockEndState *>(atn.states[image.endState]);
+                static_cast<PlusBlockStartState *>(state)->loopBackState =
+                        static_cast<PlusLoopbackState *>(atn.states[image.loopBackState]);
+                break;
+            case ATNState::BLOCK_END:
+                static_cast<BlockEndState *>(state)->startState = static_cast<BlockStartState *>(atn.states[image.endState]);
+                break;
+            case ATNState::LOOP_END:
+                static_cast<LoopEndState *>(state)->loopBackState = atn.states[image.loopBackState];
+                break;
+            case ATNState::STAR_LOOP_ENTRY:
+                static_cast<StarLoopEntryState *>(state)->loopBackState =
+                        static_cast<StarLoopbackState *>(atn.states[image.loopBackState]);
+                static_cast<StarLoopEntryState *>(state)->isPrecedenceDecision = (image.flags & PRECEDENCE_DECISION) != 0;
+                break;
+            case ATNState::RULE_START:
+                static_cast<RuleStartState *>(state)->isLeftRecursiveRule = (image.flags & LEFT_RECURSIVE) != 0;
+                break;
+            default:
+                break;
+        }
+        if (isDecisionState(image.type)) {
+            static_cast<DecisionState *>(state)->decision = image.decision == NONE ? -1 : image.decision;
+            static_cast<DecisionState *>(state)->nonGreedy = (image.flags & NON_GREEDY) != 0;
+        }
+    }
+
+    std::vector<antlr4::misc::IntervalSet> sets(setCount);
+    for (size_t i = 0; i < setCount; i++) {
+        for (uint32_t n = setStarts[i]; n < setStarts[i + 1]; n++)
+            sets[i].add(intervals[n].a, intervals[n].b);
+    }
+
+    const Transition *next = transitions;
+    for (size_t i = 0; i < stateCount; i++) {
+        ATNState *state = atn.states[i];
+        for (uint16_t n = 0; n < states[i].transitionCount; n++, next++) {
+            ATNState *target = atn.states[next->target];
+            auto a = static_cast<size_t>(next->a), b = static_cast<size_t>(next->b);
+            antlr4::atn::Transition *transition = nullptr;
+            switch (next->type) {
+                case antlr4::atn::Transition::EPSILON:
+                    transition = new EpsilonTransition(target, a);
+                    break;
+                case antlr4::atn::Transition::RANGE:
+                    transition = new RangeTransition(target, a, b);
+                    break;
+                case antlr4::atn::Transition::RULE:
+                    transition = new RuleTransition(static_cast<RuleStartState *>(target), a, next->b,
+                                                    atn.states[next->c]);
+                    break;
+                case antlr4::atn::Transition::PREDICATE:
+                    transition = new PredicateTransition(target, a, b, next->c != 0);
+                    break;
+                case antlr4::atn::Transition::ATOM:
+                    transition = new AtomTransition(target, a);
+                    break;
+                case antlr4::atn::Transition::ACTION:
+                    transition = new ActionTransition(target, a, b, next->c != 0);
+                    break;
+                case antlr4::atn::Transition::SET:
+                    transition = new SetTransition(target, sets[a]);
+                    break;
+                case antlr4::atn::Transition::NOT_SET:
+                    transition = new NotSetTransition(target, sets[a]);
+                    break;
+                case antlr4::atn::Transition::WILDCARD:
+                    transition = new WildcardTransition(target);
+                    break;
+                case antlr4::atn::Transition::PRECEDENCE:
+                    transition = new PrecedencePredicateTransition(target, next->a);
+                    break;
+                default:
+                    break;
+            }
+            state->addTransition(transition);
+        }
+    }
+
+    for (size_t r = 0; r < ruleCount; r++) {
+        auto *start = static_cast<RuleStartState *>(atn.states[ruleStartStates[r]]);
+        auto *stop = static_cast<RuleStopState *>(atn.states[ruleStopStates[r]]);
+        start->stopState = stop;
+        atn.ruleToStartState.push_back(start);
+        atn.ruleToStopState.push_back(stop);
+        if (ruleTokenTypes != nullptr)
+            atn.ruleToTokenType.push_back(static_cast<size_t>(ruleTokenTypes[r]));
+    }
+    for (size_t m = 0; m < modeCount; m++)
+        atn.modeToStartState.push_back(static_cast<TokensStartState *>(atn.states[modeStartStates[m]]));
+    for (size_t d = 0; d < decisionCount; d++)
+        atn.decisionToState.push_back(static_cast<DecisionState *>(atn.states[decisionStates[d]]));
+
+    LexerActionFactory factory;
+    for (size_t i = 0; i < lexerActionCount; i++) {
+        atn.lexerActions.push_back(factory.lexerActionFactory(static_cast<LexerActionType>(lexerActions[i].type),
+                                                              lexerActions[i].data1, lexerActions[i].data2));
+    }
+    return atn;
+}
@@ -0,0 +1,96 @@
+#ifndef SHELL_ATNIMAGE_H
+#define SHELL_ATNIMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atn/ATN.h>
+
+/**
+ * The ATN of a generated recognizer as constant tables, made at build time.
+ *
+ * ANTLR generates the ATN as a serialized array that every process runs
+ * through ATNDeserializer during static initialization: parsing the array,
+ * deriving the links between states it leaves out, marking precedence
+ * decisions and verifying the result, with a dynamic_cast on nearly every
+ * step. The atn_image tool (tools/atn_image.cpp) does all of that once when
+ * the shell is built and writes the resulting states, transitions, sets,
+ * rules, modes, decisions and lexer actions into a header as constexpr
+ * tables. load() turns them into an ATN in a single pass, creating only the
+ * objects the runtime needs.
+ *
+ * Indexes of states are 16 bit, as in the serialized ATN, with NONE for none.
+ */
+struct AtnImage {
+    static const uint16_t NONE = 0xFFFF;
+
+    enum StateFlags {
+        NON_GREEDY = 1,            //< DecisionState::nonGreedy
+        LEFT_RECURSIVE = 2,        //< RuleStartState::isLeftRecursiveRule
+        PRECEDENCE_DECISION = 4    //< StarLoopEntryState::isPrecedenceDecision
+    };
+
+    struct State {
+        uint8_t type;              //< ATNState::StateType, ATN_INVALID_TYPE for a removed state.
+        uint8_t flags;
+        uint16_t ruleIndex;
+        uint16_t decision;
+        uint16_t endState;         //< Of a block start, or the start state of a block end.
+        uint16_t loopBackState;    //< Of a loop end, star loop entry or plus block start.
+        uint16_t transitionCount;  //< Its transitions follow those of the state before it.
+    };
+
+    /**
+     * A transition, the meaning of a, b and c depends on the type:
+     * EPSILON: outermost precedence return; RANGE: from, to; RULE: rule index,
+     * precedence, follow state; PREDICATE: rule index, predicate index,
+     * context dependent; ATOM: label; ACTION: rule index, action index, context
+     * dependent; SET, NOT_SET: set index; PRECEDENCE: precedence.
+     * Unused values, EOF and INVALID_INDEX are -1.
+     */
+    struct Transition {
+        uint8_t type;              //< Transition::SerializationType
+        uint16_t target;
+        int32_t a;
+        int32_t b;
+        int32_t c;
+    };
+
+    struct Interval {
+        int32_t a;
+        int32_t b;
+    };
+
+    struct LexerAction {
+        uint8_t type;              //< LexerActionType
+        int32_t data1;
+        int32_t data2;
+    };
+
+    uint8_t grammarType;
+    uint32_t maxTokenType;
+
+    const State *states;
+    size_t stateCount;
+    const Transition *transitions;
+    size_t transitionCount;
+    const Interval *intervals;
+    const uint32_t *setStarts;     //< setCount + 1 offsets into intervals.
+    size_t setCount;
+    const uint16_t *ruleStartStates;
+    const uint16_t *ruleStopStates;
+    const int32_t *ruleTokenTypes; //< Lexer only.
+    size_t ruleCount;
+    const uint16_t *modeStartStates;
+    size_t modeCount;
+    const uint16_t *decisionStates;
+    size_t decisionCount;
+    const LexerAction *lexerActions;
+    size_t lexerActionCount;
+    const uint16_t *serialized;    //< The ATN as ANTLR generated it, for comparison.
+    size_t serializedSize;
+
+    antlr4::atn::ATN load() const;
+};
+
+
+#endif //SHELL_ATNIMAGE_H
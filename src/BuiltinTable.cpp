@@ -0,0 +1,704 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "BuiltinTable.h"
+#include "Metrics.h"
+#include "Shell.h"
+#include "SimpleCommand.h"
+
+/**
+ * Copy the given range of a file
+ * @return false if the file could not be read
+ */
+static bool copyRange(int fd, off_t offset, off_t end, FdWriter &out) {
+    char block[65536];
+    while (offset < end) {
+        size_t wanted = static_cast<size_t>(std::min<off_t>(sizeof(block), end - offset));
+        ssize_t n = pread(fd, block, wanted, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return n == 0;
+        out.write(block, static_cast<size_t>(n));
+        offset += n;
+    }
+    return true;
+}
+
+static int builtinCd(Shell *pShell, int argc, char **argv, FdWriter &) {
+    std::string path = argc > 1 ? argv[1] : "";
+    std::string pathToGoTo;
+
+    // If the path is ~ it means the user wants to go their home directory or relative to it
+    if (!pShell->getHomeString().empty() && (path.empty() || path.find('~') != std::string::npos)) {
+        pathToGoTo = pShell->getHomeString();
+        if (path.size() > 1) {
+            // case for ~/example
+            pathToGoTo.append(path.substr(path.find('~') + 1));
+        }
+    } else {
+        pathToGoTo = path;
+    }
+
+    if (chdir(pathToGoTo.c_str()) == 0) {
+        pShell->getCommandTable().directoryChanged();
+        return 0;
+    }
+
+    switch (errno) {
+        case ENOENT:
+            std::cerr << "No such file or directory" << std::endl;
+            break;
+        case EACCES:
+            std::cerr << "Permission denied" << std::endl;
+            break;
+        case ENOTDIR:
+            std::cerr << "Path is not a directory" << std::endl;
+            break;
+        default:
+            break;
+    }
+    return 1;
+}
+
+static int builtinExit(Shell *, int argc, char **argv, FdWriter &out) {
+    out << "exiting, goodbye!\n";
+    out.flush();
+    exit(argc > 1 ? atoi(argv[1]) : 0);
+}
+
+static int builtinPwd(Shell *, int, char **, FdWriter &out) {
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == nullptr) {
+        std::cerr << "pwd: " << SimpleCommand::describeErrno(errno) << std::endl;
+        return 1;
+    }
+    out << cwd << '\n';
+    return 0;
+}
+
+static int builtinEcho(Shell *, int argc, char **argv, FdWriter &out) {
+    int first = 1;
+    bool newline = true;
+    if (argc > 1 && strcmp(argv[1], "-n") == 0) {
+        newline = false;
+        first = 2;
+    }
+
+    for (int i = first; i < argc; i++) {
+        if (i > first)
+            out << ' ';
+        out << argv[i];
+    }
+    if (newline)
+        out << '\n';
+    return 0;
+}
+
+static int builtinTrue(Shell *, int, char **, FdWriter &) {
+    return 0;
+}
+
+static int builtinFalse(Shell *, int, char **, FdWriter &) {
+    return 1;
+}
+
+static int builtinHistory(Shell *pShell, int argc, char **argv, FdWriter &out) {
+    HistoryStore &history = pShell->getHistory();
+    if (history.getDataFd() == -1) {
+        std::cerr << "history: " << history.getPath() << ": could not be opened" << std::endl;
+        return 1;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--compact") == 0) {
+        size_t removed;
+        std::string error;
+        if (!history.compact(&removed, &error)) {
+            std::cerr << "history: " << error << std::endl;
+            return 1;
+        }
+        out << "history: removed " << removed << " duplicate entries\n";
+        return 0;
+    }
+
+    // history -s text [N] prints the N most recent distinct entries containing text
+    if (argc > 1 && strcmp(argv[1], "-s") == 0) {
+        if (argc < 3) {
+            std::cerr << "history: -s: text to search for required" << std::endl;
+            return 2;
+        }
+        size_t limit = argc > 3 ? strtoul(argv[3], nullptr, 10) : 10;
+        std::string line;
+        for (size_t index : pShell->getHistorySearch().find(argv[2], limit)) {
+            if (history.get(index, &line))
+                out << index + 1 << '\t' << line << '\n';
+        }
+        return 0;
+    }
+
+    // history N prints the last N entries, one contiguous range of the file up
+    // to the end of the last indexed entry
+    off_t start = 0;
+    off_t end = static_cast<off_t>(history.getDataSize());
+    if (argc > 1) {
+        char *last;
+        long count = strtol(argv[1], &last, 10);
+        if (*argv[1] == '\0' || *last != '\0' || count < 0) {
+            std::cerr << "history: " << argv[1] << ": numeric argument required" << std::endl;
+            return 1;
+        }
+        size_t size = history.size();
+        if (count == 0)
+            start = end;
+        else if (static_cast<size_t>(count) < size)
+            start = static_cast<off_t>(history.getOffset(size - static_cast<size_t>(count)));
+    }
+
+    return copyRange(history.getDataFd(), start, end, out) ? 0 : 1;
+}
+
+static int builtinLastCommand(Shell *pShell, int, char **, FdWriter &out) {
+    HistoryStore &history = pShell->getHistory();
+    std::string line;
+    if (history.size() > 0 && history.get(history.size() - 1, &line))
+        out << line << '\n';
+    return 0;
+}
+
+static int builtinHash(Shell *pShell, int argc, char **argv, FdWriter &out) {
+    CommandTable &table = pShell->getCommandTable();
+    if (argc == 1) {
+        std::ostringstream text;
+        table.print(text);
+        out << text.str();
+        return 0;
+    }
+    if (strcmp(argv[1], "-r") == 0) {
+        table.reset();
+        return 0;
+    }
+
+    // Look the commands up right away, like other shells do
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        if (table.lookup(argv[i]).empty()) {
+            std::cerr << "hash: " << argv[i] << ": not found" << std::endl;
+            status = 1;
+        }
+    }
+    return status;
+}
+
+static int builtinPlanCache(Shell *pShell, int argc, char **argv, FdWriter &out) {
+    PlanCache &cache = pShell->getPlanCache();
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        cache.clear();
+        return 0;
+    }
+
+    std::ostringstream text;
+    cache.print(text);
+    out << text.str();
+    return 0;
+}
+
+static int builtinStats(Shell *, int argc, char **argv, FdWriter &out) {
+    std::string option = argc > 1 ? argv[1] : "";
+    if (option == "on")
+        return Metrics::enable() ? 0 : 1;
+    if (option == "off") {
+        Metrics::disable();
+        return 0;
+    }
+    if (option == "-c") {
+        Metrics::reset();
+        return 0;
+    }
+
+    std::ostringstream text;
+    std::string error;
+    if (option == "-d") {
+        // stats -d file prints the samples of a ring file, e.g. of a shell that crashed
+        if (argc < 3) {
+            std::cerr << "stats: -d: ring file required" << std::endl;
+            return 2;
+        }
+        if (!Metrics::printRing(argv[2], text, &error)) {
+            std::cerr << "stats: " << error << std::endl;
+            return 1;
+        }
+    } else if (option == "-p") {
+        // stats -p [file] in the Prometheus text format, a file is replaced as a whole
+        Metrics::printPrometheus(text);
+        if (argc > 2) {
+            // A new file with a name nobody can guess, next to it so the rename is atomic
+            std::string temporary = std::string(argv[2]) + ".XXXXXX";
+            int fd = mkostemp(&temporary[0], O_CLOEXEC);
+            bool ok = fd != -1 && fchmod(fd, 0644) == 0;
+            if (ok) {
+                FdWriter file(fd);
+                file << text.str();
+                ok = file.flush() && fsync(fd) == 0;
+            }
+            if (fd != -1)
+                ok = close(fd) == 0 && ok;
+            if (!ok || rename(temporary.c_str(), argv[2]) != 0) {
+                std::cerr << "stats: " << argv[2] << ": " << strerror(errno) << std::endl;
+                if (fd != -1)
+                    unlink(temporary.c_str());
+                return 1;
+            }
+            return 0;
+        }
+    } else if (option.empty()) {
+        Metrics::print(text);
+    } else {
+        std::cerr << "stats: usage: stats [on | off | -c | -p [file] | -d ringfile]" << std::endl;
+        return 2;
+    }
+    out << text.str();
+    return 0;
+}
+
+static int builtinJobs(Shell *pShell, int, char **, FdWriter &out) {
+    std::ostringstream text;
+    // A copy of the table in a pipeline must not reap the children of the shell
+    if (!pShell->isSubshell())
+        pShell->getJobTable().reap(text);
+    pShell->getJobTable().print(text);
+    out << text.str();
+    return 0;
+}
+
+static int builtinWait(Shell *pShell, int argc, char **argv, FdWriter &) {
+    JobTable &jobs = pShell->getJobTable();
+
+    // wait for the given jobs (%n) or for all of them
+    if (argc == 1) {
+        jobs.waitAll();
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        int id = jobs.findJob(argv[i]);
+        if (id == -1) {
+            std::cerr << "wait: " << argv[i] << ": no such job" << std::endl;
+            status = 127;
+        } else {
+            status = JobTable::exitStatus(jobs.wait(id, false));
+        }
+    }
+    return status;
+}
+
+static int builtinFg(Shell *pShell, int argc, char **argv, FdWriter &out) {
+    JobTable &jobs = pShell->getJobTable();
+    std::string spec = argc > 1 ? argv[1] : "%%";
+    int id = jobs.findJob(spec);
+    if (id == -1) {
+        std::cerr << "fg: " << (argc > 1 ? spec + ": no such job" : "no current job") << std::endl;
+        return 1;
+    }
+
+    out << jobs.getCommandLine(id) << '\n';
+    out.flush();
+    jobs.resume(id);
+    return JobTable::exitStatus(jobs.wait(id, true));
+}
+
+/**
+ * Write the character for the escape sequence at text[*pPos] (just after the backslash)
+ * @param pPos moved to the last character of the sequence
+ */
+static void writeEscape(std::string const &text, size_t *pPos, FdWriter &out) {
+    size_t i = *pPos;
+    if (i >= text.size()) {
+        out << '\\';
+        *pPos = i - 1;
+        return;
+    }
+
+    switch (text[i]) {
+        case 'n': out << '\n'; break;
+        case 't': out << '\t'; break;
+        case 'r': out << '\r'; break;
+        case 'a': out << '\a'; break;
+        case 'b': out << '\b'; break;
+        case 'f': out << '\f'; break;
+        case 'v': out << '\v'; break;
+        case '\\': out << '\\'; break;
+        case '"': out << '"'; break;
+        case '\'': out << '\''; break;
+        case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': {
+            // up to three octal digits
+            int value = 0;
+            size_t end = std::min(text.size(), i + 3);
+            for (; i < end && text[i] >= '0' && text[i] <= '7'; i++)
+                value = value * 8 + (text[i] - '0');
+            out << static_cast<char>(value);
+            i--;
+            break;
+        }
+        default:
+            out << '\\' << text[i];
+            break;
+    }
+    *pPos = i;
+}
+
+template<typename T>
+static void writeFormatted(FdWriter &out, std::string const &spec, T value) {
+    int n = snprintf(nullptr, 0, spec.c_str(), value);
+    if (n <= 0)
+        return;
+    std::vector<char> text(static_cast<size_t>(n) + 1);
+    snprintf(text.data(), text.size(), spec.c_str(), value);
+    out.write(text.data(), static_cast<size_t>(n));
+}
+
+/**
+ * The numeric value of a printf argument, a leading quote gives the value of the next character
+ * @param pStatus set to 1 if the argument is not a number
+ */
+static long long printfNumber(const char *arg, int *pStatus) {
+    if (arg == nullptr || *arg == '\0')
+        return 0;
+    if (*arg == '\'' || *arg == '"')
+        return static_cast<unsigned char>(arg[1]);
+
+    char *end;
+    errno = 0;
+    long long value = strtoll(arg, &end, 0);
+    if (*end != '\0' || errno != 0) {
+        std::cerr << "printf: " << arg << ": invalid number" << std::endl;
+        *pStatus = 1;
+    }
+    return value;
+}
+
+static int builtinPrintf(Shell *, int argc, char **argv, FdWriter &out) {
+    if (argc < 2) {
+        std::cerr << "printf: usage: printf format [arguments]" << std::endl;
+        return 2;
+    }
+
+    std::string format = argv[1];
+    int next = 2;
+    int status = 0;
+
+    // The format is reused for as long as it consumes arguments
+    do {
+        int first = next;
+        for (size_t i = 0; i < format.size(); i++) {
+            char c = format[i];
+            if (c == '\\') {
+                i++;
+                writeEscape(format, &i, out);
+                continue;
+            }
+            if (c != '%') {
+                out << c;
+                continue;
+            }
+            if (i + 1 < format.size() && format[i + 1] == '%') {
+                out << '%';
+                i++;
+                continue;
+            }
+
+            // flags, width and precision are passed on to snprintf
+            size_t start = i++;
+            while (i < format.size() && strchr("-+ #0", format[i]) != nullptr)
+                i++;
+            while (i < format.size() && isdigit(static_cast<unsigned char>(format[i])))
+                i++;
+            if (i < format.size() && format[i] == '.') {
+                i++;
+                while (i < format.size() && isdigit(static_cast<unsigned char>(format[i])))
+                    i++;
+            }
+            if (i >= format.size()) {
+                std::cerr << "printf: " << format.substr(start) << ": missing format character" << std::endl;
+                return 1;
+            }
+
+            char conversion = format[i];
+            std::string spec = format.substr(start, i - start);
+            const char *arg = next < argc ? argv[next++] : nullptr;
+
+            switch (conversion) {
+                case 's':
+                    writeFormatted(out, spec + 's', arg == nullptr ? "" : arg);
+                    break;
+                case 'b': {
+                    std::string text = arg == nullptr ? "" : arg;
+                    for (size_t j = 0; j < text.size(); j++) {
+                        if (text[j] == '\\') {
+                            j++;
+                            writeEscape(text, &j, out);
+                        } else {
+                            out << text[j];
+                        }
+                    }
+                    break;
+                }
+                case 'c':
+                    if (arg != nullptr && *arg != '\0')
+                        out << *arg;
+                    break;
+                case 'd':
+                case 'i':
+                    writeFormatted(out, spec + "lld", printfNumber(arg, &status));
+                    break;
+                case 'u':
+                case 'o':
+                case 'x':
+                case 'X':
+                    writeFormatted(out, spec + "ll" + conversion,
+                                   static_cast<unsigned long long>(printfNumber(arg, &status)));
+                    break;
+                case 'f':
+                case 'e':
+                case 'E':
+                case 'g':
+                case 'G':
+                    writeFormatted(out, spec + conversion, arg == nullptr ? 0.0 : strtod(arg, nullptr));
+                    break;
+                default:
+                    std::cerr << "printf: " << conversion << ": invalid format character" << std::endl;
+                    return 1;
+            }
+        }
+        if (next == first)
+            break;
+    } while (next < argc);
+
+    return status;
+}
+
+/**
+ * Parse an operand of an integer comparison of test
+ * @return false if it is not an integer
+ */
+static bool testInteger(const char *arg, long long *pValue) {
+    char *end;
+    errno = 0;
+    *pValue = strtoll(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || errno != 0) {
+        std::cerr << "test: " << arg << ": integer expression expected" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Evaluate a test expression of at most four words
+ * @return 0 if it is true, 1 if it is false and 2 on errors
+ */
+static int testExpression(int argc, char **argv) {
+    if (argc == 0)
+        return 1;
+
+    if (argv[0][0] == '!' && argv[0][1] == '\0' && argc > 1) {
+        int status = testExpression(argc - 1, argv + 1);
+        return status == 2 ? 2 : !status;
+    }
+
+    if (argc == 1)
+        return argv[0][0] != '\0' ? 0 : 1;
+
+    if (argc == 2) {
+        std::string op = argv[0];
+        const char *operand = argv[1];
+        struct stat info;
+
+        if (op == "-z")
+            return operand[0] == '\0' ? 0 : 1;
+        if (op == "-n")
+            return operand[0] != '\0' ? 0 : 1;
+        if (op == "-L" || op == "-h")
+            return lstat(operand, &info) == 0 && S_ISLNK(info.st_mode) ? 0 : 1;
+        if (op == "-r")
+            return access(operand, R_OK) == 0 ? 0 : 1;
+        if (op == "-w")
+            return access(operand, W_OK) == 0 ? 0 : 1;
+        if (op == "-x")
+            return access(operand, X_OK) == 0 ? 0 : 1;
+
+        bool exists = stat(operand, &info) == 0;
+        if (op == "-e")
+            return exists ? 0 : 1;
+        if (op == "-f")
+            return exists && S_ISREG(info.st_mode) ? 0 : 1;
+        if (op == "-d")
+            return exists && S_ISDIR(info.st_mode) ? 0 : 1;
+        if (op == "-s")
+            return exists && info.st_size > 0 ? 0 : 1;
+
+        std::cerr << "test: " << op << ": unary operator expected" << std::endl;
+        return 2;
+    }
+
+    if (argc == 3) {
+        std::string op = argv[1];
+        if (op == "=" || op == "==")
+            return strcmp(argv[0], argv[2]) == 0 ? 0 : 1;
+        if (op == "!=")
+            return strcmp(argv[0], argv[2]) != 0 ? 0 : 1;
+
+        static const char *INTEGER_OPS[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+        for (int i = 0; i < 6; i++) {
+            if (op != INTEGER_OPS[i])
+                continue;
+
+            long long left, right;
+            if (!testInteger(argv[0], &left) || !testInteger(argv[2], &right))
+                return 2;
+            bool result[] = {left == right, left != right, left < right,
+                             left <= right, left > right, left >= right};
+            return result[i] ? 0 : 1;
+        }
+
+        std::cerr << "test: " << op << ": binary operator expected" << std::endl;
+        return 2;
+    }
+
+    std::cerr << "test: too many arguments" << std::endl;
+    return 2;
+}
+
+static int builtinTest(Shell *, int argc, char **argv, FdWriter &) {
+    if (strcmp(argv[0], "[") == 0) {
+        if (strcmp(argv[argc - 1], "]") != 0) {
+            std::cerr << "[: missing ']'" << std::endl;
+            return 2;
+        }
+        argc--;
+    }
+    return testExpression(argc - 1, argv + 1);
+}
+
+BuiltinTable::BuiltinTable() {
+    add("cd", builtinCd, true);
+    add("exit", builtinExit, true);
+    add("wait", builtinWait, true);
+    add("fg", builtinFg, true);
+    add("hash", builtinHash, false);
+    add("jobs", builtinJobs, false);
+    add("plancache", builtinPlanCache, false);
+    add("stats", builtinStats, false);
+    add("pwd", builtinPwd, false);
+    add("echo", builtinEcho, false);
+    add("true", builtinTrue, false);
+    add("false", builtinFalse, false);
+    add("history", builtinHistory, false);
+    add("lastcommand", builtinLastCommand, false);
+    add("printf", builtinPrintf, false);
+    add("test", builtinTest, false);
+    add("[", builtinTest, false);
+}
+
+/**
+ * Register a builtin, replacing any earlier one with the same name
+ * @param name the command that runs it
+ * @param handler the implementation
+ * @param shellOnly true if running it in a child would be pointless
+ */
+void BuiltinTable::add(std::string const &name, Handler const &handler, bool shellOnly) {
+    Builtin &builtin = builtins[name];
+    builtin.handler = handler;
+    builtin.shellOnly = shellOnly;
+}
+
+/**
+ * @param name the name of a command
+ * @return the builtin or nullptr if the command is not a builtin
+ */
+const BuiltinTable::Builtin *BuiltinTable::find(std::string const &name) const {
+    auto found = builtins.find(name);
+    return found == builtins.end() ? nullptr : &found->second;
+}
+
+/**
+ * Call the handler with the arguments of the command and flush its output
+ */
+static int invoke(BuiltinTable::Builtin const &builtin, SimpleCommand *cmd, Shell *pShell) {
+    FdWriter out(STDOUT_FILENO);
+    int status = builtin.handler(pShell, static_cast<int>(cmd->getArgc()), cmd->getArgv(), out);
+    out.flush();
+    std::cout.flush();
+    return status;
+}
+
+/**
+ * Run a builtin inside the shell process.
+ * Its redirects are applied to fds 0-2 for the duration of the call only.
+ * @param builtin the builtin that cmd refers to
+ * @param cmd the command with arguments and redirects
+ * @param pShell the shell session
+ * @return the exit status of the builtin
+ */
+int BuiltinTable::runInShell(Builtin const &builtin, SimpleCommand *cmd, Shell *pShell) {
+    // Whatever the shell printed so far goes before the output of the builtin
+    std::cout.flush();
+
+    bool redirected = !cmd->getRedirects().empty();
+    int saved[3] = {-1, -1, -1};
+    std::vector<std::string> errors;
+
+    if (redirected) {
+        for (int fd = 0; fd < 3; fd++)
+            saved[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+        uint64_t start = Metrics::now();
+        cmd->applyRedirects(&errors);
+        Metrics::recordSince(Metrics::REDIRECT, start);
+    }
+
+    int status = errors.empty() ? invoke(builtin, cmd, pShell) : 1;
+
+    if (redirected) {
+        for (int fd = 0; fd < 3; fd++) {
+            if (saved[fd] != -1) {
+                dup2(saved[fd], fd);
+                close(saved[fd]);
+            }
+        }
+    }
+
+    for (const auto &error : errors) {
+        std::cerr << error << std::endl;
+    }
+
+    return status;
+}
+
+/**
+ * Run a builtin in a forked child, its redirects have been applied already
+ * @param builtin the builtin that cmd refers to
+ * @param cmd the command with arguments and redirects
+ * @param pShell the copy of the shell session of the child
+ * @return the exit status of the builtin
+ */
+int BuiltinTable::runInChild(Builtin const &builtin, SimpleCommand *cmd, Shell *pShell) {
+    pShell->setSubshell();
+
+    // cd is handled in the parent process since changing it in child will have no effect
+    // on the parent
+    if (builtin.shellOnly) {
+        std::cerr << "command " << cmd->getCommand() << " does not work inside a pipeline" << std::endl;
+        return 0;
+    }
+
+    return invoke(builtin, cmd, pShell);
+}
@@ -0,0 +1,58 @@
+#ifndef SHELL_BUILTINTABLE_H
+#define SHELL_BUILTINTABLE_H
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include "FdWriter.h"
+
+class Shell;
+class SimpleCommand;
+
+/**
+ * The commands the shell implements itself, by name.
+ *
+ * A builtin that is the only stage of a pipeline runs right inside the shell
+ * process: its redirects are applied to fds 0-2, which are restored afterwards,
+ * and no process is started at all. Inside a larger pipeline a builtin runs in
+ * a forked child like any other stage (see Launcher), writing to its pipe.
+ * Handlers write their output through an FdWriter on fd 1 and report errors on
+ * std::cerr, and they return an exit status.
+ *
+ * Builtins that change the state of the shell itself, like cd and fg, are
+ * marked shell-only: in a child they would only change a copy, so they refuse
+ * to run inside a pipeline.
+ */
+class BuiltinTable {
+public:
+    /**
+     * @param pShell the shell session
+     * @param argc the number of arguments, including the name of the builtin
+     * @param argv the NULL terminated arguments, as for a program
+     * @param out buffered stdout of the builtin
+     * @return the exit status
+     */
+    typedef std::function<int(Shell *pShell, int argc, char **argv, FdWriter &out)> Handler;
+
+    struct Builtin {
+        Handler handler;
+        bool shellOnly;    //< True if it only makes sense in the shell process.
+    };
+
+private:
+    std::unordered_map<std::string, Builtin> builtins;
+
+public:
+    BuiltinTable();
+
+    void add(std::string const &name, Handler const &handler, bool shellOnly);
+
+    const Builtin *find(std::string const &name) const;
+
+    int runInShell(Builtin const &builtin, SimpleCommand *cmd, Shell *pShell);
+
+    int runInChild(Builtin const &builtin, SimpleCommand *cmd, Shell *pShell);
+};
+
+
+#endif //SHELL_BUILTINTABLE_H
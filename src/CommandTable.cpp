@@ -0,0 +1,203 @@
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "CommandTable.h"
+
+// Everything that can make a name appear in, or disappear from, a directory
+static const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+                                   IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+CommandTable::CommandTable()
+        : relativePaths(false), inotifyFd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {
+    refresh();
+}
+
+/**
+ * Destructor.
+ */
+CommandTable::~CommandTable() {
+    if (inotifyFd != -1)
+        close(inotifyFd);
+}
+
+/**
+ * Find the command in either the paths or in a relative directory
+ * @param command the name the user typed
+ * @return if it exists the path to the command else empty string
+ */
+std::string CommandTable::lookup(std::string const &command) {
+    refresh();
+
+    // Anything with a slash depends on the current directory, don't remember it
+    if (inotifyFd == -1 || command.find('/') != std::string::npos)
+        return searchPath(command);
+
+    auto found = entries.find(command);
+    if (found != entries.end()) {
+        found->second.hits++;
+        return found->second.path;
+    }
+
+    std::string path = searchPath(command);
+    entries[command] = Entry{path, 1};
+    return path;
+}
+
+/**
+ * Forget everything, e.g. for 'hash -r'
+ */
+void CommandTable::reset() {
+    entries.clear();
+}
+
+/**
+ * Must be called after a cd, relative PATH entries now point somewhere else
+ */
+void CommandTable::directoryChanged() {
+    if (relativePaths)
+        watchPaths();
+}
+
+/**
+ * Print all remembered commands with their number of hits
+ * @param out stream to print to
+ */
+void CommandTable::print(std::ostream &out) const {
+    if (entries.empty()) {
+        out << "hash: hash table empty" << std::endl;
+        return;
+    }
+
+    out << "hits\tcommand" << std::endl;
+    for (const auto &entry : entries) {
+        out << entry.second.hits << "\t"
+            << (entry.second.path.empty() ? entry.first + " (not found)" : entry.second.path) << std::endl;
+    }
+}
+
+const std::vector<std::string> &CommandTable::getPaths() const {
+    return paths;
+}
+
+/**
+ * Take the PATH string and convert it to an array of strings
+ * @return array of strings containing paths
+ */
+std::vector<std::string> CommandTable::generatePathArray(std::string const &pathString) {
+    // Paths are seperated by :
+    const char delimiter = ':';
+    std::vector<std::string> result;
+    size_t previous = 0;
+    size_t index = pathString.find(delimiter);
+    while (index != std::string::npos) {
+        result.push_back(pathString.substr(previous, index - previous));
+        previous = index + 1;
+        index = pathString.find(delimiter, previous);
+    }
+    result.push_back(pathString.substr(previous));
+    return result;
+}
+
+/**
+ * Pick up a changed PATH and apply all pending directory events
+ */
+void CommandTable::refresh() {
+    const char *path = getenv("PATH");
+    std::string current = path == nullptr ? "" : path;
+
+    if (paths.empty() || current != pathString) {
+        pathString = current;
+        paths = generatePathArray(pathString);
+        relativePaths = false;
+        for (const auto &dir : paths) {
+            if (dir.empty() || dir[0] != '/')
+                relativePaths = true;
+        }
+        watchPaths();
+        return;
+    }
+
+    processEvents();
+}
+
+/**
+ * (Re)create the inotify watches for all PATH directories and drop the table
+ */
+void CommandTable::watchPaths() {
+    // Events of the old watches that are still queued are harmless,
+    // the table is empty anyway
+    entries.clear();
+
+    if (inotifyFd == -1)
+        return;
+
+    for (const auto &watch : watches)
+        inotify_rm_watch(inotifyFd, watch.first);
+    watches.clear();
+
+    for (const auto &dir : paths) {
+        // A directory that doesn't exist yet can't be watched. Should it be created
+        // later its commands are only found after 'hash -r'.
+        int wd = inotify_add_watch(inotifyFd, dir.empty() ? "." : dir.c_str(), WATCH_MASK);
+        if (wd != -1)
+            watches[wd] = dir;
+    }
+}
+
+/**
+ * Read all queued inotify events without blocking and drop the entries they affect
+ */
+void CommandTable::processEvents() {
+    alignas(struct inotify_event) char buffer[4096];
+    bool rewatch = false;
+
+    while (true) {
+        ssize_t len = read(inotifyFd, buffer, sizeof(buffer));
+        if (len <= 0)
+            break;
+
+        for (char *p = buffer; p < buffer + len;) {
+            auto *event = reinterpret_cast<struct inotify_event *>(p);
+
+            if (!(event->mask & IN_Q_OVERFLOW) && watches.find(event->wd) == watches.end()) {
+                // Left over from a watch we removed ourselves
+            } else if (event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                // We lost track, start over
+                rewatch = true;
+            } else if (event->len > 0) {
+                entries.erase(event->name);
+            }
+
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    if (rewatch)
+        watchPaths();
+}
+
+/**
+ * Scan all PATH directories for the command
+ * @param command the name the user typed
+ * @return if it exists the path to the command else empty string
+ */
+std::string CommandTable::searchPath(std::string const &command) const {
+    // First try to find the command in PATH
+    for (auto temp : paths) {
+
+        temp = temp.append("/").append(command);
+        // On success zero is returned.  On error , -1 is returned and errno is set appropriately.
+        if (access(temp.c_str(), F_OK) == 0) {
+            return temp;
+        }
+
+    }
+
+    // command started with ./ check if it exists
+    if (command.find("./") == 0 && access(command.c_str(), F_OK) == 0) {
+        // return the relative command
+        return command;
+    }
+
+    return "";
+}
@@ -0,0 +1,65 @@
+#ifndef SHELL_COMMANDTABLE_H
+#define SHELL_COMMANDTABLE_H
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Remembers where the commands in $PATH live, like the hash table of other shells.
+ *
+ * Lookups fill the table lazily. Commands that could not be found are remembered
+ * too, so a typo does not cost a scan of every PATH directory each time.
+ * Every PATH directory is watched with inotify. Before each lookup the pending
+ * events are drained and the entries for the names that were created, removed
+ * or renamed are dropped, so the table never hands out a stale answer.
+ * When inotify is not available nothing is cached and every lookup scans PATH.
+ */
+class CommandTable {
+private:
+    struct Entry {
+        std::string path;   //< Full path of the command, empty if it was not found.
+        unsigned long hits; //< Number of times this entry answered a lookup.
+    };
+
+    std::string pathString;
+    std::vector<std::string> paths;
+    bool relativePaths;                     //< True if PATH holds entries relative to the cwd.
+    std::unordered_map<std::string, Entry> entries;
+    int inotifyFd;
+    std::unordered_map<int, std::string> watches; //< inotify watch descriptor -> directory
+
+public:
+    CommandTable();
+
+    ~CommandTable();
+
+    CommandTable(CommandTable const &) = delete;
+
+    CommandTable &operator=(CommandTable const &) = delete;
+
+    std::string lookup(std::string const &command);
+
+    void reset();
+
+    void directoryChanged();
+
+    void print(std::ostream &out) const;
+
+    const std::vector<std::string> &getPaths() const;
+
+    static std::vector<std::string> generatePathArray(std::string const &pathString);
+
+private:
+    void refresh();
+
+    void watchPaths();
+
+    void processEvents();
+
+    std::string searchPath(std::string const &command) const;
+};
+
+
+#endif //SHELL_COMMANDTABLE_H
@@ -1,3 +1,4 @@
+#include <cstring>
 #include "CommandVisitor.h"
 #include "Sequence.h"
 #include "Pipeline.h"
@@ -10,69 +11,107 @@
 #define LOG(...) do { } while(false)
 #endif
 
-antlrcpp::Any CommandVisitor::visitSequence(ShellGrammarParser::SequenceContext *ctx) {
+/**
+ * Count the children of a node that are of the given type
+ */
+template<typename T>
+static size_t countChildren(antlr4::ParserRuleContext *ctx) {
+    size_t count = 0;
+    for (antlr4::tree::ParseTree *child : ctx->children) {
+        if (dynamic_cast<T *>(child) != nullptr)
+            count++;
+    }
+    return count;
+}
+
+Sequence *CommandVisitor::visitSequence(ShellGrammarParser::SequenceContext *ctx) {
     LOG("Visiting sequence\n");
     Sequence *sequence = new Sequence();
+    arena = &sequence->getArena();
 
     // Walk through the list of pipelines
-    size_t numberOfPipelines = ctx->pipeline().size();
-    LOG("  Visiting %zu pipelines\n", numberOfPipelines);
-    for (size_t i = 0; i < numberOfPipelines; i++) {
-        Pipeline *pipeline = visit(ctx->pipeline(i));
+    ArenaArray<Pipeline> pipelines(arena, countChildren<ShellGrammarParser::PipelineContext>(ctx));
+    LOG("  Visiting %zu pipelines\n", pipelines.size());
+    const std::vector<antlr4::tree::ParseTree *> &children = ctx->children;
+    size_t i = 0;
+    for (size_t c = 0; c < children.size(); c++) {
+        auto *pipelineCtx = dynamic_cast<ShellGrammarParser::PipelineContext *>(children[c]);
+        if (pipelineCtx == nullptr)
+            continue;
+        Pipeline &pipeline = pipelines[i];
+        pipeline = visitPipeline(pipelineCtx);
 
         // Check if pipeline must be executed asynchronously
-        if (ctx->seqDelim(i)) {
+        antlr4::tree::ParseTree *next = c + 1 < children.size() ? children[c + 1] : nullptr;
+        auto *delim = dynamic_cast<ShellGrammarParser::SeqDelimContext *>(next);
+        auto *terminal = dynamic_cast<antlr4::tree::TerminalNode *>(next);
+        if (delim != nullptr) {
             // There is another pipeline to the right from us.
             // Could be delimited using ';' or '&'
-            if (ctx->seqDelim(i)->AMPERSAND())
-                pipeline->setAsync(true);
-        } else if (ctx->lastAmpersand != nullptr) {
+            if (delim->AMPERSAND())
+                pipeline.setAsync(true);
+        } else if (terminal != nullptr && terminal->getSymbol() == ctx->lastAmpersand) {
             // If this is the last pipeline, check if user appended a '&'
-            pipeline->setAsync(true);
+            pipeline.setAsync(true);
         }
 
-        LOG("    Pipeline %zu -> %s\n", i, pipeline->isAsync() ? "async" : "wait");
-        sequence->addPipeline(pipeline);
+        LOG("    Pipeline %zu -> %s\n", i, pipeline.isAsync() ? "async" : "wait");
+        i++;
     }
+    sequence->setPipelines(pipelines);
 
     LOG("Done\n");
+    arena = nullptr;
     return sequence;
 }
 
-antlrcpp::Any CommandVisitor::visitPipeline(ShellGrammarParser::PipelineContext *ctx) {
+Pipeline CommandVisitor::visitPipeline(ShellGrammarParser::PipelineContext *ctx) {
     LOG("     Visiting pipeline\n");
-    Pipeline *pipeline = new Pipeline();
-
-    size_t n = ctx->simpleCommand().size();
-    LOG("     Pipeline has %zu commands\n", n);
-    for (size_t i = 0; i < n; i++) {
-        SimpleCommand *cmd = visit(ctx->simpleCommand(i));
-        pipeline->addCommand(cmd);
+    ArenaArray<SimpleCommand> commands(arena, countChildren<ShellGrammarParser::SimpleCommandContext>(ctx));
+
+    LOG("     Pipeline has %zu commands\n", commands.size());
+    size_t i = 0;
+    for (antlr4::tree::ParseTree *child : ctx->children) {
+        auto *commandCtx = dynamic_cast<ShellGrammarParser::SimpleCommandContext *>(child);
+        if (commandCtx != nullptr)
+            commands[i++] = visitSimpleCommand(commandCtx);
     }
 
-    return pipeline;
+    return Pipeline(commands);
 }
 
-antlrcpp::Any CommandVisitor::visitSimpleCommand(ShellGrammarParser::SimpleCommandContext *ctx) {
-    std::string program = visit(ctx->string(0));
-    SimpleCommand *cmd = new SimpleCommand(program);
-    LOG("       Program: %s\n", program.c_str());
-
-    // Gather arguments
-    size_t n = ctx->string().size();
-    for (size_t i = 1; i < n; i++) {
-        std::string arg = visit(ctx->string(i));
-        LOG("         Arg %zu: %s\n", i, arg.c_str());
-        cmd->addArgument(arg);
-    }
+SimpleCommand CommandVisitor::visitSimpleCommand(ShellGrammarParser::SimpleCommandContext *ctx) {
+    // Every child is either a word or a redirect
+    size_t words = countChildren<ShellGrammarParser::StringContext>(ctx);
+    char **argv = static_cast<char **>(arena->allocate((words + 1) * sizeof(char *), alignof(char *)));
+    ArenaArray<IORedirect> redirects(arena, ctx->children.size() - words);
+    size_t argc = 0;
+    size_t r = 0;
+
+    for (antlr4::tree::ParseTree *child : ctx->children) {
+        auto *stringCtx = dynamic_cast<ShellGrammarParser::StringContext *>(child);
+        if (stringCtx != nullptr) {
+            char *word = visitString(stringCtx);
+            if (argc == 0) {
+                LOG("       Program: %s\n", word);
+            } else {
+                // Gather arguments, ~ represents user home
+                if (strcmp(word, "~") == 0 && !home.empty())
+                    word = arena->copy(home.data(), home.size());
+                LOG("         Arg %zu: %s\n", argc, word);
+            }
+            argv[argc++] = word;
+            continue;
+        }
 
-    // Add IO redirection
-    n = ctx->ioRedirect().size();
-    for (size_t i = 0; i < n; i++) {
-        ShellGrammarParser::IoRedirectContext *ioRedir = ctx->ioRedirect(i);
+        // Add IO redirection
+        auto *ioRedir = dynamic_cast<ShellGrammarParser::IoRedirectContext *>(child);
+        if (ioRedir == nullptr)
+            continue;
 
         // Find out the type
-        std::string redir = ioRedir->REDIRECT() ? ioRedir->REDIRECT()->getText() : ioRedir->REDIRECTFD()->getText();
+        auto *operatorNode = static_cast<antlr4::tree::TerminalNode *>(ioRedir->children[0]);
+        std::string redir = operatorNode->getSymbol()->getText();
         size_t redirChar = std::isdigit(redir[0]) ? 1 : 0;   // is there a number before >, >> or < ?
         IORedirect::Type redirType = redir[redirChar] == '<' ? IORedirect::INPUT : IORedirect::OUTPUT;
         if (redir.size() > redirChar + 1) {
@@ -89,34 +128,40 @@ antlrcpp::Any CommandVisitor::visitSimpleCommand(ShellGrammarParser::SimpleComma
             fd = redir[0] - '0';
         }
 
-        // Get the target
-        std::string outFile;
-        if (ioRedir->REDIRECT()) {
-            std::string s = visit(ioRedir->string());
-            outFile = s;
+        // Get the target, e.g. ~/Documents/input.txt is relative to the home path
+        char *outFile;
+        if (operatorNode->getSymbol()->getType() == ShellGrammarParser::REDIRECT) {
+            outFile = visitString(static_cast<ShellGrammarParser::StringContext *>(ioRedir->children[1]));
+            if (outFile[0] == '~') {
+                std::string path = home + (outFile + 1);
+                outFile = arena->copy(path.data(), path.size());
+            }
         } else {
-            std::string r = ioRedir->REDIRECTFD()->getText();
-            size_t ampersandChar = r.find('&');
-            outFile = r.substr(ampersandChar, r.size() - ampersandChar);
+            size_t ampersandChar = redir.find('&');
+            outFile = arena->copy(redir.data() + ampersandChar, redir.size() - ampersandChar);
         }
 
-        // Add redirect to command
-        cmd->addIORedirect(fd, redirType, outFile);
-
         // Log
         LOG("       Redir %d %s %s\n", fd,
             redirType == IORedirect::INPUT ? "<" : redirType == IORedirect::OUTPUT ? ">" : ">>",
-            outFile.c_str()
+            outFile
         );
+
+        // Add redirect to command
+        redirects[r++] = IORedirect(fd, redirType, outFile);
     }
 
-    return cmd;
+    argv[argc] = nullptr;
+    return SimpleCommand(argv, argc, redirects);
 }
 
-antlrcpp::Any CommandVisitor::visitString(ShellGrammarParser::StringContext *ctx) {
-    if (ctx->STRING())
-        return ctx->STRING()->getText();
-
-    std::string str = ctx->QUOTEDSTRING()->getText();
-    return str.substr(1, str.size() - 2);
+/**
+ * Copy the text of a word into the arena, without the quotes of a quoted string
+ */
+char *CommandVisitor::visitString(ShellGrammarParser::StringContext *ctx) {
+    antlr4::Token *token = static_cast<antlr4::tree::TerminalNode *>(ctx->children[0])->getSymbol();
+    std::string text = token->getText();
+    if (token->getType() == ShellGrammarParser::QUOTEDSTRING)
+        return arena->copy(text.data() + 1, text.size() - 2);
+    return arena->copy(text.data(), text.size());
 }
@@ -1,23 +1,46 @@
 #ifndef SHELL_COMMANDVISITOR_H
 #define SHELL_COMMANDVISITOR_H
 
-#include "../gen/ShellGrammarBaseVisitor.h"
+#include <string>
+#include "../gen/ShellGrammarParser.h"
+#include "Arena.h"
+#include "Pipeline.h"
+#include "Sequence.h"
+#include "SimpleCommand.h"
 
 /**
  * Visitor class that walks through the whole parse tree and creates objects
  * for the parsed command.
  * Visiting a parse tree will yield a Sequence-pointer that contains all
  * pipelines, which in turn will contain the simple commands.
+ *
+ * Unlike the generated ShellGrammarBaseVisitor, every visit method returns its
+ * own type instead of an antlrcpp::Any, which would allocate a box for every
+ * result and dynamic_cast it on the way out. The children of a node are
+ * walked once, in order, rather than through the generated accessors, which
+ * build a new vector on every call.
+ *
+ * Everything is allocated in the arena of the new Sequence, with the number of
+ * pipelines, commands, words and redirects taken from the parse tree up front.
+ * A "~" argument and a leading "~" of a redirect target are replaced by the
+ * home directory right away, so commands can be started as they are.
  */
-class CommandVisitor : public ShellGrammarBaseVisitor {
+class CommandVisitor {
+private:
+    std::string home;
+    Arena *arena;       //< The arena of the Sequence that is being built.
+
 public:
-    antlrcpp::Any visitSequence(ShellGrammarParser::SequenceContext *ctx) override;
+    explicit CommandVisitor(std::string const &homeDirectory)
+            : home(homeDirectory), arena(nullptr) {}
+
+    Sequence *visitSequence(ShellGrammarParser::SequenceContext *ctx);
 
-    antlrcpp::Any visitPipeline(ShellGrammarParser::PipelineContext *ctx) override;
+    Pipeline visitPipeline(ShellGrammarParser::PipelineContext *ctx);
 
-    antlrcpp::Any visitSimpleCommand(ShellGrammarParser::SimpleCommandContext *ctx) override;
+    SimpleCommand visitSimpleCommand(ShellGrammarParser::SimpleCommandContext *ctx);
 
-    antlrcpp::Any visitString(ShellGrammarParser::StringContext *ctx) override;
+    char *visitString(ShellGrammarParser::StringContext *ctx);
 };
 
 
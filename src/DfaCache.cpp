@@ -0,0 +1,474 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <CommonTokenStream.h>
+#include <atn/ATNConfig.h>
+#include <atn/ATNConfigSet.h>
+#include <atn/ATNSerializer.h>
+#include <atn/ArrayPredictionContext.h>
+#include <atn/ParserATNSimulator.h>
+#include <atn/SemanticContext.h>
+#include <atn/SingletonPredictionContext.h>
+#include "../gen/ShellGrammarParser.h"
+#include "DfaCache.h"
+#include "ShellLexer.h"
+
+using antlr4::atn::ATN;
+using antlr4::atn::ATNConfig;
+using antlr4::atn::ATNConfigSet;
+using antlr4::atn::PredictionContext;
+using antlr4::dfa::DFA;
+using antlr4::dfa::DFAState;
+
+/*
+ * The file is a Header followed by 32 bit words:
+ *  - the prediction contexts, parents before the contexts that refer to them:
+ *      parent count, then parent and return state for each parent
+ *    context 0 is PredictionContext::EMPTY and not in the file
+ *  - for every decision with states:
+ *      decision, state count, index of s0
+ *      every state: flags, prediction, the config set, edge count and edges
+ *      config set: full context, unique alt, dips into outer context, conflicting
+ *          alt count and alts, config count and configs
+ *      config: ATN state, alt, context, reaches into outer context
+ *      edge: symbol, index of the target state
+ * States are numbered in the order of the file, starting over in every decision.
+ */
+static const char MAGIC[8] = {'S', 'H', 'D', 'F', 'A', '0', '1', '\n'};
+static const uint32_t NONE = 0xFFFFFFFF;              //< No parent, or the EOF symbol.
+static const uint32_t ERROR_STATE = 0xFFFFFFFE;       //< Edge to ATNSimulator::ERROR.
+static const uint32_t ACCEPT = 1;
+static const uint32_t FULL_CONTEXT = 2;
+
+struct Header {
+    char magic[8];
+    uint64_t atnHash;
+    uint32_t contextCount;
+    uint32_t decisionCount;
+    uint64_t words;
+    uint64_t checksum;         //< Of the words, a damaged DFA could make prediction loop.
+};
+
+std::string DfaCache::path;
+std::vector<DFA> *DfaCache::decisionToDFA = nullptr;
+const ATN *DfaCache::atn = nullptr;
+pid_t DfaCache::owner = 0;
+size_t DfaCache::loadedStates = 0;
+
+/**
+ * Load the cache named by SHELL_DFA_CACHE and write it back when the shell exits
+ */
+void DfaCache::configureFromEnvironment() {
+    const char *value = getenv("SHELL_DFA_CACHE");
+    path = value != nullptr ? value : "/var/tmp/shell-dfa." + std::to_string(getuid()) + ".cache";
+    if (path.empty())
+        return;
+
+    // The DFA and the ATN are statics of the generated parser, shared by all of its instances
+    ShellLexer lexer;
+    antlr4::CommonTokenStream tokens(&lexer);
+    ShellGrammarParser parser(&tokens);
+    decisionToDFA = &parser.getInterpreter<antlr4::atn::ParserATNSimulator>()->decisionToDFA;
+    atn = &parser.getATN();
+
+    // A missing, stale or damaged cache is simply built again
+    std::string error;
+    load(path, *atn, *decisionToDFA, &error);
+    loadedStates = countStates(*decisionToDFA);
+
+    owner = getpid();
+    atexit(saveAtExit);
+}
+
+void DfaCache::saveAtExit() {
+    if (getpid() != owner || countStates(*decisionToDFA) <= loadedStates)
+        return;
+    std::string error;
+    if (!save(path, *atn, *decisionToDFA, &error))
+        std::cerr << "SHELL_DFA_CACHE: " << error << std::endl;
+}
+
+/**
+ * @return the number of DFA states of all decisions
+ */
+size_t DfaCache::countStates(std::vector<DFA> const &decisionToDFA) {
+    size_t count = 0;
+    for (const DFA &dfa : decisionToDFA)
+        count += dfa.states.size();
+    return count;
+}
+
+/**
+ * FNV-1a of the low 32 bits of each value
+ */
+template<typename Value>
+static uint64_t hashWords(const Value *values, size_t count, uint64_t hash = 14695981039346656037ull) {
+    for (size_t v = 0; v < count; v++) {
+        for (int i = 0; i < 4; i++) {
+            hash ^= (values[v] >> (8 * i)) & 0xFF;
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+/**
+ * @return a hash of the serialized ATN, which changes with the grammar
+ */
+uint64_t DfaCache::hashATN(ATN const &atn) {
+    std::vector<size_t> serialized = antlr4::atn::ATNSerializer::getSerialized(const_cast<ATN *>(&atn));
+    return hashWords(serialized.data(), serialized.size());
+}
+
+/**
+ * Writes the contexts of the configs into their own table as they are met
+ */
+class ContextWriter {
+private:
+    std::unordered_map<const PredictionContext *, uint32_t> indexes;
+
+public:
+    std::vector<uint32_t> words;
+    uint32_t count = 1;
+
+    /**
+     * @return the index of the context, NONE for null
+     */
+    uint32_t add(Ref<PredictionContext> const &context) {
+        if (context == nullptr)
+            return NONE;
+        if (context->isEmpty())
+            return 0;
+        auto found = indexes.find(context.get());
+        if (found != indexes.end())
+            return found->second;
+
+        std::vector<uint32_t> entry;
+        entry.push_back(static_cast<uint32_t>(context->size()));
+        for (size_t i = 0; i < context->size(); i++) {
+            entry.push_back(add(context->getParent(i)));
+            size_t returnState = context->getReturnState(i);
+            entry.push_back(returnState == PredictionContext::EMPTY_RETURN_STATE
+                            ? NONE : static_cast<uint32_t>(returnState));
+        }
+        words.insert(words.end(), entry.begin(), entry.end());
+        indexes[context.get()] = count;
+        return count++;
+    }
+};
+
+/**
+ * @return false if the state needs something the file doesn't hold
+ */
+static bool isCacheable(DFAState const *state) {
+    if (!state->predicates.empty() || state->configs == nullptr || state->configs->hasSemanticContext)
+        return false;
+    for (auto const &config : state->configs->configs) {
+        if (config->semanticContext != antlr4::atn::SemanticContext::NONE)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Write the DFA to a new file that then replaces the given one
+ * @param file where to write it
+ * @param atn the ATN of the parser
+ * @param decisionToDFA the DFA of the parser
+ * @param pError receives the reason if it can't be written
+ * @return false on errors
+ */
+bool DfaCache::save(std::string const &file, ATN const &atn, std::vector<DFA> const &decisionToDFA,
+                    std::string *pError) {
+    ContextWriter contexts;
+    std::vector<uint32_t> words;
+    uint32_t decisionCount = 0;
+
+    for (const DFA &dfa : decisionToDFA) {
+        if (dfa.isPrecedenceDfa() || dfa.s0 == nullptr)
+            continue;
+        std::vector<DFAState *> states(dfa.states.begin(), dfa.states.end());
+        std::unordered_map<const DFAState *, uint32_t> indexes;
+        bool cacheable = true;
+        for (DFAState *state : states) {
+            cacheable = cacheable && isCacheable(state);
+            indexes.emplace(state, static_cast<uint32_t>(indexes.size()));
+        }
+        auto s0 = indexes.find(dfa.s0);
+        if (!cacheable || s0 == indexes.end())
+            continue;
+
+        words.push_back(static_cast<uint32_t>(dfa.decision));
+        words.push_back(static_cast<uint32_t>(states.size()));
+        words.push_back(s0->second);
+        for (DFAState *state : states) {
+            ATNConfigSet const &configs = *state->configs;
+            words.push_back((state->isAcceptState ? ACCEPT : 0) | (state->requiresFullContext ? FULL_CONTEXT : 0));
+            words.push_back(static_cast<uint32_t>(state->prediction));
+
+            words.push_back(configs.fullCtx ? 1 : 0);
+            words.push_back(static_cast<uint32_t>(configs.uniqueAlt));
+            words.push_back(configs.dipsIntoOuterContext ? 1 : 0);
+            words.push_back(static_cast<uint32_t>(configs.conflictingAlts.count()));
+            for (size_t alt = 0; alt < configs.conflictingAlts.size(); alt++) {
+                if (configs.conflictingAlts.test(alt))
+                    words.push_back(static_cast<uint32_t>(alt));
+            }
+            words.push_back(static_cast<uint32_t>(configs.configs.size()));
+            for (auto const &config : configs.configs) {
+                words.push_back(static_cast<uint32_t>(config->state->stateNumber));
+                words.push_back(static_cast<uint32_t>(config->alt));
+                words.push_back(contexts.add(config->context));
+                words.push_back(static_cast<uint32_t>(config->reachesIntoOuterContext));
+            }
+
+            // An edge to a state that is not in the DFA (yet) is left out, it
+            // would read as a syntax error
+            std::vector<uint32_t> edges;
+            state->edges.forEach([&](size_t symbol, antlr4::dfa::DFAState *to) {
+                uint32_t target = ERROR_STATE;
+                if (to != antlr4::atn::ATNSimulator::ERROR.get()) {
+                    auto found = indexes.find(to);
+                    if (found == indexes.end())
+                        return;
+                    target = found->second;
+                }
+                edges.push_back(symbol == antlr4::Token::EOF ? NONE : static_cast<uint32_t>(symbol));
+                edges.push_back(target);
+            });
+            words.push_back(static_cast<uint32_t>(edges.size() / 2));
+            words.insert(words.end(), edges.begin(), edges.end());
+        }
+        decisionCount++;
+    }
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.atnHash = hashATN(atn);
+    header.contextCount = contexts.count;
+    header.decisionCount = decisionCount;
+    header.words = contexts.words.size() + words.size();
+    header.checksum = hashWords(words.data(), words.size(), hashWords(contexts.words.data(), contexts.words.size()));
+
+    // A new file with a name nobody can guess, /var/tmp is writable for everyone
+    std::string temporary = file + ".XXXXXX";
+    int fd = mkostemp(&temporary[0], O_CLOEXEC);
+    if (fd == -1) {
+        *pError = temporary + ": " + strerror(errno);
+        return false;
+    }
+    bool written = write(fd, &header, sizeof(header)) == sizeof(header);
+    for (const std::vector<uint32_t> *part : {&contexts.words, &words}) {
+        size_t bytes = part->size() * sizeof(uint32_t);
+        written = written && write(fd, part->data(), bytes) == static_cast<ssize_t>(bytes);
+    }
+    written = close(fd) == 0 && written;
+    if (!written || rename(temporary.c_str(), file.c_str()) != 0) {
+        *pError = file + ": " + strerror(errno);
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Reads the words of the file, checking every one against its end
+ */
+class WordReader {
+private:
+    const uint32_t *next;
+    const uint32_t *end;
+
+public:
+    bool failed = false;
+
+    WordReader(const uint32_t *words, size_t count) : next(words), end(words + count) {}
+
+    uint32_t read() {
+        if (next == end) {
+            failed = true;
+            return 0;
+        }
+        return *next++;
+    }
+
+    /**
+     * @return the next word if it is below the limit, else 0 and failed is set
+     */
+    uint32_t readBelow(size_t limit) {
+        uint32_t value = read();
+        if (value >= limit) {
+            failed = true;
+            return 0;
+        }
+        return value;
+    }
+};
+
+/**
+ * Fill the empty decisions of the DFA from the file
+ * @param file the cache
+ * @param atn the ATN of the parser, the file is rejected if it was made for another
+ * @param decisionToDFA the DFA of the parser
+ * @param pError receives the reason if nothing was loaded
+ * @return false if the file can't be used
+ */
+bool DfaCache::load(std::string const &file, ATN const &atn, std::vector<DFA> &decisionToDFA,
+                    std::string *pError) {
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        *pError = file + ": " + strerror(errno);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(Header) || info.st_uid != getuid()) {
+        *pError = file + ": not a DFA cache of this user";
+        close(fd);
+        return false;
+    }
+    size_t bytes = static_cast<size_t>(info.st_size);
+    void *memory = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        *pError = file + ": " + strerror(errno);
+        return false;
+    }
+
+    Header header;
+    memcpy(&header, memory, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.words != (bytes - sizeof(Header)) / sizeof(uint32_t)) {
+        *pError = file + ": not a DFA cache";
+        munmap(memory, bytes);
+        return false;
+    }
+    if (header.atnHash != hashATN(atn)) {
+        *pError = file + ": made for another grammar";
+        munmap(memory, bytes);
+        return false;
+    }
+
+    auto *words = reinterpret_cast<const uint32_t *>(static_cast<const char *>(memory) + sizeof(Header));
+    if (header.checksum != hashWords(words, static_cast<size_t>(header.words))) {
+        *pError = file + ": damaged";
+        munmap(memory, bytes);
+        return false;
+    }
+    WordReader in(words, static_cast<size_t>(header.words));
+
+    std::vector<Ref<PredictionContext>> contexts;
+    contexts.push_back(PredictionContext::EMPTY);
+    while (contexts.size() < header.contextCount && !in.failed) {
+        uint32_t size = in.read();
+        if (size == 0 || size > header.words) {
+            in.failed = true;
+            break;
+        }
+        std::vector<Ref<PredictionContext>> parents;
+        std::vector<size_t> returnStates;
+        for (uint32_t i = 0; i < size && !in.failed; i++) {
+            uint32_t parent = in.read();
+            uint32_t returnState = in.read();
+            if (parent != NONE && parent >= contexts.size())
+                in.failed = true;
+            parents.push_back(parent == NONE || in.failed ? nullptr : contexts[parent]);
+            returnStates.push_back(returnState == NONE ? PredictionContext::EMPTY_RETURN_STATE : returnState);
+        }
+        if (in.failed)
+            break;
+        if (size == 1)
+            contexts.push_back(antlr4::atn::SingletonPredictionContext::create(parents[0], returnStates[0]));
+        else
+            contexts.push_back(std::make_shared<antlr4::atn::ArrayPredictionContext>(parents, returnStates));
+    }
+
+    // States are only put into the DFA once the whole file has been read
+    struct Loaded {
+        DFA *dfa;
+        std::vector<DFAState *> states;
+        uint32_t s0;
+    };
+    std::vector<Loaded> loaded;
+    for (uint32_t d = 0; d < header.decisionCount && !in.failed; d++) {
+        uint32_t decision = in.readBelow(decisionToDFA.size());
+        uint32_t count = in.readBelow(header.words);
+        uint32_t s0 = in.readBelow(count);
+        if (in.failed)
+            break;
+        loaded.push_back(Loaded{&decisionToDFA[decision], std::vector<DFAState *>(), s0});
+        std::vector<DFAState *> &states = loaded.back().states;
+        for (uint32_t i = 0; i < count; i++)
+            states.push_back(new DFAState());
+
+        for (uint32_t i = 0; i < count && !in.failed; i++) {
+            DFAState *state = states[i];
+            state->stateNumber = static_cast<int>(i);
+            uint32_t flags = in.read();
+            state->isAcceptState = (flags & ACCEPT) != 0;
+            state->requiresFullContext = (flags & FULL_CONTEXT) != 0;
+            state->prediction = in.read();
+
+            state->configs.reset(new ATNConfigSet(in.read() != 0));
+            ATNConfigSet &configs = *state->configs;
+            configs.uniqueAlt = in.read();
+            configs.dipsIntoOuterContext = in.read() != 0;
+            for (uint32_t n = in.readBelow(configs.conflictingAlts.size() + 1); n > 0 && !in.failed; n--)
+                configs.conflictingAlts.set(in.readBelow(configs.conflictingAlts.size()));
+            for (uint32_t n = in.readBelow(header.words); n > 0 && !in.failed; n--) {
+                uint32_t atnState = in.readBelow(atn.states.size());
+                uint32_t alt = in.read();
+                uint32_t context = in.readBelow(contexts.size());
+                uint32_t reaches = in.read();
+                if (in.failed || atn.states[atnState] == nullptr) {
+                    in.failed = true;
+                    break;
+                }
+                auto config = std::make_shared<ATNConfig>(atn.states[atnState], alt, contexts[context]);
+                config->reachesIntoOuterContext = reaches;
+                configs.configs.push_back(config);
+            }
+            configs.setReadonly(true);
+
+            for (uint32_t n = in.readBelow(header.words); n > 0 && !in.failed; n--) {
+                uint32_t symbol = in.read();
+                uint32_t target = in.read();
+                if (target != ERROR_STATE && target >= states.size()) {
+                    in.failed = true;
+                    break;
+                }
+                state->edges.set(symbol == NONE ? antlr4::Token::EOF : symbol,
+                                 target == ERROR_STATE ? antlr4::atn::ATNSimulator::ERROR.get() : states[target],
+                                 atn.maxTokenType + 1);
+            }
+        }
+    }
+    munmap(memory, bytes);
+
+    if (in.failed) {
+        for (Loaded &decision : loaded) {
+            for (DFAState *state : decision.states)
+                delete state;
+        }
+        *pError = file + ": damaged";
+        return false;
+    }
+
+    for (Loaded &decision : loaded) {
+        DFA &dfa = *decision.dfa;
+        if (dfa.s0 != nullptr || !dfa.states.empty() || dfa.isPrecedenceDfa()) {
+            for (DFAState *state : decision.states)
+                delete state;
+            continue;
+        }
+        for (DFAState *state : decision.states)
+            dfa.states.insert(state);
+        dfa.s0 = decision.states[decision.s0];
+    }
+    return true;
+}
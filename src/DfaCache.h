@@ -0,0 +1,61 @@
+#ifndef SHELL_DFACACHE_H
+#define SHELL_DFACACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <atn/ATN.h>
+#include <dfa/DFA.h>
+
+/**
+ * Keeps the DFA of the parser from one shell process to the next.
+ *
+ * ANTLR builds the DFA of every decision while it parses. The generated parser
+ * keeps it in a static, so it starts out empty in every process and the first
+ * lines of a session (and every line of a short 'shell -c') pay for the full
+ * ATN simulation. The DFA is written to a file when the shell exits and read
+ * back through mmap when the next one starts, so prediction is warm right away.
+ *
+ * The file holds every DFA state with its edges, the accept state data and the
+ * ATN configurations that prediction continues from when a state lacks an edge,
+ * including their prediction contexts. It starts with a hash of the serialized
+ * ATN of the parser and is ignored when that does not match, i.e. after the
+ * grammar has changed. Decisions with semantic predicates or precedence are
+ * not written, ShellGrammar has none.
+ * The words after the header have a checksum, and the file must belong to the
+ * user: a DFA that doesn't fit the ATN can make prediction loop forever.
+ * The file is SHELL_DFA_CACHE, /var/tmp/shell-dfa.<uid>.cache if that is not
+ * set; an empty value turns the cache off. It is only written when the DFA has
+ * grown, into a new file that replaces the old one.
+ *
+ * ShellLexer does not use the DFA of the generated lexer, so only the parser
+ * has one worth keeping.
+ */
+class DfaCache {
+private:
+    static std::string path;
+    static std::vector<antlr4::dfa::DFA> *decisionToDFA;   //< The DFA of ShellGrammarParser.
+    static const antlr4::atn::ATN *atn;
+    static pid_t owner;            //< Forked children don't write the cache.
+    static size_t loadedStates;
+
+public:
+    static void configureFromEnvironment();
+
+    static bool load(std::string const &file, antlr4::atn::ATN const &atn,
+                     std::vector<antlr4::dfa::DFA> &decisionToDFA, std::string *pError);
+
+    static bool save(std::string const &file, antlr4::atn::ATN const &atn,
+                     std::vector<antlr4::dfa::DFA> const &decisionToDFA, std::string *pError);
+
+    static size_t countStates(std::vector<antlr4::dfa::DFA> const &decisionToDFA);
+
+    static uint64_t hashATN(antlr4::atn::ATN const &atn);
+
+private:
+    static void saveAtExit();
+};
+
+
+#endif //SHELL_DFACACHE_H
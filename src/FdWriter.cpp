@@ -0,0 +1,77 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include "FdWriter.h"
+
+/**
+ * Append data to the buffer, writing the buffer out when it is full.
+ * Blocks larger than the buffer skip it.
+ * @param data the bytes to write
+ * @param size the number of bytes
+ * @return this writer
+ */
+FdWriter &FdWriter::write(const char *data, size_t size) {
+    if (used + size > sizeof(buffer)) {
+        flush();
+        if (size >= sizeof(buffer)) {
+            writeAll(data, size);
+            return *this;
+        }
+    }
+
+    memcpy(buffer + used, data, size);
+    used += size;
+    return *this;
+}
+
+FdWriter &FdWriter::operator<<(const char *s) {
+    return write(s, strlen(s));
+}
+
+FdWriter &FdWriter::operator<<(char c) {
+    if (used == sizeof(buffer))
+        flush();
+    buffer[used++] = c;
+    return *this;
+}
+
+FdWriter &FdWriter::operator<<(long value) {
+    char digits[24];
+    int n = snprintf(digits, sizeof(digits), "%ld", value);
+    return write(digits, static_cast<size_t>(n));
+}
+
+FdWriter &FdWriter::operator<<(unsigned long value) {
+    char digits[24];
+    int n = snprintf(digits, sizeof(digits), "%lu", value);
+    return write(digits, static_cast<size_t>(n));
+}
+
+/**
+ * Write out everything that is buffered
+ * @return false if this or an earlier write failed
+ */
+bool FdWriter::flush() {
+    if (used > 0) {
+        writeAll(buffer, used);
+        used = 0;
+    }
+    return !failed;
+}
+
+bool FdWriter::writeAll(const char *data, size_t size) {
+    // Once the reader is gone there is no point in trying again
+    while (size > 0 && !failed) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            failed = true;
+        } else {
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+    return !failed;
+}
@@ -0,0 +1,56 @@
+#ifndef SHELL_FDWRITER_H
+#define SHELL_FDWRITER_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Buffered output straight to a file descriptor, for builtins.
+ *
+ * Unlike std::cout it does not care which stream object the descriptor was
+ * once opened for: a builtin that runs inside the shell writes to whatever
+ * fd 1 is after its redirects have been applied, and a builtin that runs in a
+ * pipeline writes to the pipe. Everything is written with a single write()
+ * per 4 KiB, and flushed when the writer goes out of scope.
+ */
+class FdWriter {
+private:
+    int fd;
+    size_t used;
+    bool failed;   //< True once a write() has failed, e.g. with EPIPE.
+    char buffer[4096];
+
+public:
+    explicit FdWriter(int fd)
+            : fd(fd), used(0), failed(false) {}
+
+    ~FdWriter() { flush(); }
+
+    FdWriter(FdWriter const &) = delete;
+
+    FdWriter &operator=(FdWriter const &) = delete;
+
+    FdWriter &write(const char *data, size_t size);
+
+    FdWriter &operator<<(std::string const &s) { return write(s.data(), s.size()); }
+
+    FdWriter &operator<<(const char *s);
+
+    FdWriter &operator<<(char c);
+
+    FdWriter &operator<<(int value) { return *this << static_cast<long>(value); }
+
+    FdWriter &operator<<(long value);
+
+    FdWriter &operator<<(unsigned long value);
+
+    bool flush();
+
+    bool hasFailed() const { return failed; }
+
+private:
+    bool writeAll(const char *data, size_t size);
+};
+
+
+#endif //SHELL_FDWRITER_H
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <unordered_set>
+#include <sys/mman.h>
+#include "HistorySearch.h"
+#include "HistoryStore.h"
+
+// Seven bits per character: exact for ASCII, other bytes share a slot with an
+// ASCII one. Candidates are checked against the entry anyway, so a shared slot
+// only costs a false candidate, and the tables stay small enough for the cache.
+static const size_t TRIGRAM_SPACE = 1 << 21;
+
+static inline uint32_t trigramAt(const char *text) {
+    return static_cast<uint32_t>(text[0] & 0x7f) << 14 |
+           static_cast<uint32_t>(text[1] & 0x7f) << 7 |
+           static_cast<uint32_t>(text[2] & 0x7f);
+}
+
+/**
+ * The distinct trigrams of a string
+ */
+static void collectTrigrams(const char *text, size_t size, std::vector<uint32_t> *pTrigrams) {
+    pTrigrams->clear();
+    for (size_t i = 0; i + 3 <= size; i++)
+        pTrigrams->push_back(trigramAt(text + i));
+    std::sort(pTrigrams->begin(), pTrigrams->end());
+    pTrigrams->erase(std::unique(pTrigrams->begin(), pTrigrams->end()), pTrigrams->end());
+}
+
+bool HistorySearch::PostingList::contains(uint32_t entry) const {
+    if (entry >= (baseSize == 0 ? 0 : base[baseSize - 1]) && recent != nullptr &&
+        std::binary_search(recent->begin(), recent->end(), entry))
+        return true;
+    return std::binary_search(base, base + baseSize, entry);
+}
+
+HistorySearch::HistorySearch(HistoryStore *pHistory)
+        : pHistory(pHistory), built(false), indexed(0), baseCount(0) {
+}
+
+/**
+ * Index the entries that were appended since the last call.
+ * Does nothing until the index has been built by the first search.
+ */
+void HistorySearch::update() {
+    if (!built)
+        return;
+
+    size_t size = pHistory->size();
+    if (size < indexed) {
+        // the history was compacted, start over
+        built = false;
+        build();
+        return;
+    }
+
+    std::string line;
+    for (; indexed < size; indexed++) {
+        if (!pHistory->get(indexed, &line))
+            continue;
+        collectTrigrams(line.data(), line.size(), &trigrams);
+        for (uint32_t trigram : trigrams)
+            recent[trigram].push_back(static_cast<uint32_t>(indexed));
+    }
+}
+
+/**
+ * Find the most recent entry older than the given one that contains the query
+ * @param query the text to look for
+ * @param before only entries with a lower index are considered
+ * @return the index of the entry or -1 if nothing matches
+ */
+long HistorySearch::findBefore(std::string const &query, size_t before) {
+    build();
+    update();
+    before = std::min(before, indexed);
+
+    std::string line;
+    if (query.size() < 3) {
+        for (size_t i = before; i-- > 0;) {
+            if (pHistory->get(i, &line) && line.find(query) != std::string::npos)
+                return static_cast<long>(i);
+        }
+        return -1;
+    }
+
+    std::vector<uint32_t> queryTrigrams;
+    collectTrigrams(query.data(), query.size(), &queryTrigrams);
+
+    std::vector<PostingList> lists(queryTrigrams.size());
+    for (size_t i = 0; i < queryTrigrams.size(); i++) {
+        if (!lookup(queryTrigrams[i], &lists[i]))
+            return -1;
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](PostingList const &a, PostingList const &b) { return a.size() < b.size(); });
+
+    // Walk the rarest trigram from new to old
+    const PostingList &driver = lists.front();
+    for (size_t i = driver.size(); i-- > 0;) {
+        uint32_t candidate = driver.at(i);
+        if (candidate >= before)
+            continue;
+
+        bool all = true;
+        for (size_t j = 1; j < lists.size() && all; j++)
+            all = lists[j].contains(candidate);
+
+        // Having all trigrams does not mean they are in the right order
+        if (all && pHistory->get(candidate, &line) && line.find(query) != std::string::npos)
+            return candidate;
+    }
+    return -1;
+}
+
+/**
+ * Find the most recent distinct entries containing the query
+ * @param query the text to look for
+ * @param limit the maximum number of entries
+ * @return the indices of the entries, newest first
+ */
+std::vector<size_t> HistorySearch::find(std::string const &query, size_t limit) {
+    std::vector<size_t> matches;
+    std::unordered_set<std::string> seen;
+    std::string line;
+
+    size_t before = static_cast<size_t>(-1);
+    while (matches.size() < limit) {
+        long index = findBefore(query, before);
+        if (index == -1)
+            break;
+        before = static_cast<size_t>(index);
+        if (pHistory->get(before, &line) && seen.insert(line).second)
+            matches.push_back(before);
+    }
+    return matches;
+}
+
+/**
+ * Index the whole history, straight from a mapping of the history file.
+ * The first pass counts the entries per trigram, the second one puts every
+ * entry in its place in the flat postings array.
+ */
+void HistorySearch::build() {
+    if (built)
+        return;
+    built = true;
+    indexed = 0;
+    baseCount = 0;
+    starts.assign(TRIGRAM_SPACE + 1, 0);
+    postings.clear();
+    recent.clear();
+
+    size_t count = pHistory->size();
+    uint64_t dataSize = pHistory->getDataSize();
+    if (count == 0 || dataSize == 0)
+        return;
+
+    void *mapping = mmap(nullptr, dataSize, PROT_READ, MAP_PRIVATE, pHistory->getDataFd(), 0);
+    if (mapping == MAP_FAILED) {
+        // every entry with its own read then
+        update();
+        return;
+    }
+    madvise(mapping, dataSize, MADV_SEQUENTIAL);
+    const char *data = static_cast<const char *>(mapping);
+
+    // number of entries per trigram, seen[] holds the last entry (+ 1) that was counted
+    std::vector<uint32_t> seen(TRIGRAM_SPACE, 0);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t start = pHistory->getOffset(i);
+        uint64_t end = i + 1 < count ? pHistory->getOffset(i + 1) : dataSize;
+        const char *text = data + start;
+        for (size_t j = 0; j + 3 < end - start; j++) {
+            uint32_t trigram = trigramAt(text + j);
+            if (seen[trigram] != i + 1) {
+                seen[trigram] = static_cast<uint32_t>(i + 1);
+                starts[trigram + 1]++;
+            }
+        }
+    }
+
+    // where the postings of each trigram start
+    for (size_t k = 0; k < TRIGRAM_SPACE; k++)
+        starts[k + 1] += starts[k];
+
+    postings.resize(starts[TRIGRAM_SPACE]);
+    std::vector<uint32_t> fill(starts.begin(), starts.end() - 1);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t start = pHistory->getOffset(i);
+        uint64_t end = i + 1 < count ? pHistory->getOffset(i + 1) : dataSize;
+        const char *text = data + start;
+        for (size_t j = 0; j + 3 < end - start; j++) {
+            uint32_t trigram = trigramAt(text + j);
+            // postings[fill - 1] is the last entry added for this trigram
+            if (fill[trigram] == starts[trigram] || postings[fill[trigram] - 1] != i)
+                postings[fill[trigram]++] = static_cast<uint32_t>(i);
+        }
+    }
+
+    munmap(mapping, dataSize);
+    indexed = count;
+    baseCount = count;
+}
+
+/**
+ * @param trigram the trigram
+ * @param pList receives the entries containing it
+ * @return false if no entry contains it
+ */
+bool HistorySearch::lookup(uint32_t trigram, PostingList *pList) const {
+    pList->base = postings.data() + starts[trigram];
+    pList->baseSize = starts[trigram + 1] - starts[trigram];
+
+    auto found = recent.find(trigram);
+    pList->recent = found == recent.end() ? nullptr : &found->second;
+    return pList->size() > 0;
+}
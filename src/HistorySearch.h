@@ -0,0 +1,71 @@
+#ifndef SHELL_HISTORYSEARCH_H
+#define SHELL_HISTORYSEARCH_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class HistoryStore;
+
+/**
+ * Substring search over the history, for Ctrl-R and 'history -s'.
+ *
+ * Every entry is broken up into its trigrams (all runs of three bytes) and a
+ * posting list per trigram holds the entries containing it, oldest first.
+ * The posting lists are stored back to back in one flat array, with a dense
+ * table of where each trigram's list starts.
+ * A query is answered by walking the shortest posting list of its trigrams
+ * backwards from the newest entry, checking the other lists with a binary
+ * search and only reading the candidates that have every trigram. The most
+ * recent match is found without looking at the entries that can not match.
+ *
+ * The index is built from the history file on the first search, in two passes
+ * that count and then fill the flat array. Entries appended later
+ * are added by update() to small per-trigram lists on the side. Queries
+ * shorter than a trigram scan the history backwards instead.
+ */
+class HistorySearch {
+private:
+    /**
+     * The entries containing one trigram: a slice of the flat array followed by
+     * the entries added since it was built.
+     */
+    struct PostingList {
+        const uint32_t *base;
+        size_t baseSize;
+        const std::vector<uint32_t> *recent;
+
+        size_t size() const { return baseSize + (recent == nullptr ? 0 : recent->size()); }
+
+        uint32_t at(size_t i) const { return i < baseSize ? base[i] : (*recent)[i - baseSize]; }
+
+        bool contains(uint32_t entry) const;
+    };
+
+    HistoryStore *pHistory;
+    bool built;
+    size_t indexed;                    //< Number of history entries in the index.
+    size_t baseCount;                  //< Number of entries in the flat array.
+    std::vector<uint32_t> starts;      //< Where the postings of each trigram start, plus the end.
+    std::vector<uint32_t> postings;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> recent;
+    std::vector<uint32_t> trigrams;    //< Scratch space.
+
+public:
+    explicit HistorySearch(HistoryStore *pHistory);
+
+    void update();
+
+    long findBefore(std::string const &query, size_t before);
+
+    std::vector<size_t> find(std::string const &query, size_t limit);
+
+private:
+    void build();
+
+    bool lookup(uint32_t trigram, PostingList *pList) const;
+};
+
+
+#endif //SHELL_HISTORYSEARCH_H
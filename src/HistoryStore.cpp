@@ -0,0 +1,448 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "FdWriter.h"
+#include "HistoryStore.h"
+
+static const char INDEX_MAGIC[8] = {'S', 'H', 'H', 'I', 'D', 'X', '1', '\0'};
+
+// Room for this many entries is mapped at first, the mapping doubles when it is full
+static const size_t INITIAL_CAPACITY = 65536;
+
+/**
+ * Bytes of the index file for the given number of offsets
+ */
+size_t HistoryStore::mappingSize(size_t capacity) {
+    return sizeof(IndexHeader) + capacity * sizeof(uint64_t);
+}
+
+HistoryStore::HistoryStore(std::string const &path)
+        : path(path), indexPath(path + ".idx"), dataFd(-1), indexFd(-1), opened(false),
+          header(nullptr), capacity(0) {
+    // history.txt -> history.idx
+    size_t dot = path.rfind('.');
+    if (dot != std::string::npos && path.find('/', dot) == std::string::npos)
+        indexPath = path.substr(0, dot) + ".idx";
+}
+
+/**
+ * Destructor.
+ */
+HistoryStore::~HistoryStore() {
+    unmap();
+    if (dataFd != -1)
+        close(dataFd);
+    if (indexFd != -1)
+        close(indexFd);
+}
+
+/**
+ * @return a descriptor for reading the text file, -1 if it could not be opened
+ */
+int HistoryStore::getDataFd() {
+    open();
+    return dataFd;
+}
+
+/**
+ * @return the number of entries
+ */
+size_t HistoryStore::size() {
+    open();
+    return header == nullptr ? 0 : header->count;
+}
+
+/**
+ * @param index an entry, 0 being the oldest
+ * @return where the entry starts in the text file
+ */
+uint64_t HistoryStore::getOffset(size_t index) {
+    open();
+    return offsets()[index];
+}
+
+/**
+ * @return the end of the last complete entry in the text file
+ */
+uint64_t HistoryStore::getDataSize() {
+    open();
+    return header == nullptr ? 0 : header->dataSize;
+}
+
+/**
+ * Read a single entry
+ * @param index the entry, 0 being the oldest
+ * @param pLine receives the entry without its newline
+ * @return false if there is no such entry
+ */
+bool HistoryStore::get(size_t index, std::string *pLine) {
+    open();
+    if (header == nullptr || index >= header->count)
+        return false;
+
+    uint64_t start = offsets()[index];
+    uint64_t end = index + 1 < header->count ? offsets()[index + 1] : header->dataSize;
+    pLine->resize(end - start - 1);
+    if (pLine->empty())
+        return true;
+    return pread(dataFd, &(*pLine)[0], pLine->size(), static_cast<off_t>(start)) ==
+           static_cast<ssize_t>(pLine->size());
+}
+
+/**
+ * Add an entry at the end of the history
+ * @param line the entry, without a newline
+ */
+void HistoryStore::append(std::string const &line) {
+    open();
+    if (dataFd == -1)
+        return;
+
+    // The file may have been compacted (and replaced) by another shell
+    struct stat current, ours;
+    if (stat(path.c_str(), &current) == 0 && fstat(dataFd, &ours) == 0 && current.st_ino != ours.st_ino) {
+        int fd = ::open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (fd != -1) {
+            close(dataFd);
+            dataFd = fd;
+        }
+    }
+
+    flock(dataFd, LOCK_EX);
+    catchUp();
+
+    std::string entry = line + "\n";
+    const char *data = entry.data();
+    size_t remaining = entry.size();
+    while (remaining > 0) {
+        ssize_t written = write(dataFd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        data += written;
+        remaining -= static_cast<size_t>(written);
+    }
+
+    // Index what we just wrote from where it really ended up
+    catchUp();
+    flock(dataFd, LOCK_UN);
+}
+
+/**
+ * Replace the history references !!, !n and !-n outside of quotes by the entries
+ * they refer to. Entries are numbered from 1.
+ * @param line the line as typed
+ * @param pResult receives the line with all references replaced
+ * @param pError receives a message for a reference that does not exist
+ * @return false if a reference does not exist
+ */
+bool HistoryStore::expand(std::string const &line, std::string *pResult, std::string *pError) {
+    pResult->clear();
+    bool quoted = false;
+
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (c == '"' && (i == 0 || line[i - 1] != '\\'))
+            quoted = !quoted;
+
+        if (quoted || c != '!' || i + 1 >= line.size()) {
+            pResult->push_back(c);
+            continue;
+        }
+
+        size_t end = i + 1;
+        long event;
+        if (line[end] == '!') {
+            event = static_cast<long>(size());
+            end++;
+        } else {
+            bool relative = line[end] == '-';
+            if (relative)
+                end++;
+            size_t digits = end;
+            while (end < line.size() && line[end] >= '0' && line[end] <= '9')
+                end++;
+            if (end == digits) {
+                // not a reference, e.g. a lone !
+                pResult->push_back(c);
+                continue;
+            }
+            event = atol(line.substr(digits, end - digits).c_str());
+            if (relative)
+                event = static_cast<long>(size()) + 1 - event;
+        }
+
+        std::string entry;
+        if (event < 1 || !get(static_cast<size_t>(event - 1), &entry)) {
+            *pError = line.substr(i, end - i) + ": event not found";
+            return false;
+        }
+        pResult->append(entry);
+        i = end - 1;
+    }
+
+    return true;
+}
+
+namespace {
+    struct Entry {
+        const char *text;
+        size_t size;
+    };
+
+    struct EntryHash {
+        size_t operator()(Entry const &entry) const {
+            // FNV-1a
+            uint64_t hash = 14695981039346656037ULL;
+            for (size_t i = 0; i < entry.size; i++)
+                hash = (hash ^ static_cast<unsigned char>(entry.text[i])) * 1099511628211ULL;
+            return static_cast<size_t>(hash);
+        }
+    };
+
+    struct EntryEqual {
+        bool operator()(Entry const &a, Entry const &b) const {
+            return a.size == b.size && memcmp(a.text, b.text, a.size) == 0;
+        }
+    };
+}
+
+/**
+ * Rewrite the history with every duplicate entry removed, keeping the most
+ * recent occurrence. The new text file replaces the old one atomically and the
+ * index is rebuilt. Meant to run while no other shell is appending.
+ * @param pRemoved receives the number of entries that were dropped
+ * @param pError receives a message when the history could not be rewritten
+ * @return true on success
+ */
+bool HistoryStore::compact(size_t *pRemoved, std::string *pError) {
+    open();
+    if (dataFd == -1 || header == nullptr) {
+        *pError = "history is not available";
+        return false;
+    }
+
+    flock(dataFd, LOCK_EX);
+    catchUp();
+
+    size_t count = header->count;
+    uint64_t dataSize = header->dataSize;
+    *pRemoved = 0;
+    if (count == 0) {
+        flock(dataFd, LOCK_UN);
+        return true;
+    }
+
+    void *mapping = mmap(nullptr, dataSize, PROT_READ, MAP_PRIVATE, dataFd, 0);
+    if (mapping == MAP_FAILED) {
+        flock(dataFd, LOCK_UN);
+        *pError = strerror(errno);
+        return false;
+    }
+    const char *data = static_cast<const char *>(mapping);
+
+    // Walk from new to old so the most recent copy of a line is the one kept
+    std::unordered_set<Entry, EntryHash, EntryEqual> seen;
+    seen.reserve(count);
+    std::vector<bool> keep(count);
+    for (size_t i = count; i-- > 0;) {
+        uint64_t end = i + 1 < count ? offsets()[i + 1] : dataSize;
+        Entry entry = {data + offsets()[i], static_cast<size_t>(end - offsets()[i] - 1)};
+        keep[i] = seen.insert(entry).second;
+        if (!keep[i])
+            (*pRemoved)++;
+    }
+
+    // A new file with a name nobody can guess, /var/tmp is writable for everyone
+    std::string tempPath = path + ".XXXXXX";
+    int fd = mkostemp(&tempPath[0], O_CLOEXEC);
+    bool ok = fd != -1 && fchmod(fd, 0644) == 0;
+    if (ok) {
+        FdWriter out(fd);
+        for (size_t i = 0; i < count; i++) {
+            if (!keep[i])
+                continue;
+            uint64_t end = i + 1 < count ? offsets()[i + 1] : dataSize;
+            out.write(data + offsets()[i], static_cast<size_t>(end - offsets()[i]));
+        }
+        ok = out.flush() && fsync(fd) == 0;
+        ok = close(fd) == 0 && ok;
+        ok = ok && rename(tempPath.c_str(), path.c_str()) == 0;
+    }
+    if (!ok) {
+        *pError = strerror(errno);
+        if (fd != -1)
+            unlink(tempPath.c_str());
+    }
+
+    munmap(mapping, dataSize);
+    flock(dataFd, LOCK_UN);
+
+    if (ok) {
+        int newFd = ::open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (newFd != -1) {
+            close(dataFd);
+            dataFd = newFd;
+            catchUp();
+        }
+    }
+    return ok;
+}
+
+/**
+ * Open the files and bring the index up to date, on first use
+ */
+void HistoryStore::open() {
+    if (opened)
+        return;
+    opened = true;
+
+    dataFd = ::open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (dataFd == -1)
+        dataFd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dataFd == -1)
+        return;
+
+    indexFd = ::open(indexPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    size_t existing = 0;
+    struct stat info;
+    if (indexFd != -1 && fstat(indexFd, &info) == 0 && static_cast<size_t>(info.st_size) > mappingSize(0))
+        existing = (static_cast<size_t>(info.st_size) - mappingSize(0)) / sizeof(uint64_t);
+
+    if (!map(std::max(existing, INITIAL_CAPACITY)))
+        return;
+
+    // An index that does not end at the end of a line does not belong to this file
+    char last = '\n';
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 && header->dataSize > 0 &&
+        pread(dataFd, &last, 1, static_cast<off_t>(header->dataSize - 1)) != 1)
+        last = 0;
+    if (last != '\n')
+        header->magic[0] = 0;
+
+    catchUp();
+}
+
+/**
+ * (Re)map the index with room for the given number of offsets, growing the
+ * index file if needed. Falls back to anonymous memory when the file can not
+ * be used.
+ * @return false if there is no index at all
+ */
+bool HistoryStore::map(size_t newCapacity) {
+    size_t bytes = mappingSize(newCapacity);
+    void *mapping = MAP_FAILED;
+
+    if (indexFd != -1) {
+        struct stat info;
+        if (fstat(indexFd, &info) == 0 &&
+            (static_cast<size_t>(info.st_size) >= bytes || ftruncate(indexFd, static_cast<off_t>(bytes)) == 0))
+            mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, indexFd, 0);
+
+        if (mapping == MAP_FAILED) {
+            close(indexFd);
+            indexFd = -1;
+        }
+    }
+
+    if (mapping == MAP_FAILED) {
+        mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED)
+            return false;
+        if (header != nullptr)
+            memcpy(mapping, header, mappingSize(std::min(capacity, newCapacity)));
+    }
+
+    unmap();
+    header = static_cast<IndexHeader *>(mapping);
+    capacity = newCapacity;
+    return true;
+}
+
+void HistoryStore::unmap() {
+    if (header != nullptr)
+        munmap(header, mappingSize(capacity));
+    header = nullptr;
+    capacity = 0;
+}
+
+/**
+ * Index whatever has been appended to the text file since we last looked, or
+ * start over if the index does not belong to the text file anymore
+ */
+void HistoryStore::catchUp() {
+    struct stat info;
+    if (header == nullptr || fstat(dataFd, &info) != 0)
+        return;
+
+    // Another shell has grown the index file past our mapping, map all of it
+    struct stat index;
+    if (header->count > capacity && indexFd != -1 && fstat(indexFd, &index) == 0 &&
+        static_cast<size_t>(index.st_size) >= mappingSize(header->count))
+        map((static_cast<size_t>(index.st_size) - mappingSize(0)) / sizeof(uint64_t));
+
+    uint64_t size = static_cast<uint64_t>(info.st_size);
+    uint64_t inode = static_cast<uint64_t>(info.st_ino);
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || header->dataInode != inode ||
+        header->dataSize > size || header->count > capacity)
+        rebuild(inode);
+
+    if (size > header->dataSize)
+        scan(header->dataSize, size);
+}
+
+/**
+ * Empty the index, the next scan starts at the beginning of the text file
+ */
+void HistoryStore::rebuild(uint64_t inode) {
+    header->count = 0;
+    header->dataSize = 0;
+    header->dataInode = inode;
+    memcpy(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+}
+
+/**
+ * Add an offset for every complete line in the given range of the text file
+ * @param from the end of the last indexed line
+ * @param to the size of the file
+ */
+void HistoryStore::scan(uint64_t from, uint64_t to) {
+    char block[65536];
+    uint64_t lineStart = from;
+    uint64_t position = from;
+
+    while (position < to) {
+        size_t wanted = static_cast<size_t>(std::min<uint64_t>(sizeof(block), to - position));
+        ssize_t n = pread(dataFd, block, wanted, static_cast<off_t>(position));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+
+        const char *p = block;
+        const char *end = block + n;
+        const char *newline;
+        while ((newline = static_cast<const char *>(memchr(p, '\n', static_cast<size_t>(end - p)))) != nullptr) {
+            if (header->count == capacity && !map(capacity * 2))
+                return;
+            offsets()[header->count] = lineStart;
+            header->count++;
+            lineStart = position + static_cast<uint64_t>(newline - block) + 1;
+            header->dataSize = lineStart;
+            p = newline + 1;
+        }
+        position += static_cast<uint64_t>(n);
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef SHELL_HISTORYSTORE_H
+#define SHELL_HISTORYSTORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+/**
+ * The command history: an append-only text file with one entry per line, plus
+ * an index file next to it holding the byte offset of every entry.
+ *
+ * The index is a fixed-width array of 64-bit offsets that is mmap'd, so finding
+ * entry n is a single array access and reading it a single pread(), no matter
+ * how many millions of lines the history has. The last N entries are one
+ * contiguous range of the text file.
+ * The index records how much of the text file it covers and the inode of that
+ * file. Lines appended by someone else (another shell, an older version) are
+ * indexed when they are first noticed; a text file that has been replaced or
+ * truncated gets its index rebuilt. Appends are serialised with flock().
+ * Without a usable index file the offsets live in anonymous memory instead.
+ */
+class HistoryStore {
+private:
+    struct IndexHeader {
+        char magic[8];
+        uint64_t count;     //< Number of entries in the index.
+        uint64_t dataSize;  //< Bytes of the text file covered by the index.
+        uint64_t dataInode; //< The text file the index belongs to.
+    };
+
+    std::string path;
+    std::string indexPath;
+    int dataFd;
+    int indexFd;
+    bool opened;
+    IndexHeader *header;    //< Start of the mapping, the offsets follow it.
+    size_t capacity;        //< Number of offsets the mapping has room for.
+
+public:
+    explicit HistoryStore(std::string const &path);
+
+    ~HistoryStore();
+
+    HistoryStore(HistoryStore const &) = delete;
+
+    HistoryStore &operator=(HistoryStore const &) = delete;
+
+    const std::string &getPath() const { return path; }
+
+    int getDataFd();
+
+    size_t size();
+
+    uint64_t getOffset(size_t index);
+
+    uint64_t getDataSize();
+
+    bool get(size_t index, std::string *pLine);
+
+    void append(std::string const &line);
+
+    bool expand(std::string const &line, std::string *pResult, std::string *pError);
+
+    bool compact(size_t *pRemoved, std::string *pError);
+
+private:
+    void open();
+
+    static size_t mappingSize(size_t capacity);
+
+    uint64_t *offsets() const { return reinterpret_cast<uint64_t *>(header + 1); }
+
+    bool map(size_t newCapacity);
+
+    void unmap();
+
+    void catchUp();
+
+    void rebuild(uint64_t inode);
+
+    void scan(uint64_t from, uint64_t to);
+};
+
+
+#endif //SHELL_HISTORYSTORE_H
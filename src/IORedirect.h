@@ -1,9 +1,15 @@
 #ifndef SHELL_IOREDIRECT_H
 #define SHELL_IOREDIRECT_H
 
-#include <string>
+#include <cstdlib>
 #include <fcntl.h>
 
+/**
+ * A single redirect of a command, as it is applied when the command starts.
+ * Everything that can be worked out in advance is: which descriptor gets
+ * replaced, how the file is opened and, for targets like '&1', which
+ * descriptor is copied. The target lives in the arena of the Sequence.
+ */
 class IORedirect {
 public:
     enum Type {
@@ -17,19 +23,42 @@ public:
 private:
     int oldFileDesc;      //< The file descriptor that is subject of redirection.
     Type type;            //< Type of redirection.
-    std::string newFile;  //< Destination for the redirect. This can be a filename, or - if
+    const char *newFile;  //< Destination for the redirect. This can be a filename, or - if
     //  it starts with an ampersand ('&') another file descriptor. E.g.
     //  if this is '&1', output will be written to stdout.
+    int targetFd;         //< The descriptor that is replaced: 0 for input, 1 or 2 for output, -1 for none.
+    int sourceFd;         //< For output to '&n' the descriptor n, -1 otherwise.
+    int openFlags;        //< How newFile is opened.
 
 public:
-    IORedirect(int oldFd, Type t, std::string const &nf)
-            : oldFileDesc(oldFd), type(t), newFile(nf) {}
+    IORedirect()
+            : oldFileDesc(-1), type(OUTPUT), newFile(""), targetFd(-1), sourceFd(-1), openFlags(0) {}
+
+    IORedirect(int oldFd, Type t, const char *nf)
+            : oldFileDesc(oldFd), type(t), newFile(nf), targetFd(-1), sourceFd(-1) {
+        if (t == INPUT) {
+            targetFd = 0;
+            openFlags = READ_FLAGS;
+        } else {
+            if (oldFd == 1 || oldFd == 2)
+                targetFd = oldFd;
+            if (nf[0] == '&')
+                sourceFd = atoi(nf + 1);
+            openFlags = t == OUTPUT ? TRUNC_FLAGS : APPEND_FLAGS;
+        }
+    }
 
     int getOldFileDescriptor() const { return oldFileDesc; }
 
     Type getType() const { return type; }
 
-    std::string const &getNewFile() const { return newFile; }
+    const char *getNewFile() const { return newFile; }
+
+    int getTargetFd() const { return targetFd; }
+
+    int getSourceFd() const { return sourceFd; }
+
+    int getOpenFlags() const { return openFlags; }
 };
 
 #endif //SHELL_IOREDIRECT_H
@@ -0,0 +1,363 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "JobTable.h"
+
+/**
+ * pidfd_open() through syscall(), not every libc has a (usable) wrapper
+ */
+static int openPidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+JobTable::JobTable()
+        : nextId(1), epollFd(epoll_create1(EPOLL_CLOEXEC)), polledStages(0), terminalFd(-1) {
+}
+
+/**
+ * Destructor.
+ */
+JobTable::~JobTable() {
+    for (auto &entry : jobs) {
+        for (int fd : entry.second.pidfds) {
+            if (fd != -1)
+                close(fd);
+        }
+    }
+    if (epollFd != -1)
+        close(epollFd);
+}
+
+/**
+ * Turn on job control for the given terminal.
+ * The shell itself ignores the signals for terminal access and Ctrl-Z from now
+ * on, so it can move jobs in and out of the foreground. Started commands get
+ * their default behaviour back (see Launcher).
+ * @param fd the terminal, normally stdin
+ */
+void JobTable::enableJobControl(int fd) {
+    signal(SIGTTOU, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    terminalFd = fd;
+}
+
+/**
+ * Add a started pipeline to the table
+ * @param commandLine the text shown by 'jobs'
+ * @param pids the processes of the pipeline, the last one being the last stage.
+ *             With job control the first one leads the process group.
+ * @param background true if nobody waits for the job right away
+ * @return the id of the new job
+ */
+int JobTable::add(std::string const &commandLine, std::vector<pid_t> const &pids, bool background) {
+    if (jobs.empty())
+        nextId = 1;
+
+    int id = nextId++;
+    Job &job = jobs[id];
+    job.id = id;
+    job.commandLine = commandLine;
+    job.pids = pids;
+    job.pidfds.assign(pids.size(), -1);
+    job.stopped.assign(pids.size(), false);
+    job.pgid = hasJobControl() ? pids.front() : -1;
+    job.running = pids.size();
+    job.status = 0;
+    job.background = background;
+
+    for (size_t i = 0; i < pids.size(); i++) {
+        int fd = epollFd == -1 ? -1 : openPidfd(pids[i]);
+        if (fd != -1) {
+            struct epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.u64 = (static_cast<uint64_t>(id) << 32) | i;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0) {
+                job.pidfds[i] = fd;
+                continue;
+            }
+            close(fd);
+        }
+        polledStages++;
+    }
+
+    return id;
+}
+
+/**
+ * Reap all processes that have finished without blocking.
+ * Background jobs that are completely done are reported and removed.
+ * @param out stream for the 'Done' notifications
+ */
+void JobTable::reap(std::ostream &out) {
+    std::vector<int> finished;
+
+    if (epollFd != -1) {
+        struct epoll_event events[64];
+        int n;
+        do {
+            n = epoll_wait(epollFd, events, 64, 0);
+            for (int i = 0; i < n; i++) {
+                auto found = jobs.find(static_cast<int>(events[i].data.u64 >> 32));
+                if (found == jobs.end())
+                    continue;
+
+                Job &job = found->second;
+                size_t stage = events[i].data.u64 & 0xffffffff;
+                int status = 0;
+                pid_t result = waitpid(job.pids[stage], &status, WNOHANG);
+                // ECHILD: somebody else reaped it, don't let the pidfd fire forever
+                if (result == job.pids[stage] || (result == -1 && errno == ECHILD)) {
+                    stageDone(job, stage, status);
+                    if (job.running == 0)
+                        finished.push_back(job.id);
+                }
+            }
+        } while (n == 64);
+    }
+
+    if (polledStages > 0) {
+        for (auto &entry : jobs) {
+            Job &job = entry.second;
+            for (size_t stage = 0; stage < job.pids.size(); stage++) {
+                if (job.pids[stage] == -1 || job.pidfds[stage] != -1)
+                    continue;
+
+                int status = 0;
+                pid_t result = waitpid(job.pids[stage], &status, WNOHANG);
+                if (result == job.pids[stage] || (result == -1 && errno == ECHILD)) {
+                    stageDone(job, stage, status);
+                    if (job.running == 0)
+                        finished.push_back(job.id);
+                }
+            }
+        }
+    }
+
+    std::sort(finished.begin(), finished.end());
+    for (int id : finished) {
+        auto found = jobs.find(id);
+        if (found->second.background)
+            out << "[" << id << "] Done\t" << found->second.commandLine << std::endl;
+        jobs.erase(found);
+    }
+}
+
+/**
+ * Block until all processes of a job have finished and remove it from the table.
+ * With job control the job gets the terminal in the meantime, and if it is
+ * stopped it stays in the table as a background job.
+ * @param id the job to wait for
+ * @param foreground true to hand the terminal to the job, false for 'wait'
+ * @return the wait status of the last stage of the pipeline, or of the
+ *         stage that stopped
+ */
+int JobTable::wait(int id, bool foreground) {
+    auto found = jobs.find(id);
+    if (found == jobs.end())
+        return 0;
+
+    Job &job = found->second;
+    if (job.pgid != -1) {
+        int status = waitForGroup(job, foreground);
+        if (job.running > 0) {
+            job.background = true;
+            std::cout << std::endl << "[" << id << "] Stopped\t" << job.commandLine << std::endl;
+            return status;
+        }
+    } else {
+        for (size_t stage = 0; stage < job.pids.size(); stage++) {
+            if (job.pids[stage] == -1)
+                continue;
+
+            int status = 0;
+            pid_t result;
+            do {
+                result = waitpid(job.pids[stage], &status, 0);
+            } while (result == -1 && errno == EINTR);
+            stageDone(job, stage, status);
+        }
+    }
+
+    int status = job.status;
+    jobs.erase(found);
+    return status;
+}
+
+/**
+ * Continue a stopped job, for 'fg'
+ * @param id the job
+ */
+void JobTable::resume(int id) {
+    auto found = jobs.find(id);
+    if (found == jobs.end() || found->second.pgid == -1)
+        return;
+
+    Job &job = found->second;
+    job.stopped.assign(job.pids.size(), false);
+    job.background = false;
+    kill(-job.pgid, SIGCONT);
+}
+
+/**
+ * Wait for every job in the table
+ */
+void JobTable::waitAll() {
+    for (int id : sortedIds())
+        wait(id, false);
+}
+
+/**
+ * Find the job a user refers to
+ * @param spec either %n, n, %% or %+ (the most recent job)
+ * @return the id of the job or -1 if there is no such job
+ */
+int JobTable::findJob(std::string const &spec) const {
+    if (spec == "%%" || spec == "%+")
+        return getCurrentJob();
+
+    std::string number = !spec.empty() && spec[0] == '%' ? spec.substr(1) : spec;
+    if (number.empty() || number.find_first_not_of("0123456789") != std::string::npos)
+        return -1;
+
+    int id = atoi(number.c_str());
+    return jobs.find(id) != jobs.end() ? id : -1;
+}
+
+const std::string &JobTable::getCommandLine(int id) const {
+    return jobs.at(id).commandLine;
+}
+
+/**
+ * @return the most recently started job, or -1 if there is none
+ */
+int JobTable::getCurrentJob() const {
+    int current = -1;
+    for (const auto &entry : jobs)
+        current = std::max(current, entry.first);
+    return current;
+}
+
+/**
+ * Print all jobs that are still running or stopped, for 'jobs'
+ * @param out stream to print to
+ */
+void JobTable::print(std::ostream &out) const {
+    for (int id : sortedIds()) {
+        const Job &job = jobs.at(id);
+        bool stopped = false;
+        for (size_t stage = 0; stage < job.pids.size(); stage++) {
+            if (job.pids[stage] != -1 && job.stopped[stage])
+                stopped = true;
+        }
+        out << "[" << id << "] " << (stopped ? "Stopped" : "Running") << "\t" << job.commandLine << std::endl;
+    }
+}
+
+/**
+ * Turn a wait status into the exit status the user gets to see
+ * @param waitStatus as returned by wait()
+ * @return the exit code, or 128 plus the number of the signal that ended or stopped it
+ */
+int JobTable::exitStatus(int waitStatus) {
+    if (WIFEXITED(waitStatus))
+        return WEXITSTATUS(waitStatus);
+    if (WIFSIGNALED(waitStatus))
+        return 128 + WTERMSIG(waitStatus);
+    if (WIFSTOPPED(waitStatus))
+        return 128 + WSTOPSIG(waitStatus);
+    return 0;
+}
+
+/**
+ * Wait for the process group of a job until every stage has either finished
+ * or stopped.
+ * Waiting on the group instead of on each pid collects the stop reports of all
+ * stages, so none of them is mistaken for a new stop after 'fg'.
+ * @return the wait status of the last stage or of the stage that stopped
+ */
+int JobTable::waitForGroup(Job &job, bool foreground) {
+    if (foreground)
+        tcsetpgrp(terminalFd, job.pgid);
+
+    int lastStatus = 0;
+    size_t stoppedStages = 0;
+    while (job.running > stoppedStages) {
+        int status = 0;
+        pid_t pid = waitpid(-job.pgid, &status, WUNTRACED);
+        if (pid == -1) {
+            if (errno == EINTR)
+                continue;
+
+            // Nothing left in the group, whatever is still listed is gone
+            for (size_t stage = 0; stage < job.pids.size(); stage++) {
+                if (job.pids[stage] != -1)
+                    stageDone(job, stage, 0);
+            }
+            break;
+        }
+
+        for (size_t stage = 0; stage < job.pids.size(); stage++) {
+            if (job.pids[stage] != pid)
+                continue;
+
+            if (WIFSTOPPED(status)) {
+                if (!job.stopped[stage]) {
+                    job.stopped[stage] = true;
+                    stoppedStages++;
+                }
+                lastStatus = status;
+            } else {
+                if (job.stopped[stage])
+                    stoppedStages--;
+                stageDone(job, stage, status);
+            }
+            break;
+        }
+    }
+
+    // Take the terminal back
+    if (foreground)
+        tcsetpgrp(terminalFd, getpgrp());
+
+    return job.running > 0 ? lastStatus : job.status;
+}
+
+/**
+ * Bookkeeping for a process that has been reaped
+ */
+void JobTable::stageDone(Job &job, size_t stage, int status) {
+    if (job.pidfds[stage] != -1) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, job.pidfds[stage], nullptr);
+        close(job.pidfds[stage]);
+        job.pidfds[stage] = -1;
+    } else {
+        polledStages--;
+    }
+
+    job.pids[stage] = -1;
+    job.stopped[stage] = false;
+    job.running--;
+    if (stage == job.pids.size() - 1)
+        job.status = status;
+}
+
+std::vector<int> JobTable::sortedIds() const {
+    std::vector<int> ids;
+    ids.reserve(jobs.size());
+    for (const auto &entry : jobs)
+        ids.push_back(entry.first);
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
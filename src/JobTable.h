@@ -0,0 +1,95 @@
+#ifndef SHELL_JOBTABLE_H
+#define SHELL_JOBTABLE_H
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * Keeps track of every pipeline the shell started, one job per pipeline.
+ *
+ * Each process of a job gets a pidfd that is put in a single epoll set. A pidfd
+ * becomes readable when its process exits, so reap() can find the finished
+ * processes with one epoll_wait() call and reap exactly those, without blocking
+ * and without scanning the table. The epoll event carries the job id and the
+ * index of the process, so handling a completion is O(1).
+ * Should pidfds not be supported by the kernel, the processes of the table are
+ * polled with waitpid(WNOHANG) instead.
+ *
+ * Processes are always waited for by pid (or by process group), so waiting for
+ * one job never reaps a process of another.
+ *
+ * When the shell runs on a terminal, job control is enabled: the stages of a
+ * pipeline share a process group, a foreground job is given the terminal while
+ * it is waited for, and a job that is stopped (e.g. with Ctrl-Z) stays in the
+ * table until it is continued with 'fg'.
+ */
+class JobTable {
+private:
+    struct Job {
+        int id;
+        std::string commandLine;
+        std::vector<pid_t> pids;   //< One per stage, -1 once reaped.
+        std::vector<int> pidfds;   //< One per stage, -1 when closed or not available.
+        std::vector<bool> stopped; //< One per stage, true while the stage is stopped.
+        pid_t pgid;                //< Process group of the stages, -1 without job control.
+        size_t running;            //< Number of stages that have not been reaped yet.
+        int status;                //< Wait status of the last stage.
+        bool background;
+    };
+
+    std::unordered_map<int, Job> jobs;
+    int nextId;
+    int epollFd;
+    size_t polledStages;           //< Running stages without a pidfd.
+    int terminalFd;                //< The terminal handed to foreground jobs, -1 without job control.
+
+public:
+    JobTable();
+
+    ~JobTable();
+
+    JobTable(JobTable const &) = delete;
+
+    JobTable &operator=(JobTable const &) = delete;
+
+    void enableJobControl(int fd);
+
+    bool hasJobControl() const { return terminalFd != -1; }
+
+    int getTerminalFd() const { return terminalFd; }
+
+    int add(std::string const &commandLine, std::vector<pid_t> const &pids, bool background);
+
+    void reap(std::ostream &out);
+
+    int wait(int id, bool foreground);
+
+    void resume(int id);
+
+    void waitAll();
+
+    int findJob(std::string const &spec) const;
+
+    const std::string &getCommandLine(int id) const;
+
+    bool isEmpty() const { return jobs.empty(); }
+
+    int getCurrentJob() const;
+
+    void print(std::ostream &out) const;
+
+    static int exitStatus(int waitStatus);
+
+private:
+    void stageDone(Job &job, size_t stage, int status);
+
+    int waitForGroup(Job &job, bool foreground);
+
+    std::vector<int> sortedIds() const;
+};
+
+
+#endif //SHELL_JOBTABLE_H
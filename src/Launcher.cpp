@@ -0,0 +1,258 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <cstdlib>
+#include <cerrno>
+#include <spawn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <linux/close_range.h>
+#include "Launcher.h"
+#include "Metrics.h"
+#include "SimpleCommand.h"
+#include "Shell.h"
+
+extern char **environ;
+
+Launcher::Backend Launcher::backend = Launcher::SPAWN;
+
+// Ignored by the shell when it does job control, see JobTable::enableJobControl()
+static const int JOB_CONTROL_SIGNALS[] = {SIGTTOU, SIGTTIN, SIGTSTP};
+
+const char *Launcher::getBackendName(Backend b) {
+    return b == FORK ? "fork" : "spawn";
+}
+
+/**
+ * Mark every descriptor from the given one upwards close-on-exec with a single
+ * close_range() call. They stay usable as the source of a redirect like 2>&3.
+ */
+static void closeRangeOnExec(unsigned int first) {
+#if defined(SYS_close_range) && defined(CLOSE_RANGE_CLOEXEC)
+    if (syscall(SYS_close_range, first, ~0U, CLOSE_RANGE_CLOEXEC) == 0)
+        return;
+#endif
+    // Older kernel, fall back to the descriptors we know can leak
+    long max = sysconf(_SC_OPEN_MAX);
+    for (long fd = first; fd < max && fd < 1024; fd++) {
+        int flags = fcntl(static_cast<int>(fd), F_GETFD);
+        if (flags != -1)
+            fcntl(static_cast<int>(fd), F_SETFD, flags | FD_CLOEXEC);
+    }
+}
+
+/**
+ * Translate a backend name into a Backend
+ * @param name either "fork" or "spawn"
+ * @param pBackend receives the backend when the name is known
+ * @return true if the name was recognised
+ */
+bool Launcher::parseBackend(std::string const &name, Backend *pBackend) {
+    if (name == "fork") {
+        *pBackend = FORK;
+        return true;
+    } else if (name == "spawn") {
+        *pBackend = SPAWN;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Select the backend named by the SHELL_LAUNCHER environment variable, if set
+ */
+void Launcher::configureFromEnvironment() {
+    const char *name = getenv("SHELL_LAUNCHER");
+    if (name == nullptr)
+        return;
+
+    if (!parseBackend(name, &backend)) {
+        std::cerr << "SHELL_LAUNCHER: unknown backend " << name << ", using "
+                  << getBackendName(backend) << std::endl;
+    }
+}
+
+/**
+ * Start one stage of a pipeline
+ * @param cmd the command to start
+ * @param pShell the shell session
+ * @param inFd the pipe end that becomes stdin, or -1 to keep ours
+ * @param outFd the pipe end that becomes stdout, or -1 to keep ours
+ * @param heldFd a pipe end the shell holds on to for the next stage, or -1
+ * @param pgid the process group to join, 0 to lead a new one or -1 to stay in ours
+ * @param foreground true if the process group gets the terminal (job control only)
+ * @return the pid of the child, or -1 if no child was started
+ */
+pid_t Launcher::launch(SimpleCommand *cmd, Shell *pShell, int inFd, int outFd, int heldFd,
+                       pid_t pgid, bool foreground) {
+    int terminalFd = foreground && pgid != -1 ? pShell->getJobTable().getTerminalFd() : -1;
+
+    pid_t childPid;
+    if (pShell->getBuiltinTable().find(cmd->getCommand()) != nullptr) {
+        childPid = launchFork(cmd, pShell, "", inFd, outFd, heldFd, pgid, terminalFd);
+    } else {
+        childPid = launchProgram(cmd, pShell, inFd, outFd, heldFd, pgid, terminalFd);
+    }
+
+    // Also done by the child, whichever of us gets there first avoids the race
+    // with the next stage joining the group or the job reading the terminal
+    if (childPid > 0 && pgid != -1) {
+        setpgid(childPid, pgid == 0 ? childPid : pgid);
+        if (terminalFd != -1)
+            tcsetpgrp(terminalFd, pgid == 0 ? childPid : pgid);
+    }
+
+    return childPid;
+}
+
+pid_t Launcher::launchProgram(SimpleCommand *cmd, Shell *pShell, int inFd, int outFd, int heldFd,
+                              pid_t pgid, int terminalFd) {
+    // Look the command up here so the shell's command table remembers it
+    uint64_t lookupStart = Metrics::now();
+    std::string commandPath = cmd->findCommand(pShell);
+    Metrics::recordSince(Metrics::LOOKUP, lookupStart);
+
+    // command was not found in any of the paths or in the current directory (on ./cmd)
+    if (commandPath.empty()) {
+        std::cerr << cmd->getCommand() << ": command not found" << std::endl;
+        return -1;
+    }
+
+    if (backend == FORK)
+        return launchFork(cmd, pShell, commandPath, inFd, outFd, heldFd, pgid, terminalFd);
+    return launchSpawn(cmd, commandPath, inFd, outFd, pgid, terminalFd);
+}
+
+pid_t Launcher::launchFork(SimpleCommand *cmd, Shell *pShell, std::string const &commandPath,
+                           int inFd, int outFd, int heldFd, pid_t pgid, int terminalFd) {
+    // Anything still sitting in our stdio buffers would otherwise be written twice
+    std::cout.flush();
+    fflush(stdout);
+
+    uint64_t start = Metrics::now();
+    int childPid = fork();
+
+    if (childPid == 0) {
+        if (pgid != -1) {
+            setpgid(0, pgid);
+            if (terminalFd != -1)
+                tcsetpgrp(terminalFd, getpgrp());
+        }
+        for (int sig : JOB_CONTROL_SIGNALS)
+            signal(sig, SIG_DFL);
+
+        if (outFd != -1 && dup2(outFd, 1) < 0) {
+            std::cerr << "Failed dup2" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        if (inFd != -1 && dup2(inFd, 0) < 0) {
+            std::cerr << "Failed dup2" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        // pipes are connected close them, anything else we inherited from the
+        // shell must not survive the exec either. A builtin never execs, so the
+        // read end of its own output pipe that the shell still holds is closed
+        // right away, or the writer would never see the reader go.
+        if (outFd != -1)
+            close(outFd);
+        if (inFd != -1)
+            close(inFd);
+        if (heldFd != -1)
+            close(heldFd);
+        closeRangeOnExec(3);
+
+        cmd->execute(pShell, commandPath);
+        // Should never get here
+        exit(EXIT_FAILURE);
+    } else if (childPid < 0) {
+        // e.g. EAGAIN, the shell itself carries on
+        std::cerr << "Failed to create child process: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    Metrics::recordSince(Metrics::LAUNCH, start);
+    return childPid;
+}
+
+pid_t Launcher::launchSpawn(SimpleCommand *cmd, std::string const &commandPath,
+                            int inFd, int outFd, pid_t pgid, int terminalFd) {
+    uint64_t redirectStart = Metrics::now();
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+
+    // The pipe ends are close-on-exec, dup2 clears that flag on the copies only
+    if (outFd != -1)
+        posix_spawn_file_actions_adddup2(&actions, outFd, 1);
+    if (inFd != -1)
+        posix_spawn_file_actions_adddup2(&actions, inFd, 0);
+
+    // Opening straight onto the target descriptor means a later redirect of the
+    // same stream replaces an earlier one, while the earlier file is still created
+    // or truncated, just like processRedirects() does. Descriptor copies are
+    // applied last in the order stdin, stdout, stderr for the same reason.
+    int dupSource[3] = {-1, -1, -1};
+    for (const IORedirect &redirect : cmd->getRedirects()) {
+        int target = redirect.getTargetFd();
+        if (redirect.getNewFile()[0] == '\0' || target == -1)
+            continue;
+
+        dupSource[target] = redirect.getSourceFd();
+        if (dupSource[target] == -1)
+            posix_spawn_file_actions_addopen(&actions, target, redirect.getNewFile(), redirect.getOpenFlags(), 0644);
+    }
+    for (int target = 0; target < 3; target++) {
+        if (dupSource[target] != -1)
+            posix_spawn_file_actions_adddup2(&actions, dupSource[target], target);
+    }
+
+    // Whatever else we inherited is dropped, after it had the chance to be the
+    // source of a redirect. This is a single close_range() in the child.
+#if __GLIBC_PREREQ(2, 34)
+    posix_spawn_file_actions_addclosefrom_np(&actions, 3);
+#endif
+    Metrics::recordSince(Metrics::REDIRECT, redirectStart);
+
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    short flags = POSIX_SPAWN_SETSIGDEF;
+
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    for (int sig : JOB_CONTROL_SIGNALS)
+        sigaddset(&defaults, sig);
+    posix_spawnattr_setsigdefault(&attributes, &defaults);
+
+    if (pgid != -1) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attributes, pgid);
+#ifdef POSIX_SPAWN_TCSETPGROUP
+        if (terminalFd != -1) {
+            flags |= POSIX_SPAWN_TCSETPGROUP;
+            posix_spawnattr_tcsetpgrp_np(&attributes, terminalFd);
+        }
+#else
+        // launch() hands the terminal over from the parent instead
+        (void) terminalFd;
+#endif
+    }
+    posix_spawnattr_setflags(&attributes, flags);
+
+    // The child execs before posix_spawn() returns, that is part of this stage
+    pid_t childPid;
+    uint64_t start = Metrics::now();
+    int error = posix_spawn(&childPid, commandPath.c_str(), &actions, &attributes, cmd->getArgv(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+    Metrics::recordSince(Metrics::LAUNCH, start);
+
+    if (error != 0) {
+        std::cerr << SimpleCommand::describeErrno(error) << std::endl;
+        return -1;
+    }
+
+    return childPid;
+}
@@ -0,0 +1,64 @@
+#ifndef SHELL_LAUNCHER_H
+#define SHELL_LAUNCHER_H
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+class Shell;
+class SimpleCommand;
+
+/**
+ * Starts the process for a single stage of a pipeline.
+ *
+ * Two backends are available:
+ *  - FORK:  the classic fork() followed by SimpleCommand::execute() in the child.
+ *  - SPAWN: posix_spawn(), which glibc implements with clone(CLONE_VM|CLONE_VFORK).
+ *           The child shares our address space until it execs, so no page tables
+ *           are copied and no copy-on-write faults are taken, no matter how big the
+ *           ANTLR runtime and DFA heap of the shell have grown. The pipe layout and
+ *           IORedirects are turned into spawn file actions up front.
+ *
+ * Builtins in a pipeline have to run our own code in the child, so they always
+ * use FORK (a builtin on its own runs in the shell, see BuiltinTable).
+ * With job control the child is also put in the process group of its pipeline
+ * and, for foreground pipelines, given the terminal.
+ * The backend can be selected at runtime with the SHELL_LAUNCHER environment
+ * variable ("fork" or "spawn"); SPAWN is the default.
+ */
+class Launcher {
+public:
+    enum Backend {
+        FORK, SPAWN
+    };
+
+private:
+    static Backend backend;
+
+public:
+    static Backend getBackend() { return backend; }
+
+    static void setBackend(Backend b) { backend = b; }
+
+    static const char *getBackendName(Backend b);
+
+    static bool parseBackend(std::string const &name, Backend *pBackend);
+
+    static void configureFromEnvironment();
+
+    static pid_t launch(SimpleCommand *cmd, Shell *pShell, int inFd, int outFd, int heldFd,
+                        pid_t pgid, bool foreground);
+
+private:
+    static pid_t launchProgram(SimpleCommand *cmd, Shell *pShell, int inFd, int outFd, int heldFd,
+                               pid_t pgid, int terminalFd);
+
+    static pid_t launchFork(SimpleCommand *cmd, Shell *pShell, std::string const &commandPath,
+                            int inFd, int outFd, int heldFd, pid_t pgid, int terminalFd);
+
+    static pid_t launchSpawn(SimpleCommand *cmd, std::string const &commandPath,
+                             int inFd, int outFd, pid_t pgid, int terminalFd);
+};
+
+
+#endif //SHELL_LAUNCHER_H
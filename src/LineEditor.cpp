@@ -0,0 +1,285 @@
+#include <cerrno>
+#include <iostream>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "FdWriter.h"
+#include "LineEditor.h"
+#include "Shell.h"
+
+// Keys that arrive as escape sequences, above the range of a byte
+enum {
+    KEY_UP = 1000, KEY_DOWN, KEY_LEFT, KEY_RIGHT, KEY_HOME, KEY_END, KEY_DELETE, KEY_UNKNOWN
+};
+
+static const int CTRL_A = 1, CTRL_B = 2, CTRL_C = 3, CTRL_D = 4, CTRL_E = 5, CTRL_F = 6, CTRL_G = 7,
+        CTRL_H = 8, CTRL_K = 11, CTRL_L = 12, CTRL_N = 14, CTRL_P = 16, CTRL_R = 18, CTRL_U = 21,
+        ESCAPE = 27, BACKSPACE = 127;
+
+static bool isPrintable(int key) {
+    return key >= 32 && key < 256 && key != BACKSPACE;
+}
+
+LineEditor::LineEditor(Shell *pShell)
+        : pShell(pShell), interactive(isatty(STDIN_FILENO) && isatty(STDOUT_FILENO)), cursor(0) {
+}
+
+/**
+ * Print the prompt and read a line
+ * @param prompt the prompt
+ * @param pLine receives the line without its newline
+ * @return false at the end of the input
+ */
+bool LineEditor::readLine(std::string const &prompt, std::string *pLine) {
+    if (interactive) {
+        struct termios original;
+        if (tcgetattr(STDIN_FILENO, &original) == 0) {
+            struct termios raw = original;
+            raw.c_iflag &= ~(ICRNL | IXON);
+            raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+            raw.c_cc[VMIN] = 1;
+            raw.c_cc[VTIME] = 0;
+            tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+
+            bool ok = readRaw(prompt, pLine);
+
+            tcsetattr(STDIN_FILENO, TCSADRAIN, &original);
+            return ok;
+        }
+    }
+
+    std::cout << prompt;
+    std::flush(std::cout);
+    return static_cast<bool>(std::getline(std::cin, *pLine));
+}
+
+bool LineEditor::readRaw(std::string const &prompt, std::string *pLine) {
+    HistoryStore &history = pShell->getHistory();
+    size_t historyIndex = history.size();
+    std::string edited;    //< The new line while walking the history.
+
+    buffer.clear();
+    cursor = 0;
+    std::cout.flush();
+    refresh(prompt);
+
+    while (true) {
+        int key = readKey();
+        switch (key) {
+            case -1:
+                return false;
+            case '\r':
+            case '\n':
+                *pLine = buffer;
+                write(STDOUT_FILENO, "\r\n", 2);
+                return true;
+            case CTRL_C:
+                write(STDOUT_FILENO, "^C\r\n", 4);
+                buffer.clear();
+                cursor = 0;
+                historyIndex = history.size();
+                break;
+            case CTRL_D:
+                if (buffer.empty()) {
+                    write(STDOUT_FILENO, "\r\n", 2);
+                    return false;
+                }
+                // fall through
+            case KEY_DELETE:
+                if (cursor < buffer.size())
+                    buffer.erase(cursor, 1);
+                break;
+            case BACKSPACE:
+            case CTRL_H:
+                if (cursor > 0)
+                    buffer.erase(--cursor, 1);
+                break;
+            case CTRL_A:
+            case KEY_HOME:
+                cursor = 0;
+                break;
+            case CTRL_E:
+            case KEY_END:
+                cursor = buffer.size();
+                break;
+            case CTRL_B:
+            case KEY_LEFT:
+                if (cursor > 0)
+                    cursor--;
+                break;
+            case CTRL_F:
+            case KEY_RIGHT:
+                if (cursor < buffer.size())
+                    cursor++;
+                break;
+            case CTRL_K:
+                buffer.erase(cursor);
+                break;
+            case CTRL_U:
+                buffer.erase(0, cursor);
+                cursor = 0;
+                break;
+            case CTRL_L:
+                write(STDOUT_FILENO, "\x1b[H\x1b[2J", 7);
+                break;
+            case CTRL_P:
+            case KEY_UP:
+            case CTRL_N:
+            case KEY_DOWN: {
+                bool up = key == CTRL_P || key == KEY_UP;
+                if (up ? historyIndex == 0 : historyIndex == history.size())
+                    break;
+                if (historyIndex == history.size())
+                    edited = buffer;
+                historyIndex += up ? -1 : 1;
+                if (historyIndex == history.size())
+                    buffer = edited;
+                else
+                    history.get(historyIndex, &buffer);
+                cursor = buffer.size();
+                break;
+            }
+            case CTRL_R:
+                if (reverseSearch()) {
+                    *pLine = buffer;
+                    refresh(prompt);
+                    write(STDOUT_FILENO, "\r\n", 2);
+                    return true;
+                }
+                break;
+            default:
+                if (isPrintable(key))
+                    buffer.insert(cursor++, 1, static_cast<char>(key));
+                break;
+        }
+        refresh(prompt);
+    }
+}
+
+/**
+ * Incremental search backwards through the history, started by Ctrl-R.
+ * Typing extends the query, Ctrl-R again goes to the next older match, Ctrl-G
+ * or Ctrl-C give up. Any other key puts the match in the buffer for editing.
+ * @return true if the match was accepted with Enter and should run right away
+ */
+bool LineEditor::reverseSearch() {
+    HistoryStore &history = pShell->getHistory();
+    HistorySearch &search = pShell->getHistorySearch();
+    std::string query;
+    std::string match = buffer;
+    long matchIndex = -1;
+    bool failed = false;
+
+    while (true) {
+        FdWriter out(STDOUT_FILENO);
+        out << "\r" << (failed ? "(failed reverse-i-search)`" : "(reverse-i-search)`")
+            << query << "': " << match << "\x1b[K";
+        out.flush();
+
+        int key = readKey();
+        long found = -2;
+        if (key == -1 || key == CTRL_G || key == CTRL_C) {
+            return false;
+        } else if (key == '\r' || key == '\n') {
+            buffer = match;
+            cursor = buffer.size();
+            return true;
+        } else if (key == CTRL_R) {
+            if (!query.empty())
+                found = search.findBefore(query, matchIndex == -1 ? history.size() : static_cast<size_t>(matchIndex));
+        } else if (key == BACKSPACE || key == CTRL_H) {
+            if (!query.empty()) {
+                query.erase(query.size() - 1);
+                found = query.empty() ? -2 : search.findBefore(query, history.size());
+            }
+        } else if (isPrintable(key)) {
+            // a longer query can still match the current entry
+            query.push_back(static_cast<char>(key));
+            found = search.findBefore(query, matchIndex == -1 ? history.size() : static_cast<size_t>(matchIndex) + 1);
+        } else {
+            buffer = match;
+            cursor = buffer.size();
+            return false;
+        }
+
+        if (found >= 0) {
+            matchIndex = found;
+            history.get(static_cast<size_t>(found), &match);
+            failed = false;
+        } else if (found == -1) {
+            failed = true;
+            write(STDOUT_FILENO, "\a", 1);
+        }
+    }
+}
+
+/**
+ * Redraw the line and put the cursor where it belongs
+ */
+void LineEditor::refresh(std::string const &prompt) {
+    FdWriter out(STDOUT_FILENO);
+    out << "\r" << prompt << buffer << "\x1b[K";
+    if (cursor < buffer.size())
+        out << "\x1b[" << (buffer.size() - cursor) << "D";
+}
+
+/**
+ * Read one key press, decoding the escape sequences of the special keys
+ * @return the byte, one of the KEY_ values, or -1 at the end of the input
+ */
+int LineEditor::readKey() {
+    unsigned char c;
+    ssize_t n;
+    do {
+        n = read(STDIN_FILENO, &c, 1);
+    } while (n < 0 && errno == EINTR);
+    if (n != 1)
+        return -1;
+    if (c != ESCAPE)
+        return c;
+
+    // A sequence arrives in one go, a lone escape does not have a follow-up
+    struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+    unsigned char sequence[3];
+    if (poll(&pfd, 1, 50) != 1 || read(STDIN_FILENO, &sequence[0], 1) != 1)
+        return ESCAPE;
+    if (sequence[0] != '[' && sequence[0] != 'O')
+        return KEY_UNKNOWN;
+    if (read(STDIN_FILENO, &sequence[1], 1) != 1)
+        return KEY_UNKNOWN;
+
+    if (sequence[1] >= '0' && sequence[1] <= '9') {
+        // ESC [ n ~
+        if (read(STDIN_FILENO, &sequence[2], 1) != 1 || sequence[2] != '~')
+            return KEY_UNKNOWN;
+        switch (sequence[1]) {
+            case '1':
+            case '7':
+                return KEY_HOME;
+            case '3':
+                return KEY_DELETE;
+            case '4':
+            case '8':
+                return KEY_END;
+            default:
+                return KEY_UNKNOWN;
+        }
+    }
+
+    switch (sequence[1]) {
+        case 'A':
+            return KEY_UP;
+        case 'B':
+            return KEY_DOWN;
+        case 'C':
+            return KEY_RIGHT;
+        case 'D':
+            return KEY_LEFT;
+        case 'H':
+            return KEY_HOME;
+        case 'F':
+            return KEY_END;
+        default:
+            return KEY_UNKNOWN;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef SHELL_LINEEDITOR_H
+#define SHELL_LINEEDITOR_H
+
+#include <string>
+
+class Shell;
+
+/**
+ * Reads command lines.
+ *
+ * On a terminal the line is edited in raw mode: the cursor keys, Home/End,
+ * Backspace/Delete, Ctrl-A/E/K/U/L, Up/Down to walk the history and Ctrl-R for
+ * an incremental reverse search through it (see HistorySearch). Ctrl-C throws
+ * the line away and Ctrl-D on an empty line ends the input.
+ * The terminal is only in raw mode while a line is being read, so commands
+ * always start with the terminal settings the user had.
+ * When stdin is not a terminal lines are simply read with std::getline().
+ */
+class LineEditor {
+private:
+    Shell *pShell;
+    bool interactive;
+    std::string buffer;
+    size_t cursor;
+
+public:
+    explicit LineEditor(Shell *pShell);
+
+    bool readLine(std::string const &prompt, std::string *pLine);
+
+private:
+    bool readRaw(std::string const &prompt, std::string *pLine);
+
+    bool reverseSearch();
+
+    void refresh(std::string const &prompt);
+
+    int readKey();
+};
+
+
+#endif //SHELL_LINEEDITOR_H
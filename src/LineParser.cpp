@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <CommonToken.h>
+#include <Exceptions.h>
+#include <atn/ParserATNSimulator.h>
+#include "CommandVisitor.h"
+#include "Metrics.h"
+#include "LineParser.h"
+#include "Sequence.h"
+
+void LineParser::ErrorListener::syntaxError(antlr4::Recognizer * /*recognizer*/,
+                                            antlr4::Token * /*offendingSymbol*/,
+                                            size_t line, size_t charPositionInLine, const std::string &msg,
+                                            std::exception_ptr /*e*/) {
+    std::cerr << "ERROR in input - line " << line << ":" << charPositionInLine << " " << msg << std::endl;
+    errorLines.push_back(line);
+}
+
+/**
+ * @return true if an error was reported on the given line
+ */
+bool LineParser::ErrorListener::hasSeenError(size_t line) const {
+    return std::find(errorLines.begin(), errorLines.end(), line) != errorLines.end();
+}
+
+/**
+ * Drop the errors of the lines before the given one, they have been dealt with
+ */
+void LineParser::ErrorListener::forgetBefore(size_t line) {
+    errorLines.erase(std::remove_if(errorLines.begin(), errorLines.end(),
+                                    [line](size_t errorLine) { return errorLine < line; }),
+                     errorLines.end());
+}
+
+static double microsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+LineParser::LineParser(std::string const &homeDirectory)
+        : home(homeDirectory), statements(&lexer), tokens(&lexer), parser(&tokens),
+          bailStrategy(std::make_shared<antlr4::BailErrorStrategy>()),
+          defaultStrategy(std::make_shared<antlr4::DefaultErrorStrategy>()),
+          last(), total(), lines(0), sllParses(0), llParses(0), reportTiming(false) {
+    lexer.setErrorListener(&errorListener);
+    parser.removeErrorListeners();
+}
+
+/**
+ * Parse a line
+ * @param line the line
+ * @return a new Sequence owned by the caller, or nullptr if the line has errors
+ */
+Sequence *LineParser::parse(std::string const &line) {
+    errorListener.reset();
+
+    // Point everything at the new text, this rewinds the lexer, empties the
+    // token buffer and drops the parse tree of the previous line
+    lexer.setInput(line);
+    tokens.setTokenSource(&lexer);
+    parser.setTokenStream(&tokens);
+
+    return build(0);
+}
+
+/**
+ * Start reading the statements of a script, see nextStatement()
+ * @param text the whole script
+ * @param name the name of the script for error messages
+ */
+void LineParser::startScript(std::string const &text, std::string const &name) {
+    lexer.setInput(text, name);
+    statements.reset();
+    errorListener.reset();
+}
+
+/**
+ * Parse the next line of the script. Empty lines and comments (#) are skipped.
+ * @param pSequence receives a new Sequence owned by the caller, or nullptr if
+ *                  the line has errors
+ * @return false at the end of the script
+ */
+bool LineParser::nextStatement(Sequence **pSequence) {
+    if (!statements.startStatement())
+        return false;
+
+    // An error on this line may have been found while looking for the end of
+    // the previous statement, so only the older ones are dropped
+    size_t line = statements.getStatementLine();
+    errorListener.forgetBefore(line);
+    tokens.setTokenSource(&statements);
+    parser.setTokenStream(&tokens);
+
+    *pSequence = build(line);
+    return true;
+}
+
+/**
+ * Lex and parse whatever the token stream now delivers and turn it into a Sequence
+ * @param line the line of the statement in a script, only errors on it count, or 0 for any error
+ */
+Sequence *LineParser::build(size_t line) {
+    // The lexer combines characters into meaningful tokens
+    auto start = std::chrono::steady_clock::now();
+    tokens.fill();
+    last.lexMicros = microsSince(start);
+
+    // The parser then uses these tokens to deduce meaning of the line
+    start = std::chrono::steady_clock::now();
+    unsigned long llBefore = llParses;
+    ShellGrammarParser::SequenceContext *parseTree = parseSequence();
+    last.parseMicros = microsSince(start);
+
+    // Take apart the line entered into sequences, pipelines and commands
+    Sequence *sequence = nullptr;
+    start = std::chrono::steady_clock::now();
+    if (line == 0 ? !errorListener.hasSeenError() : !errorListener.hasSeenError(line)) {
+        CommandVisitor visitor(home);
+        sequence = visitor.visitSequence(parseTree);
+    }
+    last.buildMicros = microsSince(start);
+
+    lines++;
+    total.lexMicros += last.lexMicros;
+    total.parseMicros += last.parseMicros;
+    total.buildMicros += last.buildMicros;
+
+    // The stages ran back to back and the last one has just ended
+    if (Metrics::isEnabled()) {
+        uint64_t end = Metrics::now();
+        auto lexNanos = static_cast<uint64_t>(last.lexMicros * 1e3);
+        auto parseNanos = static_cast<uint64_t>(last.parseMicros * 1e3);
+        auto buildNanos = static_cast<uint64_t>(last.buildMicros * 1e3);
+        Metrics::record(Metrics::BUILD, end - buildNanos, buildNanos);
+        Metrics::record(Metrics::PARSE, end - buildNanos - parseNanos, parseNanos);
+        Metrics::record(Metrics::LEX, end - buildNanos - parseNanos - lexNanos, lexNanos);
+    }
+
+    if (reportTiming) {
+        fprintf(stderr, "timing: lex %.1f us, parse %.1f us (%s), build %.1f us\n",
+                last.lexMicros, last.parseMicros, llParses != llBefore ? "ll" : "sll", last.buildMicros);
+    }
+    return sequence;
+}
+
+/**
+ * Parse the tokens, first with SLL prediction and bailing out at the first
+ * error, then, if that failed, again from the start with full LL prediction
+ * and error reporting.
+ * @return the parse tree, owned by the parser
+ */
+ShellGrammarParser::SequenceContext *LineParser::parseSequence() {
+    auto *interpreter = parser.getInterpreter<antlr4::atn::ParserATNSimulator>();
+
+    // Without listeners, reportError() of the bail strategy stays quiet
+    interpreter->setPredictionMode(antlr4::atn::PredictionMode::SLL);
+    parser.removeErrorListeners();
+    parser.setErrorHandler(bailStrategy);
+    parser.reset();
+    try {
+        ShellGrammarParser::SequenceContext *parseTree = parser.sequence();
+        sllParses++;
+        return parseTree;
+    } catch (antlr4::ParseCancellationException &) {
+    }
+
+    // Rewind the tokens and drop the partial tree
+    interpreter->setPredictionMode(antlr4::atn::PredictionMode::LL);
+    parser.addErrorListener(&errorListener);
+    parser.setErrorHandler(defaultStrategy);
+    parser.reset();
+    llParses++;
+    return parser.sequence();
+}
+
+/**
+ * Skip to the first token of the next statement, past empty lines and comments
+ * @return false if there is nothing left
+ */
+bool LineParser::StatementSource::startStatement() {
+    while (true) {
+        // Throw away what the parser did not take of the last statement
+        while (line != 0 && peek()->getType() != antlr4::Token::EOF && pending->getLine() == line)
+            pending.reset();
+
+        antlr4::Token *first = peek();
+        if (first->getType() == antlr4::Token::EOF)
+            return false;
+
+        line = first->getLine();
+        if (first->getText()[0] != '#')
+            return true;
+    }
+}
+
+std::unique_ptr<antlr4::Token> LineParser::StatementSource::nextToken() {
+    antlr4::Token *next = peek();
+    if (next->getType() != antlr4::Token::EOF && next->getLine() == line)
+        return std::move(pending);
+
+    // The end of this statement
+    std::unique_ptr<antlr4::CommonToken> eof(new antlr4::CommonToken(antlr4::Token::EOF));
+    eof->setLine(line);
+    eof->setCharPositionInLine(next->getType() == antlr4::Token::EOF ? 0 : next->getCharPositionInLine());
+    return eof;
+}
+
+antlr4::Token *LineParser::StatementSource::peek() {
+    if (pending == nullptr)
+        pending = source->nextToken();
+    return pending.get();
+}
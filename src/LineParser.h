@@ -0,0 +1,158 @@
+#ifndef SHELL_LINEPARSER_H
+#define SHELL_LINEPARSER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <BailErrorStrategy.h>
+#include <BaseErrorListener.h>
+#include <CommonTokenStream.h>
+#include <DefaultErrorStrategy.h>
+#include <TokenSource.h>
+#include "../gen/ShellGrammarParser.h"
+#include "ShellLexer.h"
+
+class Sequence;
+
+/**
+ * Turns a line of input into a Sequence.
+ *
+ * The lexer, token stream, parser and error listener are created once and
+ * reset for every line, so a line does not pay for constructing them
+ * again and the token buffer and the other vectors keep their capacity.
+ * The tokens come from ShellLexer, which produces the same tokens as the
+ * generated ShellGrammarLexer at a fraction of the cost.
+ * Lines are parsed in two stages. The first uses SLL prediction, which does
+ * not have to follow the rule invocations of the parser, and gives up at the
+ * first syntax error. Only when it gives up is the line parsed again with full
+ * LL prediction and the usual error recovery and reporting. For a correct line
+ * SLL finds the same parse, so nearly every line only takes the first stage;
+ * how many needed the second one is counted.
+ * The time spent lexing, parsing and building the Sequence is measured for
+ * every line and can be reported on stderr (SHELL_TIMING in the environment).
+ *
+ * For scripts the whole text is lexed as one token stream instead. The grammar
+ * only knows a single line, so the tokens are handed to the parser one line at
+ * a time: an end of file is inserted where the next line starts, and the
+ * parser is run again for the next statement. Each statement is parsed only
+ * when the previous one has been executed. Finding the end of a statement
+ * lexes the first token of the next line, so errors are kept with their line
+ * and a statement is only rejected for errors on its own line.
+ */
+class LineParser {
+public:
+    struct Timing {
+        double lexMicros;
+        double parseMicros;
+        double buildMicros;
+    };
+
+private:
+    class ErrorListener : public antlr4::BaseErrorListener {
+        std::vector<size_t> errorLines;  //< The line of every error since the last reset.
+
+    public:
+        ErrorListener()
+                : antlr4::BaseErrorListener() {}
+
+        bool hasSeenError() const { return !errorLines.empty(); }
+
+        bool hasSeenError(size_t line) const;
+
+        void reset() { errorLines.clear(); }
+
+        void forgetBefore(size_t line);
+
+        void syntaxError(antlr4::Recognizer *recognizer, antlr4::Token *offendingSymbol,
+                         size_t line, size_t charPositionInLine, const std::string &msg,
+                         std::exception_ptr e) override;
+    };
+
+    /**
+     * Passes on the tokens of the lexer, but ends every line with an EOF token
+     * until the next statement is started.
+     */
+    class StatementSource : public antlr4::TokenSource {
+        antlr4::TokenSource *source;
+        std::unique_ptr<antlr4::Token> pending;  //< The next token of the lexer.
+        size_t line;                             //< The line of the current statement.
+
+    public:
+        explicit StatementSource(antlr4::TokenSource *source)
+                : source(source), line(0) {}
+
+        void reset() {
+            pending.reset();
+            line = 0;
+        }
+
+        size_t getStatementLine() const { return line; }
+
+        bool startStatement();
+
+        std::unique_ptr<antlr4::Token> nextToken() override;
+
+        size_t getLine() const override { return source->getLine(); }
+
+        size_t getCharPositionInLine() override { return source->getCharPositionInLine(); }
+
+        antlr4::CharStream *getInputStream() override { return source->getInputStream(); }
+
+        std::string getSourceName() override { return source->getSourceName(); }
+
+        Ref<antlr4::TokenFactory<antlr4::CommonToken>> getTokenFactory() override {
+            return source->getTokenFactory();
+        }
+
+    private:
+        antlr4::Token *peek();
+    };
+
+    ErrorListener errorListener;
+    std::string home;              //< Home directory that '~' stands for.
+    ShellLexer lexer;
+    StatementSource statements;
+    antlr4::CommonTokenStream tokens;
+    ShellGrammarParser parser;
+    Ref<antlr4::BailErrorStrategy> bailStrategy;
+    Ref<antlr4::DefaultErrorStrategy> defaultStrategy;
+    Timing last;
+    Timing total;
+    unsigned long lines;
+    unsigned long sllParses;       //< Lines that only needed SLL prediction.
+    unsigned long llParses;        //< Lines that were parsed again with full LL prediction.
+    bool reportTiming;
+
+public:
+    explicit LineParser(std::string const &homeDirectory);
+
+    LineParser(LineParser const &) = delete;
+
+    LineParser &operator=(LineParser const &) = delete;
+
+    Sequence *parse(std::string const &line);
+
+    void startScript(std::string const &text, std::string const &name);
+
+    bool nextStatement(Sequence **pSequence);
+
+    void setReportTiming(bool report) { reportTiming = report; }
+
+    const Timing &getLastTiming() const { return last; }
+
+    const Timing &getTotalTiming() const { return total; }
+
+    unsigned long getLineCount() const { return lines; }
+
+    unsigned long getSllParses() const { return sllParses; }
+
+    unsigned long getLlParses() const { return llParses; }
+
+private:
+    Sequence *build(size_t line);
+
+    ShellGrammarParser::SequenceContext *parseSequence();
+};
+
+
+#endif //SHELL_LINEPARSER_H
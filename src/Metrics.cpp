@@ -0,0 +1,336 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Metrics.h"
+
+static const char RING_MAGIC[8] = {'S', 'H', 'R', 'I', 'N', 'G', '1', '\0'};
+static const uint64_t RING_CAPACITY = 65536;
+
+/**
+ * The start of the ring file, followed by the records
+ */
+struct Metrics::RingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t capacity;
+    uint64_t next;        //< Number of records ever written, the slot is next % capacity.
+};
+
+struct Metrics::RingRecord {
+    uint64_t start;       //< Monotonic clock in nanoseconds.
+    uint64_t nanos;
+    uint32_t pid;
+    uint32_t stage;
+};
+
+bool Metrics::enabled = false;
+Metrics::Histogram *Metrics::histograms = nullptr;
+Metrics::RingHeader *Metrics::ring = nullptr;
+size_t Metrics::ringBytes = 0;
+
+static const char *STAGE_NAMES[] = {
+        "read", "lex", "parse", "build", "lookup", "redirect", "launch", "exec", "wait", "history"
+};
+
+const char *Metrics::getStageName(Stage stage) {
+    return STAGE_NAMES[stage];
+}
+
+/**
+ * Turn metrics on if SHELL_METRICS (anything but "0") or SHELL_METRICS_RING is set
+ */
+void Metrics::configureFromEnvironment() {
+    const char *ringPath = getenv("SHELL_METRICS_RING");
+    if (ringPath != nullptr && *ringPath != '\0') {
+        std::string error;
+        if (!openRing(ringPath, &error))
+            std::cerr << "SHELL_METRICS_RING: " << error << std::endl;
+        enable();
+        return;
+    }
+
+    const char *value = getenv("SHELL_METRICS");
+    if (value != nullptr && strcmp(value, "0") != 0)
+        enable();
+}
+
+/**
+ * Start recording, the histograms are created the first time
+ * @return false if there was no memory for them
+ */
+bool Metrics::enable() {
+    if (histograms == nullptr) {
+        void *memory = mmap(nullptr, STAGE_COUNT * sizeof(Histogram), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            std::cerr << "metrics: " << strerror(errno) << std::endl;
+            return false;
+        }
+        histograms = static_cast<Histogram *>(memory);
+        reset();
+    }
+    enabled = true;
+    return true;
+}
+
+/**
+ * Also write every sample to a file. A ring that is already in the file is
+ * continued, so the samples of an earlier session stay until overwritten.
+ * @param path the file
+ * @param pError receives the reason if the file can't be used
+ * @return false on errors
+ */
+bool Metrics::openRing(std::string const &path, std::string *pError) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        *pError = path + ": " + strerror(errno);
+        return false;
+    }
+
+    size_t bytes = sizeof(RingHeader) + RING_CAPACITY * sizeof(RingRecord);
+    struct stat info;
+    bool existing = fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) == bytes;
+    if (!existing && ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        *pError = path + ": " + strerror(errno);
+        close(fd);
+        return false;
+    }
+
+    void *memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        *pError = path + ": " + strerror(errno);
+        return false;
+    }
+
+    auto *header = static_cast<RingHeader *>(memory);
+    if (!existing || memcmp(header->magic, RING_MAGIC, sizeof(RING_MAGIC)) != 0 ||
+        header->recordSize != sizeof(RingRecord) || header->capacity != RING_CAPACITY) {
+        memset(memory, 0, bytes);
+        memcpy(header->magic, RING_MAGIC, sizeof(RING_MAGIC));
+        header->version = 1;
+        header->recordSize = sizeof(RingRecord);
+        header->capacity = RING_CAPACITY;
+    }
+
+    if (ring != nullptr)
+        munmap(ring, ringBytes);
+    ring = header;
+    ringBytes = bytes;
+    return true;
+}
+
+/**
+ * Index of the bucket that counts a value: exact below SUB_BUCKETS, then
+ * HALF_BUCKETS buckets for every power of two.
+ */
+size_t Metrics::bucketIndex(uint64_t value) {
+    if (value < SUB_BUCKETS)
+        return static_cast<size_t>(value);
+    if (value >> MAX_VALUE_BITS)
+        value = (uint64_t(1) << MAX_VALUE_BITS) - 1;
+
+    unsigned shift = 63 - __builtin_clzll(value) - (SUB_BUCKET_BITS - 1);
+    uint64_t subBucket = value >> shift;       // HALF_BUCKETS .. SUB_BUCKETS - 1
+    return static_cast<size_t>(SUB_BUCKETS + (shift - 1) * HALF_BUCKETS + (subBucket - HALF_BUCKETS));
+}
+
+/**
+ * @return the largest value that is counted in a bucket
+ */
+uint64_t Metrics::bucketHighest(size_t index) {
+    if (index < SUB_BUCKETS)
+        return index;
+    unsigned shift = static_cast<unsigned>((index - SUB_BUCKETS) / HALF_BUCKETS + 1);
+    uint64_t subBucket = (index - SUB_BUCKETS) % HALF_BUCKETS + HALF_BUCKETS;
+    return ((subBucket + 1) << shift) - 1;
+}
+
+/**
+ * Record a sample. Forked children record into the same histograms, so
+ * everything is updated atomically.
+ * @param stage what was measured
+ * @param start when it started, from now()
+ * @param nanos how long it took
+ */
+void Metrics::record(Stage stage, uint64_t start, uint64_t nanos) {
+    if (!enabled)
+        return;
+
+    Histogram &histogram = histograms[stage];
+    __atomic_fetch_add(&histogram.count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram.sum, nanos, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram.buckets[bucketIndex(nanos)], 1, __ATOMIC_RELAXED);
+
+    uint64_t seen = __atomic_load_n(&histogram.min, __ATOMIC_RELAXED);
+    while (nanos < seen && !__atomic_compare_exchange_n(&histogram.min, &seen, nanos, true,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    seen = __atomic_load_n(&histogram.max, __ATOMIC_RELAXED);
+    while (nanos > seen && !__atomic_compare_exchange_n(&histogram.max, &seen, nanos, true,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    if (ring != nullptr) {
+        uint64_t slot = __atomic_fetch_add(&ring->next, 1, __ATOMIC_RELAXED) % ring->capacity;
+        RingRecord &record = reinterpret_cast<RingRecord *>(ring + 1)[slot];
+        record.start = start;
+        record.nanos = nanos;
+        record.pid = static_cast<uint32_t>(getpid());
+        record.stage = stage;
+    }
+}
+
+uint64_t Metrics::getCount(Stage stage) {
+    return histograms == nullptr ? 0 : histograms[stage].count;
+}
+
+/**
+ * @param percentile 0 to 100
+ * @return the value below which the given percentage of the samples of a stage
+ *         fall, in nanoseconds and rounded up to the end of its bucket
+ */
+uint64_t Metrics::getPercentile(Stage stage, double percentile) {
+    if (histograms == nullptr || histograms[stage].count == 0)
+        return 0;
+
+    const Histogram &histogram = histograms[stage];
+    auto wanted = static_cast<uint64_t>(std::ceil(percentile / 100.0 * histogram.count));
+    if (wanted == 0)
+        return histogram.min;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        seen += histogram.buckets[i];
+        if (seen >= wanted)
+            return std::min(bucketHighest(i), histogram.max);
+    }
+    return histogram.max;
+}
+
+/**
+ * Forget all samples, e.g. for 'stats -c'. The ring file is kept.
+ */
+void Metrics::reset() {
+    if (histograms == nullptr)
+        return;
+    memset(histograms, 0, STAGE_COUNT * sizeof(Histogram));
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+        histograms[stage].min = UINT64_MAX;
+}
+
+/**
+ * Print count, percentiles and mean of every stage in microseconds
+ */
+void Metrics::print(std::ostream &out) {
+    char line[160];
+    snprintf(line, sizeof(line), "%-10s %8s %10s %10s %10s %10s %10s %10s %10s\n",
+             "stage", "count", "min us", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us", "mean us");
+    out << line;
+
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        auto stage = static_cast<Stage>(i);
+        uint64_t count = getCount(stage);
+        if (count == 0)
+            continue;
+
+        const Histogram &histogram = histograms[stage];
+        snprintf(line, sizeof(line), "%-10s %8llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                 getStageName(stage), static_cast<unsigned long long>(count),
+                 histogram.min / 1e3, getPercentile(stage, 50) / 1e3, getPercentile(stage, 90) / 1e3,
+                 getPercentile(stage, 99) / 1e3, getPercentile(stage, 99.9) / 1e3,
+                 histogram.max / 1e3, static_cast<double>(histogram.sum) / count / 1e3);
+        out << line;
+    }
+    if (!enabled)
+        out << "(metrics are off, 'stats on' starts recording)\n";
+}
+
+/**
+ * Print the histograms in the Prometheus text format, as one summary with a
+ * stage label
+ */
+void Metrics::printPrometheus(std::ostream &out) {
+    static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+    char line[160];
+
+    out << "# HELP shell_stage_duration_seconds Time spent in each stage of running a command line.\n";
+    out << "# TYPE shell_stage_duration_seconds summary\n";
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        auto stage = static_cast<Stage>(i);
+        uint64_t count = getCount(stage);
+        for (double quantile : QUANTILES) {
+            snprintf(line, sizeof(line), "shell_stage_duration_seconds{stage=\"%s\",quantile=\"%g\"} %.9g\n",
+                     getStageName(stage), quantile, getPercentile(stage, quantile * 100) / 1e9);
+            out << line;
+        }
+        snprintf(line, sizeof(line), "shell_stage_duration_seconds_sum{stage=\"%s\"} %.9g\n",
+                 getStageName(stage), count == 0 ? 0.0 : histograms[stage].sum / 1e9);
+        out << line;
+        snprintf(line, sizeof(line), "shell_stage_duration_seconds_count{stage=\"%s\"} %llu\n",
+                 getStageName(stage), static_cast<unsigned long long>(count));
+        out << line;
+    }
+}
+
+/**
+ * Print the samples in a ring file, oldest first. The file may come from a
+ * shell that has crashed; a record it was writing at that moment can be torn.
+ * @param path the ring file
+ * @param out where to print
+ * @param pError receives the reason if the file isn't a ring
+ * @return false on errors
+ */
+bool Metrics::printRing(std::string const &path, std::ostream &out, std::string *pError) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        *pError = path + ": " + strerror(errno);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(RingHeader)) {
+        *pError = path + ": not a metrics ring";
+        close(fd);
+        return false;
+    }
+
+    auto bytes = static_cast<size_t>(info.st_size);
+    void *memory = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        *pError = path + ": " + strerror(errno);
+        return false;
+    }
+
+    const auto *header = static_cast<const RingHeader *>(memory);
+    if (memcmp(header->magic, RING_MAGIC, sizeof(RING_MAGIC)) != 0 || header->recordSize != sizeof(RingRecord) ||
+        header->capacity == 0 || sizeof(RingHeader) + header->capacity * sizeof(RingRecord) > bytes) {
+        *pError = path + ": not a metrics ring";
+        munmap(memory, bytes);
+        return false;
+    }
+
+    const auto *records = reinterpret_cast<const RingRecord *>(header + 1);
+    uint64_t next = header->next;
+    uint64_t first = next > header->capacity ? next - header->capacity : 0;
+    char line[128];
+    for (uint64_t i = first; i < next; i++) {
+        const RingRecord &record = records[i % header->capacity];
+        const char *name = record.stage < STAGE_COUNT ? getStageName(static_cast<Stage>(record.stage)) : "?";
+        snprintf(line, sizeof(line), "%llu %u %s %.1f\n", static_cast<unsigned long long>(record.start),
+                 record.pid, name, record.nanos / 1e3);
+        out << line;
+    }
+
+    munmap(memory, bytes);
+    return true;
+}
@@ -0,0 +1,116 @@
+#ifndef SHELL_METRICS_H
+#define SHELL_METRICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * Latency of every stage between reading a line and the next prompt: reading,
+ * lexing, parsing, building the Sequence, PATH lookup, redirect setup, starting
+ * the process, the child's work up to exec, waiting and writing the history.
+ *
+ * Every stage has a histogram in the style of HdrHistogram: values in
+ * nanoseconds are counted in buckets that are linear within each power of two,
+ * 64 to a power, so any percentile is accurate to within 1.6%. The
+ * histograms are in a shared anonymous mapping, so a forked child records
+ * the stages it runs itself (redirects, exec) in the same place as the shell.
+ * The histograms are shown by the stats builtin, which can also write them as
+ * Prometheus text.
+ *
+ * If SHELL_METRICS_RING names a file, every sample is also written to that
+ * file through a shared mapping. It holds the most recent samples, oldest
+ * overwritten first, and what made it into the page cache survives a crash of
+ * the shell; 'stats -d file' prints them.
+ *
+ * Everything is off unless SHELL_METRICS or SHELL_METRICS_RING is set, or
+ * 'stats on' was run. While off, now() returns 0 without reading the clock and
+ * recording a sample with a start of 0 returns right away, so an instrumented
+ * stage costs a test of one flag.
+ */
+class Metrics {
+public:
+    enum Stage {
+        READ, LEX, PARSE, BUILD, LOOKUP, REDIRECT, LAUNCH, EXEC, WAIT, HISTORY, STAGE_COUNT
+    };
+
+private:
+    static const unsigned SUB_BUCKET_BITS = 7;
+    static const uint64_t SUB_BUCKETS = 1u << SUB_BUCKET_BITS;         //< Exact counts below this.
+    static const uint64_t HALF_BUCKETS = SUB_BUCKETS / 2;              //< Buckets per power of two above it.
+    static const unsigned MAX_VALUE_BITS = 40;                         //< About 18 minutes.
+    static const size_t BUCKET_COUNT = SUB_BUCKETS + (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * HALF_BUCKETS;
+
+    struct Histogram {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t min;
+        uint64_t max;
+        uint64_t buckets[BUCKET_COUNT];
+    };
+
+    struct RingHeader;
+    struct RingRecord;
+
+    static bool enabled;
+    static Histogram *histograms;      //< STAGE_COUNT of them, shared with forked children.
+    static RingHeader *ring;
+    static size_t ringBytes;
+
+public:
+    static bool isEnabled() { return enabled; }
+
+    static void configureFromEnvironment();
+
+    static bool enable();
+
+    static void disable() { enabled = false; }
+
+    static bool openRing(std::string const &path, std::string *pError);
+
+    /**
+     * @return the monotonic time in nanoseconds, or 0 if metrics are off
+     */
+    static uint64_t now() {
+        if (!enabled)
+            return 0;
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    /**
+     * Record a stage that started at the given time and ends now
+     * @param start what now() returned when the stage started
+     */
+    static void recordSince(Stage stage, uint64_t start) {
+        if (start == 0 || !enabled)
+            return;
+        uint64_t end = now();
+        record(stage, start, end - start);
+    }
+
+    static void record(Stage stage, uint64_t start, uint64_t nanos);
+
+    static uint64_t getCount(Stage stage);
+
+    static uint64_t getPercentile(Stage stage, double percentile);
+
+    static void reset();
+
+    static void print(std::ostream &out);
+
+    static void printPrometheus(std::ostream &out);
+
+    static bool printRing(std::string const &path, std::ostream &out, std::string *pError);
+
+    static const char *getStageName(Stage stage);
+
+private:
+    static size_t bucketIndex(uint64_t value);
+
+    static uint64_t bucketHighest(size_t index);
+};
+
+
+#endif //SHELL_METRICS_H
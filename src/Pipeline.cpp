@@ -1,90 +1,96 @@
 #include <iostream>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
 #include <unistd.h>
-#include <wait.h>
+#include <fcntl.h>
+#include <sys/wait.h>
 #include "Pipeline.h"
 #include "SimpleCommand.h"
-#include "Sequence.h"
+#include "Launcher.h"
 
 /**
- * Destructor.
+ * Kill and reap the stages that were started before the pipeline failed, and
+ * take the terminal back if they were given it.
+ * @param pids the stages started so far
+ * @param pShell the shell session
  */
-Pipeline::~Pipeline() {
-    for (SimpleCommand *cmd : commands)
-        delete cmd;
+static void abandon(std::vector<pid_t> const &pids, Shell *pShell) {
+    for (pid_t pid : pids)
+        kill(pid, SIGKILL);
+    for (pid_t pid : pids)
+        waitpid(pid, nullptr, 0);
+
+    JobTable &jobs = pShell->getJobTable();
+    if (!pids.empty() && jobs.hasJobControl())
+        tcsetpgrp(jobs.getTerminalFd(), getpgrp());
 }
 
 /**
- * Executes the commands on this pipeline.
+ * Starts the commands on this pipeline.
+ * The stages are started straight from the shell process and are not waited for,
+ * that is up to the caller. With job control they share a process group that
+ * is led by the first stage.
+ * @param pShell the shell session
+ * @param foreground true if the pipeline gets the terminal
+ * @return the pids of all stages that could be started, none if the pipes could not be created
  */
-void Pipeline::execute(Sequence *pSequence) {
-    //pSequence->logPaths();
-
-    unsigned long numOfPipes = commands.size();
-    int status;
-    int pipes[2 * numOfPipes];
-
-    // first create all the pipes
-    for (int i = 0; i < numOfPipes; i++) {
-        if (pipe(pipes + i * 2) < 0) {
-            std::cerr << "PIPE FAILED" << std::endl;
-            exit(EXIT_FAILURE);
+std::vector<pid_t> Pipeline::execute(Shell *pShell, bool foreground) {
+    //pShell->logPaths();
+
+    std::vector<pid_t> pids;
+    pid_t pgid = pShell->getJobTable().hasJobControl() ? 0 : -1;
+
+    // Pipes are created one at a time, right before the stage that writes into
+    // them, and the parent closes every end as soon as it has been handed to its
+    // child. So we never hold more than three pipe ends and the n-1 pipes cost
+    // O(n) system calls in total. They are all close-on-exec: a child only dups
+    // its own two ends and everything else it inherited disappears on exec. A
+    // builtin does not exec, it is told which end we still hold so it can close
+    // it: that is the read end of its own output pipe.
+    int inFd = -1;
+    for (size_t i = 0; i != commands.size(); i++) {
+        // if not the last command the child will output to the next command,
+        // if not the first command the child will get his input from the previous command
+        int pipeFds[2] = {-1, -1};
+        if (i < commands.size() - 1 && pipe2(pipeFds, O_CLOEXEC) < 0) {
+            // e.g. EMFILE, the shell itself carries on
+            std::cerr << "Failed to create pipe: " << strerror(errno) << std::endl;
+            if (inFd != -1)
+                close(inFd);
+            abandon(pids, pShell);
+            return std::vector<pid_t>();
         }
+        int outFd = pipeFds[1];
 
-    }
-
-    int counter = 0;
-
-    for (std::vector<SimpleCommand>::size_type i = 0; i != commands.size(); i++) {
-        int childPid = fork();
-
-        if (childPid == 0) {
-
-            // if not the last command
-            // the child will output to the next command
-            if (i < commands.size() - 1) {
-                if (dup2(pipes[counter + 1], 1) < 0) {
-                    std::cerr << "Failed dup2" << std::endl;
-                    exit(EXIT_FAILURE);
-                }
-            }
-
-            // if not the first command
-            // the child will get his input from the previous command
-            if (i != 0) {
-                if (dup2(pipes[counter - 2], 0) < 0) {
-                    std::cerr << "Failed dup2" << std::endl;
-                    exit(EXIT_FAILURE);
-                }
-            }
-
-            // pipes are connected close them
-            for (int j = 0; j < 2 * numOfPipes; j++) {
-                close(pipes[j]);
-            }
-
-            commands[i]->execute(pSequence);
-            // Should never get here
-            exit(EXIT_FAILURE);
-        } else if (childPid < 0) {
-            std::cerr << "Failed to create child process" << std::endl;
-            exit(EXIT_FAILURE);
+        pid_t pid = Launcher::launch(&commands[i], pShell, inFd, outFd, pipeFds[0], pgid, foreground);
+        if (pid > 0) {
+            pids.push_back(pid);
+            if (pgid == 0)
+                pgid = pid;
         }
 
-        counter += 2;
-    }
-
-    // close pipes of parent
-    for (int j = 0; j < 2 * numOfPipes; j++) {
-        close(pipes[j]);
-    }
-
-
-    for (int j = 0; j < numOfPipes; j++) {
-        wait(&status);
+        // close pipes of parent
+        if (inFd != -1)
+            close(inFd);
+        if (outFd != -1)
+            close(outFd);
+        inFd = pipeFds[0];
     }
 
+    return pids;
 }
 
-const std::vector<SimpleCommand *> &Pipeline::getCommands() const {
-    return commands;
+/**
+ * The pipeline as it could have been typed, e.g. for 'jobs'
+ * @return the commands separated by pipes
+ */
+std::string Pipeline::toString() const {
+    std::string result;
+    for (const SimpleCommand &cmd : commands) {
+        if (!result.empty())
+            result.append(" | ");
+        result.append(cmd.toString());
+    }
+    return result;
 }
@@ -1,10 +1,12 @@
 #ifndef SHELL_PIPELINE_H
 #define SHELL_PIPELINE_H
 
+#include <string>
 #include <vector>
-#include "Sequence.h"
-
-class SimpleCommand;
+#include <sys/types.h>
+#include "Arena.h"
+#include "Shell.h"
+#include "SimpleCommand.h"
 
 /**
  * A pipeline, i.e. a set of simple commands of which the output of each previous
@@ -14,25 +16,26 @@ class SimpleCommand;
  */
 class Pipeline {
 private:
-    std::vector<SimpleCommand *> commands; //< The commands to execute
-    bool async;                            //< True if this the sequence does not need to wait for the
+    ArenaArray<SimpleCommand> commands; //< The commands to execute
+    bool async;                         //< True if this the sequence does not need to wait for the
     //  pipeline to finish.
 
 public:
     Pipeline()
             : commands(), async(false) {}
 
-    ~Pipeline();
+    explicit Pipeline(ArenaArray<SimpleCommand> const &cmds)
+            : commands(cmds), async(false) {}
 
     bool isAsync() const { return async; }
 
     void setAsync(bool b) { async = b; }
 
-    void addCommand(SimpleCommand *cmd) { commands.push_back(cmd); }
+    const ArenaArray<SimpleCommand> &getCommands() const { return commands; }
 
-    const std::vector<SimpleCommand *> &getCommands() const;
+    std::string toString() const;
 
-    void execute(Sequence *pSequence);
+    std::vector<pid_t> execute(Shell *pShell, bool foreground);
 };
 
 
@@ -0,0 +1,167 @@
+#include <cstdlib>
+#include "PlanCache.h"
+#include "Sequence.h"
+#include "ShellLexer.h"
+
+static const size_t DEFAULT_MAX_BYTES = 1 << 20;
+
+/**
+ * Size of a plan in memory: the sequence and its arena
+ */
+static size_t estimateSize(Sequence const &sequence) {
+    return sizeof(Sequence) + sequence.getArena().getBytes();
+}
+
+PlanCache::PlanCache()
+        : bytes(0), maxBytes(DEFAULT_MAX_BYTES), hits(0), misses(0), evictions(0) {
+    const char *max = getenv("SHELL_PLAN_CACHE_BYTES");
+    if (max != nullptr)
+        maxBytes = strtoul(max, nullptr, 10);
+}
+
+/**
+ * Look up the plan for a line
+ * @param line the line as typed
+ * @return the plan, or an empty pointer if the line has not been seen
+ */
+std::shared_ptr<Sequence> PlanCache::find(std::string const &line) {
+    if (maxBytes == 0)
+        return nullptr;
+
+    auto found = index.find(normalize(line));
+    if (found == index.end()) {
+        misses++;
+        return nullptr;
+    }
+
+    hits++;
+    entries.splice(entries.begin(), entries, found->second);
+    return found->second->sequence;
+}
+
+/**
+ * Remember the plan for a line
+ * @param line the line as typed
+ * @param sequence the plan built for it
+ */
+void PlanCache::insert(std::string const &line, std::shared_ptr<Sequence> const &sequence) {
+    if (maxBytes == 0)
+        return;
+
+    std::string key = normalize(line);
+    if (tokenize(key) != tokenize(line))
+        return;    // the key does not stand for the tokens of the line
+
+    auto found = index.find(key);
+    if (found != index.end()) {
+        bytes -= found->second->bytes;
+        entries.erase(found->second);
+        index.erase(found);
+    }
+
+    size_t size = estimateSize(*sequence) + 2 * key.capacity() + sizeof(Entry);
+    if (size > maxBytes)
+        return;
+
+    entries.push_front(Entry{key, sequence, size});
+    index[key] = entries.begin();
+    bytes += size;
+    evict();
+}
+
+void PlanCache::clear() {
+    entries.clear();
+    index.clear();
+    bytes = 0;
+}
+
+void PlanCache::setMaxBytes(size_t max) {
+    maxBytes = max;
+    evict();
+}
+
+/**
+ * Print the counters, for the 'plancache' builtin
+ * @param out stream to print to
+ */
+void PlanCache::print(std::ostream &out) const {
+    unsigned long lookups = hits + misses;
+    out << "plans:     " << entries.size() << std::endl;
+    out << "bytes:     " << bytes << " of " << maxBytes << std::endl;
+    out << "hits:      " << hits << std::endl;
+    out << "misses:    " << misses << std::endl;
+    out << "hit rate:  " << (lookups == 0 ? 0 : hits * 100 / lookups) << "%" << std::endl;
+    out << "evictions: " << evictions << std::endl;
+}
+
+/**
+ * The text a line is cached under: the line with each run of blanks between
+ * its tokens replaced by a single tab. Lines with the same key have the same
+ * tokens and therefore the same plan, however they are spaced.
+ *
+ * This is only a pass over the text, so that a hit does not lex the line. It
+ * follows the lexer where blanks are part of a token: an escaped space belongs
+ * to the word, and a quoted string is not closed by a '\"' and does not
+ * continue on the next line. The separator is a tab because a backslash
+ * cannot escape one. Where the lexer differs (for a quoted string that only
+ * ends at an escaped quote) this keeps the blanks, which costs hits but never
+ * shares a plan between different lines; insert() checks that.
+ */
+std::string PlanCache::normalize(std::string const &line) {
+    std::string result;
+    result.reserve(line.size());
+    bool quoted = false;
+    bool blank = false;
+
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (c == '\n' || c == '\r')
+            quoted = false;
+        if (!quoted && (c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
+            blank = true;
+            continue;
+        }
+        if (blank && !result.empty())
+            result.push_back('\t');
+        blank = false;
+
+        result.push_back(c);
+        if (c == '"') {
+            // only an unescaped quote closes a quoted string, any quote opens one
+            if (!quoted || line[i - 1] != '\\')
+                quoted = !quoted;
+        } else if (!quoted && c == '\\' && i + 1 < line.size() && line[i + 1] == ' ') {
+            // an escaped space is part of the word
+            result.push_back(line[++i]);
+        }
+    }
+    return result;
+}
+
+/**
+ * The text of the tokens of a line, one per line. Text the lexer rejects is
+ * part of it as well.
+ */
+std::string PlanCache::tokenize(std::string const &line) {
+    ShellLexer lexer;
+    lexer.setInput(line);
+
+    std::string result;
+    result.reserve(line.size());
+    ShellLexer::Span span;
+    while (lexer.scan(&span)) {
+        if (!result.empty())
+            result.push_back('\n');
+        result.append(line, span.begin, span.end - span.begin);
+    }
+    return result;
+}
+
+void PlanCache::evict() {
+    while (bytes > maxBytes && !entries.empty()) {
+        bytes -= entries.back().bytes;
+        index.erase(entries.back().key);
+        entries.pop_back();
+        evictions++;
+    }
+}
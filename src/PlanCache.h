@@ -0,0 +1,63 @@
+#ifndef SHELL_PLANCACHE_H
+#define SHELL_PLANCACHE_H
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+class Sequence;
+
+/**
+ * Remembers the Sequence built for a line, so running the same line again
+ * skips lexing, parsing and visiting altogether.
+ *
+ * Lines are looked up by their text with the blanks between the words
+ * squeezed, so lines that only differ in those share a plan. Only inserting a
+ * plan lexes the line, to check that its key stands for its tokens. A Sequence is never modified by
+ * executing it, so a cached one can be run any number of times; the cache and
+ * whoever is executing it share ownership.
+ * The least recently used lines are evicted once the estimated size of the
+ * cached plans exceeds the bound (SHELL_PLAN_CACHE_BYTES, 0 turns it off).
+ */
+class PlanCache {
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<Sequence> sequence;
+        size_t bytes;
+    };
+
+    std::list<Entry> entries;    //< Most recently used first.
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t bytes;
+    size_t maxBytes;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+
+public:
+    PlanCache();
+
+    std::shared_ptr<Sequence> find(std::string const &line);
+
+    void insert(std::string const &line, std::shared_ptr<Sequence> const &sequence);
+
+    void clear();
+
+    void setMaxBytes(size_t max);
+
+    void print(std::ostream &out) const;
+
+    static std::string normalize(std::string const &line);
+
+private:
+    static std::string tokenize(std::string const &line);
+
+    void evict();
+};
+
+
+#endif //SHELL_PLANCACHE_H
@@ -1,39 +1,33 @@
 #ifndef SHELL_SEQUENCE_H
 #define SHELL_SEQUENCE_H
 
-#include <vector>
-
-class Pipeline;
+#include "Arena.h"
+#include "Pipeline.h"
+#include "Shell.h"
 
 /**
  * Top-level class for an entered line in our shell.
  * Contains a list of pipelines to execute in order.
+ *
+ * The sequence owns the arena that its pipelines, their commands and
+ * everything these point to are allocated in, so deleting it frees the whole
+ * line at once.
  */
 class Sequence {
 private:
-    std::vector<Pipeline *> pipelines;
-    std::vector<std::string> paths;
-    std::string pathString;
-    std::string homeString;
+    Arena arena;
+    ArenaArray<Pipeline> pipelines;
 
 public:
-    Sequence();
-
-    ~Sequence();
-
-    std::vector<std::string> generatePathArray(std::string pathString);
-
-    void logPaths();
+    Arena &getArena() { return arena; }
 
-    void addPipeline(Pipeline *pipeline) {
-        pipelines.push_back(pipeline);
-    }
+    const Arena &getArena() const { return arena; }
 
-    const std::vector<std::string> &getPaths() const;
+    void setPipelines(ArenaArray<Pipeline> const &p) { pipelines = p; }
 
-    void execute();
+    const ArenaArray<Pipeline> &getPipelines() const { return pipelines; }
 
-    const std::string &getHomeString() const;
+    void execute(Shell *pShell);
 };
 
 
@@ -0,0 +1,32 @@
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+#include "Shell.h"
+
+/**
+ * Constructor.
+ * @param interactive false for scripts, which run without job control
+ */
+// normally this would be somewhere in the home directory
+Shell::Shell(bool interactive)
+        : history("/var/tmp/history.txt"), historySearch(&history), lastStatus(0), subshell(false) {
+    const char *home = getenv("HOME");
+    if (home != nullptr)
+        homeString = home;
+
+    // Only do job control when we own the terminal we read commands from
+    if (interactive && isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp())
+        jobTable.enableJobControl(STDIN_FILENO);
+}
+
+/**
+ * Utility for logging all available paths including the home path
+ */
+void Shell::logPaths() {
+    std::cout << "Paths:" << std::endl;
+    for (const auto &path : commandTable.getPaths()) {
+        std::cout << path << std::endl;
+    }
+    std::cout << "Home:" << std::endl;
+    std::cout << homeString << std::endl;
+}
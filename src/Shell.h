@@ -0,0 +1,60 @@
+#ifndef SHELL_SHELL_H
+#define SHELL_SHELL_H
+
+#include <string>
+#include "BuiltinTable.h"
+#include "CommandTable.h"
+#include "HistorySearch.h"
+#include "HistoryStore.h"
+#include "JobTable.h"
+#include "PlanCache.h"
+
+/**
+ * The state of a shell session that outlives a single line, like the home
+ * directory, the command hash table, the builtins, the history, the job table
+ * and the cache of parsed lines.
+ * One instance is created when the shell starts and handed to everything that
+ * executes commands.
+ */
+class Shell {
+private:
+    std::string homeString;
+    CommandTable commandTable;
+    BuiltinTable builtinTable;
+    HistoryStore history;
+    HistorySearch historySearch;
+    JobTable jobTable;
+    PlanCache planCache;
+    int lastStatus;    //< Exit status of the last command.
+    bool subshell;     //< True in a forked child that runs a builtin.
+
+public:
+    explicit Shell(bool interactive = true);
+
+    const std::string &getHomeString() const { return homeString; }
+
+    CommandTable &getCommandTable() { return commandTable; }
+
+    BuiltinTable &getBuiltinTable() { return builtinTable; }
+
+    HistoryStore &getHistory() { return history; }
+
+    HistorySearch &getHistorySearch() { return historySearch; }
+
+    JobTable &getJobTable() { return jobTable; }
+
+    PlanCache &getPlanCache() { return planCache; }
+
+    int getLastStatus() const { return lastStatus; }
+
+    void setLastStatus(int status) { lastStatus = status; }
+
+    bool isSubshell() const { return subshell; }
+
+    void setSubshell() { subshell = true; }
+
+    void logPaths();
+};
+
+
+#endif //SHELL_SHELL_H
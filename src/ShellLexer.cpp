@@ -0,0 +1,442 @@
+#include <CommonTokenFactory.h>
+#include <Token.h>
+#include "../gen/ShellGrammarLexer.h"
+#include "ShellLexer.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define SHELL_LEXER_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+ * The bytes that end a word (STRING): blanks, newlines, quotes, '|' and '&'.
+ * A space only ends it if it is not escaped, which the caller checks.
+ * All bytes of a multi-byte UTF-8 character are word bytes.
+ */
+static inline bool endsString(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '"' || c == '|' || c == '&';
+}
+
+/*
+ * The bytes that end the text of a quoted string: the quote and newlines.
+ */
+static inline bool endsQuotedString(unsigned char c) {
+    return c == '"' || c == '\n' || c == '\r';
+}
+
+static inline bool isBlank(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/*
+ * Continuation bytes of UTF-8 do not start a new code point.
+ */
+static inline bool isContinuation(unsigned char c) {
+    return (c & 0xc0) == 0x80;
+}
+
+static const unsigned char *findStringEndScalar(const unsigned char *p, const unsigned char *end) {
+    while (p < end && !endsString(*p))
+        p++;
+    return p;
+}
+
+static const unsigned char *findQuoteEndScalar(const unsigned char *p, const unsigned char *end) {
+    while (p < end && !endsQuotedString(*p))
+        p++;
+    return p;
+}
+
+static size_t countCodePointsScalar(const unsigned char *p, const unsigned char *end) {
+    size_t count = 0;
+    for (; p < end; p++) {
+        if (!isContinuation(*p))
+            count++;
+    }
+    return count;
+}
+
+#ifdef SHELL_LEXER_X86
+
+static inline __m128i matchStringEnd(__m128i v) {
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+    return _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+}
+
+static inline __m128i matchQuoteEnd(__m128i v) {
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    return _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+}
+
+static const unsigned char *findStringEndSse2(const unsigned char *p, const unsigned char *end) {
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(matchStringEnd(v)));
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+    }
+    return findStringEndScalar(p, end);
+}
+
+static const unsigned char *findQuoteEndSse2(const unsigned char *p, const unsigned char *end) {
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(matchQuoteEnd(v)));
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+    }
+    return findQuoteEndScalar(p, end);
+}
+
+static size_t countCodePointsSse2(const unsigned char *p, const unsigned char *end) {
+    size_t count = 0;
+    // as signed bytes, the continuation bytes 0x80-0xbf are the ones below -64
+    const __m128i limit = _mm_set1_epi8(-64);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmplt_epi8(v, limit)));
+        count += 16 - __builtin_popcount(mask);
+    }
+    return count + countCodePointsScalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i matchStringEnd(__m256i v) {
+    __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')));
+    return _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i matchQuoteEnd(__m256i v) {
+    __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    return _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+}
+
+__attribute__((target("avx2")))
+static const unsigned char *findStringEndAvx2(const unsigned char *p, const unsigned char *end) {
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(matchStringEnd(v)));
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+    }
+    return findStringEndSse2(p, end);
+}
+
+__attribute__((target("avx2")))
+static const unsigned char *findQuoteEndAvx2(const unsigned char *p, const unsigned char *end) {
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(matchQuoteEnd(v)));
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+    }
+    return findQuoteEndSse2(p, end);
+}
+
+__attribute__((target("avx2")))
+static size_t countCodePointsAvx2(const unsigned char *p, const unsigned char *end) {
+    size_t count = 0;
+    const __m256i limit = _mm256_set1_epi8(-64);
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, v)));
+        count += 32 - __builtin_popcount(mask);
+    }
+    return count + countCodePointsSse2(p, end);
+}
+
+static ShellLexer::Scanner bestScanner() {
+    return __builtin_cpu_supports("avx2") ? ShellLexer::AVX2 : ShellLexer::SSE2;
+}
+
+#else
+
+static ShellLexer::Scanner bestScanner() {
+    return ShellLexer::SCALAR;
+}
+
+#endif
+
+ShellLexer::Scanner ShellLexer::scanner = bestScanner();
+
+/**
+ * Choose how words and quoted strings are scanned
+ * @param s the scanner
+ * @return false if this CPU (or build) cannot use it
+ */
+bool ShellLexer::setScanner(Scanner s) {
+#ifdef SHELL_LEXER_X86
+    if (s == AVX2 && !__builtin_cpu_supports("avx2"))
+        return false;
+#else
+    if (s != SCALAR)
+        return false;
+#endif
+    scanner = s;
+    return true;
+}
+
+const char *ShellLexer::getScannerName(Scanner s) {
+    switch (s) {
+        case SCALAR:
+            return "scalar";
+        case SSE2:
+            return "sse2";
+        case AVX2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+static const unsigned char *findStringEnd(const unsigned char *p, const unsigned char *end) {
+#ifdef SHELL_LEXER_X86
+    if (ShellLexer::getScanner() == ShellLexer::AVX2)
+        return findStringEndAvx2(p, end);
+    if (ShellLexer::getScanner() == ShellLexer::SSE2)
+        return findStringEndSse2(p, end);
+#endif
+    return findStringEndScalar(p, end);
+}
+
+static const unsigned char *findQuoteEnd(const unsigned char *p, const unsigned char *end) {
+#ifdef SHELL_LEXER_X86
+    if (ShellLexer::getScanner() == ShellLexer::AVX2)
+        return findQuoteEndAvx2(p, end);
+    if (ShellLexer::getScanner() == ShellLexer::SSE2)
+        return findQuoteEndSse2(p, end);
+#endif
+    return findQuoteEndScalar(p, end);
+}
+
+static size_t countCodePoints(const unsigned char *p, const unsigned char *end) {
+#ifdef SHELL_LEXER_X86
+    if (ShellLexer::getScanner() == ShellLexer::AVX2)
+        return countCodePointsAvx2(p, end);
+    if (ShellLexer::getScanner() == ShellLexer::SSE2)
+        return countCodePointsSse2(p, end);
+#endif
+    return countCodePointsScalar(p, end);
+}
+
+ShellLexer::ShellLexer()
+        : pos(0), index(0), line(1), lineStart(0), syntaxErrors(0), errorListener(nullptr) {
+}
+
+/**
+ * Start lexing a new text. Like ANTLRInputStream, a UTF-8 byte order mark at
+ * the start is skipped.
+ * @param text the input
+ * @param name the name of the input, for error messages
+ */
+void ShellLexer::setInput(std::string const &text, std::string const &name) {
+    input = text;
+    sourceName = name;
+    pos = input.compare(0, 3, "\xef\xbb\xbf") == 0 ? 3 : 0;
+    index = 0;
+    line = 1;
+    lineStart = 0;
+    syntaxErrors = 0;
+}
+
+/**
+ * Find the next token. Blanks are skipped, text that is no token at all is
+ * returned with type INVALID_TYPE and skipped as well.
+ * @param span receives the token
+ * @return false at the end of the input, span then holds the EOF token
+ */
+bool ShellLexer::scan(Span *span) {
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(input.data());
+    size_t size = input.size();
+
+    while (pos < size && isBlank(data[pos])) {
+        if (data[pos] == '\n') {
+            line++;
+            lineStart = index + 1;
+        }
+        pos++;
+        index++;
+    }
+
+    span->begin = pos;
+    span->startIndex = index;
+    span->line = line;
+    span->charPositionInLine = index - lineStart;
+
+    if (pos == size) {
+        span->type = antlr4::Token::EOF;
+        span->end = pos;
+        return false;
+    }
+
+    size_t end;
+    switch (data[pos]) {
+        case ';':
+            // ";" on its own, but part of a word when more follows
+            end = endOfString(pos);
+            span->type = end - pos > 1 ? ShellGrammarLexer::STRING : ShellGrammarLexer::SEMICOLON;
+            break;
+
+        case '&':
+            end = pos + 1;
+            span->type = ShellGrammarLexer::AMPERSAND;
+            break;
+
+        case '|':
+            end = pos + 1;
+            span->type = ShellGrammarLexer::PIPE;
+            break;
+
+        case '"': {
+            size_t failed;
+            end = endOfQuotedString(pos, &failed);
+            span->type = ShellGrammarLexer::QUOTEDSTRING;
+            if (end == std::string::npos) {
+                // ANTLR reports up to and including the character it got stuck
+                // on and skips that one
+                end = failed < size ? failed + 1 : size;
+                span->type = antlr4::Token::INVALID_TYPE;
+            }
+            break;
+        }
+
+        default: {
+            end = endOfString(pos);
+            span->type = ShellGrammarLexer::STRING;
+
+            // Digit? ('>' | '>>' | '<') ('&' Digit)?
+            size_t op = data[pos] >= '0' && data[pos] <= '9' ? pos + 1 : pos;
+            size_t opEnd = op;
+            if (op < size && data[op] == '>')
+                opEnd = op + 1 < size && data[op + 1] == '>' ? op + 2 : op + 1;
+            else if (op < size && data[op] == '<')
+                opEnd = op + 1;
+            if (opEnd == op)
+                break;
+
+            if (opEnd + 1 < size && data[opEnd] == '&' && data[opEnd + 1] >= '0' && data[opEnd + 1] <= '9') {
+                // a word cannot contain the '&', so this is always longer
+                end = opEnd + 2;
+                span->type = ShellGrammarLexer::REDIRECTFD;
+            } else if (end == opEnd) {
+                // as long as the word, the rule listed first wins
+                span->type = ShellGrammarLexer::REDIRECT;
+            }
+            break;
+        }
+    }
+
+    span->end = end;
+    advance(end);
+    if (span->type == antlr4::Token::INVALID_TYPE && data[end - 1] == '\n') {
+        line++;
+        lineStart = index;
+    }
+    return true;
+}
+
+std::unique_ptr<antlr4::Token> ShellLexer::nextToken() {
+    Span span;
+    while (scan(&span) && span.type == antlr4::Token::INVALID_TYPE) {
+        syntaxErrors++;
+        if (errorListener != nullptr) {
+            errorListener->syntaxError(nullptr, nullptr, span.line, span.charPositionInLine,
+                                       getErrorMessage(getText(span)), nullptr);
+        }
+    }
+
+    bool eof = span.type == antlr4::Token::EOF;
+    return antlr4::CommonTokenFactory::DEFAULT->create(
+            std::make_pair(this, nullptr), span.type, eof ? "<EOF>" : getText(span),
+            antlr4::Token::DEFAULT_CHANNEL, span.startIndex, index - 1, span.line, span.charPositionInLine);
+}
+
+Ref<antlr4::TokenFactory<antlr4::CommonToken>> ShellLexer::getTokenFactory() {
+    return antlr4::CommonTokenFactory::DEFAULT;
+}
+
+/**
+ * The message ANTLR reports for text that is no token
+ * @param text the text the lexer got stuck on
+ */
+std::string ShellLexer::getErrorMessage(std::string const &text) {
+    std::string message = "token recognition error at: '";
+    for (char c : text) {
+        if (c == '\n')
+            message += "\\n";
+        else if (c == '\t')
+            message += "\\t";
+        else if (c == '\r')
+            message += "\\r";
+        else
+            message += c;
+    }
+    return message + "'";
+}
+
+/**
+ * Find the end of a word (STRING). A space only ends it if it is not escaped
+ * with a backslash.
+ * @param from the offset of its first byte, which belongs to the word
+ * @return the offset past its last byte
+ */
+size_t ShellLexer::endOfString(size_t from) const {
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(input.data());
+    const unsigned char *end = data + input.size();
+    const unsigned char *p = data + from + 1;
+
+    while (true) {
+        p = findStringEnd(p, end);
+        if (p == end || *p != ' ' || p[-1] != '\\')
+            return p - data;
+        p++;
+    }
+}
+
+/**
+ * Find the end of a quoted string.
+ * The grammar matches its text non-greedily, with '\"' as an alternative for
+ * any two characters. ANTLR ends the string at the first quote that is not
+ * preceded by a backslash; a quote that is preceded by one ends it as well,
+ * but only if no later quote does before the end of the line.
+ * @param from the offset of the opening quote
+ * @param pFailed receives the offset of the newline or end of input that ends
+ *                the search
+ * @return the offset past the closing quote, or npos if there is none
+ */
+size_t ShellLexer::endOfQuotedString(size_t from, size_t *pFailed) const {
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(input.data());
+    const unsigned char *end = data + input.size();
+    const unsigned char *p = data + from + 1;
+    size_t accepted = std::string::npos;
+
+    while (true) {
+        p = findQuoteEnd(p, end);
+        if (p == end || *p != '"') {
+            *pFailed = p - data;
+            return accepted;
+        }
+
+        accepted = p + 1 - data;
+        if (p[-1] != '\\')
+            return accepted;
+        p++;
+    }
+}
+
+/**
+ * Move past the bytes of a token, counting its code points
+ */
+void ShellLexer::advance(size_t to) {
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(input.data());
+    index += countCodePoints(data + pos, data + to);
+    pos = to;
+}
@@ -0,0 +1,111 @@
+#ifndef SHELL_SHELLLEXER_H
+#define SHELL_SHELLLEXER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <ANTLRErrorListener.h>
+#include <CommonToken.h>
+#include <TokenSource.h>
+
+/**
+ * A hand-written lexer for ShellGrammar that produces exactly the tokens
+ * ShellGrammarLexer does, without the ATN simulator.
+ *
+ * The grammar has so few token rules that which one matches, and how far, can
+ * be decided directly from the first character: the longest match wins and a
+ * tie goes to the rule listed first, like in ANTLR. That means a ';' followed
+ * by word characters is a STRING, a redirect that is followed by word
+ * characters is a STRING as well, and a quoted string ends at the first '"'
+ * that is not preceded by a backslash - or, if the line has no such quote, at
+ * the last escaped one.
+ *
+ * Words and quoted strings are scanned 16 (SSE2) or 32 (AVX2) bytes at a time
+ * for the bytes that end them; everything else is only ever one or two
+ * characters long. AVX2 is used when the CPU has it, the scanner can also be
+ * chosen explicitly for testing and benchmarking.
+ *
+ * The input is kept as UTF-8. Token indexes and positions are counted in code
+ * points, as ANTLRInputStream does, and lexer errors are reported to the error
+ * listener with the same message as ANTLR's, after which the offending
+ * character is skipped.
+ */
+class ShellLexer : public antlr4::TokenSource {
+public:
+    enum Scanner {
+        SCALAR, SSE2, AVX2
+    };
+
+    /**
+     * A token as found in the input, without creating an antlr4::Token for it.
+     * The type is one of the ShellGrammarLexer token types, EOF, or
+     * INVALID_TYPE for text that is no token at all.
+     */
+    struct Span {
+        size_t type;
+        size_t begin;              //< Offset of the first byte in the input.
+        size_t end;                //< Offset past the last byte.
+        size_t startIndex;         //< Index of the first code point.
+        size_t line;
+        size_t charPositionInLine;
+    };
+
+private:
+    static Scanner scanner;
+
+    std::string input;
+    std::string sourceName;
+    size_t pos;                    //< Offset of the next byte to look at.
+    size_t index;                  //< Code point index of pos.
+    size_t line;
+    size_t lineStart;              //< Code point index of the start of the line.
+    size_t syntaxErrors;
+    antlr4::ANTLRErrorListener *errorListener;
+
+public:
+    ShellLexer();
+
+    ShellLexer(ShellLexer const &) = delete;
+
+    ShellLexer &operator=(ShellLexer const &) = delete;
+
+    static Scanner getScanner() { return scanner; }
+
+    static bool setScanner(Scanner s);
+
+    static const char *getScannerName(Scanner s);
+
+    void setInput(std::string const &text, std::string const &name = "");
+
+    void setErrorListener(antlr4::ANTLRErrorListener *listener) { errorListener = listener; }
+
+    size_t getNumberOfSyntaxErrors() const { return syntaxErrors; }
+
+    bool scan(Span *span);
+
+    std::string getText(Span const &span) const { return input.substr(span.begin, span.end - span.begin); }
+
+    std::unique_ptr<antlr4::Token> nextToken() override;
+
+    size_t getLine() const override { return line; }
+
+    size_t getCharPositionInLine() override { return index - lineStart; }
+
+    antlr4::CharStream *getInputStream() override { return nullptr; }
+
+    std::string getSourceName() override { return sourceName; }
+
+    Ref<antlr4::TokenFactory<antlr4::CommonToken>> getTokenFactory() override;
+
+    static std::string getErrorMessage(std::string const &text);
+
+private:
+    size_t endOfString(size_t from) const;
+
+    size_t endOfQuotedString(size_t from, size_t *pFailed) const;
+
+    void advance(size_t to);
+};
+
+
+#endif //SHELL_SHELLLEXER_H
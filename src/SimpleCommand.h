@@ -3,8 +3,9 @@
 
 #include <vector>
 #include <string>
+#include "Arena.h"
 #include "IORedirect.h"
-#include "Sequence.h"
+#include "Shell.h"
 
 /**
  * A command that is part of a pipeline.
@@ -15,36 +16,49 @@
  * of the keyboard, or errors from stderr can be written to a file instead of the
  * console.
  * IORedirections are always executed in order, from left to right.
+ *
+ * A command lives in the arena of its Sequence, like its argv array, the
+ * strings it points to and its redirects. The argv array is complete when the
+ * command is built (a "~" argument is already the home directory), so it is
+ * handed to exec or posix_spawn as it is, and starting the command takes no
+ * allocation or copying.
  */
 class SimpleCommand {
 private:
-    std::string command;
-    std::vector<std::string> arguments;
-    std::vector<IORedirect> redirects;
+    char **argv;                       //< NULL terminated, argv[0] is the command.
+    size_t argc;
+    ArenaArray<IORedirect> redirects;
 
 public:
-    SimpleCommand(std::string const &cmd)
-            : command(cmd) {}
+    SimpleCommand()
+            : argv(nullptr), argc(0) {}
+
+    SimpleCommand(char **argv, size_t argc, ArenaArray<IORedirect> const &redirects)
+            : argv(argv), argc(argc), redirects(redirects) {}
+
+    SimpleCommand(Arena *arena, std::vector<std::string> const &words);
 
-    void addArgument(std::string const &s) { arguments.push_back(s); }
+    void execute(Shell *pShell, std::string const &commandPath);
 
-    void addIORedirect(int fd, IORedirect::Type t, std::string const &s) {
-        redirects.emplace_back(fd, t, s);
-    }
+    const char *getCommand() const { return argv[0]; }
 
-    void execute(Sequence *pSequence);
+    char **getArgv() const { return argv; }
 
-    const std::string &getCommand() const;
+    size_t getArgc() const { return argc; }
 
-    const std::vector<std::string> &getArguments() const;
+    const ArenaArray<IORedirect> &getRedirects() const { return redirects; }
 
-    std::string findCommand(Sequence *pSequence);
+    std::string toString() const;
 
-    void changeDirectory(Sequence *pSequence, std::string *pPath);
+    std::string findCommand(Shell *pShell);
 
-    void processRedirects(Sequence *pSequence);
+    void processRedirects();
+
+    bool applyRedirects(std::vector<std::string> *errors);
 
     void checkForErrno(std::vector<std::string> *errors);
+
+    static const char *describeErrno(int error);
 };
 
 
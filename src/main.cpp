@@ -1,52 +1,137 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
-#include <ANTLRInputStream.h>
-#include <CommonTokenStream.h>
-#include <tree/ParseTree.h>
-#include <fcntl.h>
+#include <iterator>
+#include <memory>
+#include <sstream>
 #include <unistd.h>
-#include <cstring>
-#include "../gen/ShellGrammarLexer.h"
-#include "../gen/ShellGrammarParser.h"
-#include "CommandVisitor.h"
 #include "Sequence.h"
-#include "IORedirect.h"
+#include "Shell.h"
+#include "Launcher.h"
+#include "LineEditor.h"
+#include "LineParser.h"
+#include "DfaCache.h"
+#include "Metrics.h"
+
+/**
+ * Run a whole script, one statement after the other, without prompts
+ * @param text the script
+ * @param name where it came from, for error messages
+ * @return the exit status of the last command
+ */
+static int runScript(std::string const &text, std::string const &name) {
+    Shell shell(false);
+    LineParser parser(shell.getHomeString());
+    bool reportTiming = getenv("SHELL_TIMING") != nullptr;
+
+    // Scripts don't get told about finished background jobs
+    std::ostream quiet(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    unsigned long commands = 0;
+
+    parser.startScript(text, name);
+    Sequence *sequence;
+    while (parser.nextStatement(&sequence)) {
+        shell.getJobTable().reap(quiet);
+
+        if (sequence == nullptr) {
+            shell.setLastStatus(2);
+            continue;
+        }
+        sequence->execute(&shell);
+        delete sequence;
+        commands++;
+    }
+
+    if (reportTiming) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const LineParser::Timing &total = parser.getTotalTiming();
+        fprintf(stderr, "batch: %lu commands in %.3f s, %.0f commands/s (lex %.0f us, parse %.0f us, build %.0f us)\n",
+                commands, seconds, seconds > 0 ? commands / seconds : 0.0,
+                total.lexMicros, total.parseMicros, total.buildMicros);
+        fprintf(stderr, "parse: %lu lines with SLL, %lu parsed again with LL\n",
+                parser.getSllParses(), parser.getLlParses());
+    }
+    return shell.getLastStatus();
+}
 
-class ErrorListener : public antlr4::BaseErrorListener {
-    bool seenError;
+int main(int argc, char **argv) {
+    static const char *PROMPT = "-> ";
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wmissing-noreturn"
 
-public:
-    ErrorListener()
-            : antlr4::BaseErrorListener(), seenError(false) {}
+    // fork or spawn, see Launcher
+    Launcher::configureFromEnvironment();
 
-    bool hasSeenError() const { return seenError; }
+    // per-stage latency histograms, see Metrics
+    Metrics::configureFromEnvironment();
 
-    void reset() { seenError = false; }
+    // the parser DFA of earlier sessions, see DfaCache
+    DfaCache::configureFromEnvironment();
 
-    void syntaxError(antlr4::Recognizer *recognizer, antlr4::Token *offendingSymbol,
-                     size_t line, size_t charPositionInLine, const std::string &msg, std::exception_ptr e) override {
-        std::cerr << "ERROR in input - line " << line << ":" << charPositionInLine << " " << msg << std::endl;
-        seenError = true;
+    // shell -c 'commands', shell script.sh, or commands piped into stdin
+    if (argc > 2 && strcmp(argv[1], "-c") == 0)
+        return runScript(argv[2], "-c");
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        std::cerr << "shell: -c: option requires an argument" << std::endl;
+        return 2;
+    }
+    if (argc > 1) {
+        std::ifstream file(argv[1], std::ios::binary);
+        if (!file) {
+            std::cerr << "shell: " << argv[1] << ": " << strerror(errno) << std::endl;
+            return 127;
+        }
+        std::ostringstream text;
+        text << file.rdbuf();
+        return runScript(text.str(), argv[1]);
+    }
+    if (!isatty(STDIN_FILENO)) {
+        // The whole input is read up front, so commands don't see the script on their stdin
+        std::string text((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+        return runScript(text, "stdin");
     }
-};
 
-int main() {
-    static const char *PROMPT = "-> ";
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wmissing-noreturn"
+    Shell shell;
+    LineEditor editor(&shell);
 
-    // normally this would be somewhere in the home directory
-    int fdHistory = open("/var/tmp/history.txt", IORedirect::APPEND_FLAGS, 0644);
+    // One lexer and parser for all lines
+    LineParser parser(shell.getHomeString());
+    parser.setReportTiming(getenv("SHELL_TIMING") != nullptr);
 
     while (true) {
-        // Print a prompt
-        std::cout << PROMPT;
-        std::flush(std::cout);
+        // Clean up after background jobs that have finished in the meantime
+        shell.getJobTable().reap(std::cout);
 
-        // Read a complete line
+        // Print a prompt and read a complete line
         std::string line;
-        std::getline(std::cin, line);
+        uint64_t readStart = Metrics::now();
+        bool more = editor.readLine(PROMPT, &line);
+        Metrics::recordSince(Metrics::READ, readStart);
+
+        // Ctrl-D on an empty line, or the terminal went away
+        if (!more)
+            break;
+
+        // Replace !!, !n and !-n by the history entries they refer to
+        if (line.find('!') != std::string::npos) {
+            std::string expanded, error;
+            if (!shell.getHistory().expand(line, &expanded, &error)) {
+                std::cerr << error << std::endl;
+                continue;
+            }
+            if (expanded != line) {
+                std::cout << expanded << std::endl;
+                line = expanded;
+            }
+        }
 
-        std::string historyLine = line.append("\n");
+        std::string historyLine = line;
+        line.append("\n");
 
         // Check if the user typed 'exit'.
         // Now this is a bit of a hack, since the nice way to do this is actually
@@ -55,40 +140,28 @@ int main() {
         //        if (line == "exit")
         //            break;
 
-        // Create an error listener. This will be called when an error occured.
-        ErrorListener errorListener;
-
-        // Create parser and lexer for line
-        // The lexer combines characters into meaningful tokens
-        // The parser then uses these tokens to deduce meaning of the line
-        antlr4::ANTLRInputStream inputStream(line);
-        ShellGrammarLexer lexer(&inputStream);
-        lexer.removeErrorListeners();
-        lexer.addErrorListener(&errorListener);
-        antlr4::CommonTokenStream tokens(&lexer);
-        ShellGrammarParser parser(&tokens);
-        parser.removeErrorListeners();
-        parser.addErrorListener(&errorListener);
-
-        // Actually parse the line
-        antlr4::tree::ParseTree *parseTree = parser.sequence();
-
-        // Did ANTLR report an error?
-        if (!errorListener.hasSeenError()) {
-            // Take apart the line entered into sequences, pipelines and commands
-            CommandVisitor visitor;
-            Sequence *sequence = visitor.visit(parseTree);
+        // A line that ran before comes straight from the cache, otherwise lex and
+        // parse it (nullptr if ANTLR reported an error)
+        std::shared_ptr<Sequence> sequence = shell.getPlanCache().find(line);
+        if (sequence == nullptr) {
+            sequence.reset(parser.parse(line));
+            if (sequence != nullptr)
+                shell.getPlanCache().insert(line, sequence);
+        }
 
+        if (sequence != nullptr) {
             // Execute sequence
             // Now these execute() methods are were you have to add your code...
-            sequence->execute();
-
-            // Cleanup
-            delete sequence;
+            sequence->execute(&shell);
         }
 
         // write to history after execution
-        write(fdHistory, historyLine.c_str(), strlen(historyLine.c_str()));
+        if (!historyLine.empty()) {
+            uint64_t historyStart = Metrics::now();
+            shell.getHistory().append(historyLine);
+            shell.getHistorySearch().update();
+            Metrics::recordSince(Metrics::HISTORY, historyStart);
+        }
     }
 #pragma clang diagnostic pop
     return 0;
@@ -0,0 +1,299 @@
+/**
+ * Build step that turns the serialized ATN of a generated recognizer into
+ * the constexpr tables of an AtnImage.
+ *
+ * Reads the _serializedATN initializer out of the generated .cpp file,
+ * deserializes and verifies it with the ANTLR runtime, and writes the
+ * resulting ATN, with every link between states resolved, as a header that
+ * defines <name>Atn. See src/AtnImage.h.
+ *
+ * usage: atn_image recognizer.cpp output.h name
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <Exceptions.h>
+#include <atn/ATNDeserializer.h>
+#include <atn/ATNType.h>
+#include <atn/ActionTransition.h>
+#include <atn/AtomTransition.h>
+#include <atn/BlockEndState.h>
+#include <atn/BlockStartState.h>
+#include <atn/DecisionState.h>
+#include <atn/EpsilonTransition.h>
+#include <atn/LexerChannelAction.h>
+#include <atn/LexerCustomAction.h>
+#include <atn/LexerModeAction.h>
+#include <atn/LexerPushModeAction.h>
+#include <atn/LexerTypeAction.h>
+#include <atn/LoopEndState.h>
+#include <atn/PlusBlockStartState.h>
+#include <atn/PlusLoopbackState.h>
+#include <atn/PrecedencePredicateTransition.h>
+#include <atn/PredicateTransition.h>
+#include <atn/RangeTransition.h>
+#include <atn/RuleStartState.h>
+#include <atn/RuleStopState.h>
+#include <atn/RuleTransition.h>
+#include <atn/SetTransition.h>
+#include <atn/StarLoopEntryState.h>
+#include <atn/StarLoopbackState.h>
+#include <atn/TokensStartState.h>
+#include <misc/IntervalSet.h>
+#include "AtnImage.h"
+
+using namespace antlr4::atn;
+
+/**
+ * @return the numbers between '_serializedATN = {' and '};'
+ */
+static bool readSerializedATN(std::string const &path, std::vector<uint16_t> *pData) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    std::stringstream text;
+    text << file.rdbuf();
+    std::string source = text.str();
+
+    size_t start = source.find("_serializedATN = {");
+    if (!file || start == std::string::npos)
+        return false;
+    size_t end = source.find("};", start);
+    const char *next = source.c_str() + source.find('{', start) + 1;
+    const char *last = source.c_str() + end;
+    while (next < last) {
+        char *after;
+        unsigned long value = strtoul(next, &after, 0);
+        if (after == next) {
+            next++;
+            continue;
+        }
+        pData->push_back(static_cast<uint16_t>(value));
+        next = after;
+    }
+    return !pData->empty();
+}
+
+static std::string number(size_t value) {
+    return value == INVALID_INDEX ? "-1" : std::to_string(value);
+}
+
+static std::string state(const ATNState *state) {
+    return std::to_string(state == nullptr ? AtnImage::NONE : static_cast<size_t>(state->stateNumber));
+}
+
+/**
+ * Write an array, or nothing if it's empty
+ * @return the expression for the pointer to it
+ */
+static std::string array(std::ostream &out, std::string const &type, std::string const &name,
+                         std::vector<std::string> const &elements) {
+    if (elements.empty())
+        return "nullptr";
+    out << "static constexpr " << type << " " << name << "[] = {\n";
+    for (const std::string &element : elements)
+        out << "    " << element << ",\n";
+    out << "};\n\n";
+    return name;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: atn_image recognizer.cpp output.h name\n");
+        return 2;
+    }
+    std::string name = argv[3];
+
+    std::vector<uint16_t> serialized;
+    if (!readSerializedATN(argv[1], &serialized)) {
+        fprintf(stderr, "%s: no _serializedATN\n", argv[1]);
+        return 1;
+    }
+
+    ATN atn;
+    try {
+        ATNDeserializer deserializer;
+        atn = deserializer.deserialize(serialized);
+    } catch (antlr4::RuntimeException &e) {
+        fprintf(stderr, "%s: %s\n", argv[1], e.what());
+        return 1;
+    }
+
+    std::vector<std::string> states, transitions, intervals, setStarts;
+    std::vector<antlr4::misc::IntervalSet> sets;
+    for (ATNState *s : atn.states) {
+        if (s == nullptr) {
+            states.push_back("{0, 0, 65535, 65535, 65535, 65535, 0}");
+            continue;
+        }
+
+        unsigned flags = 0;
+        const ATNState *end = nullptr, *loopBack = nullptr;
+        size_t decision = AtnImage::NONE;
+        if (auto *decisionState = dynamic_cast<const DecisionState *>(s)) {
+            if (decisionState->decision >= 0)
+                decision = static_cast<size_t>(decisionState->decision);
+            flags |= decisionState->nonGreedy ? AtnImage::NON_GREEDY : 0;
+        }
+        if (auto *blockStart = dynamic_cast<const BlockStartState *>(s))
+            end = blockStart->endState;
+        if (auto *blockEnd = dynamic_cast<const BlockEndState *>(s))
+            end = blockEnd->startState;
+        if (auto *plusBlockStart = dynamic_cast<const PlusBlockStartState *>(s))
+            loopBack = plusBlockStart->loopBackState;
+        if (auto *loopEnd = dynamic_cast<const LoopEndState *>(s))
+            loopBack = loopEnd->loopBackState;
+        if (auto *starLoopEntry = dynamic_cast<const StarLoopEntryState *>(s)) {
+            loopBack = starLoopEntry->loopBackState;
+            flags |= starLoopEntry->isPrecedenceDecision ? AtnImage::PRECEDENCE_DECISION : 0;
+        }
+        if (auto *ruleStart = dynamic_cast<const RuleStartState *>(s))
+            flags |= ruleStart->isLeftRecursiveRule ? AtnImage::LEFT_RECURSIVE : 0;
+
+        states.push_back("{" + std::to_string(s->getStateType()) + ", " + std::to_string(flags) + ", " +
+                         std::to_string(s->ruleIndex == INVALID_INDEX ? AtnImage::NONE : s->ruleIndex) + ", " +
+                         std::to_string(decision) + ", " + state(end) + ", " + state(loopBack) + ", " +
+                         std::to_string(s->transitions.size()) + "}");
+
+        for (const Transition *t : s->transitions) {
+            std::string a = "-1", b = "-1", c = "-1";
+            switch (t->getSerializationType()) {
+                case Transition::EPSILON:
+                    a = number(const_cast<EpsilonTransition *>(static_cast<const EpsilonTransition *>(t))
+                                       ->outermostPrecedenceReturn());
+                    break;
+                case Transition::RANGE:
+                    a = number(static_cast<const RangeTransition *>(t)->from);
+                    b = number(static_cast<const RangeTransition *>(t)->to);
+                    break;
+                case Transition::RULE: {
+                    auto *rule = static_cast<const RuleTransition *>(t);
+                    a = number(rule->ruleIndex);
+                    b = std::to_string(rule->precedence);
+                    c = state(rule->followState);
+                    break;
+                }
+                case Transition::PREDICATE: {
+                    auto *predicate = static_cast<const PredicateTransition *>(t);
+                    a = number(predicate->ruleIndex);
+                    b = number(predicate->predIndex);
+                    c = predicate->isCtxDependent ? "1" : "0";
+                    break;
+                }
+                case Transition::ATOM:
+                    a = number(static_cast<const AtomTransition *>(t)->_label);
+                    break;
+                case Transition::ACTION: {
+                    auto *action = static_cast<const ActionTransition *>(t);
+                    a = number(action->ruleIndex);
+                    b = number(action->actionIndex);
+                    c = action->isCtxDependent ? "1" : "0";
+                    break;
+                }
+                case Transition::SET:
+                case Transition::NOT_SET: {
+                    const antlr4::misc::IntervalSet &set = static_cast<const SetTransition *>(t)->set;
+                    size_t index = 0;
+                    while (index < sets.size() && !(sets[index] == set))
+                        index++;
+                    if (index == sets.size())
+                        sets.push_back(set);
+                    a = std::to_string(index);
+                    break;
+                }
+                case Transition::PRECEDENCE:
+                    a = std::to_string(static_cast<const PrecedencePredicateTransition *>(t)->precedence);
+                    break;
+                default:
+                    break;
+            }
+            transitions.push_back("{" + std::to_string(t->getSerializationType()) + ", " + state(t->target) +
+                                  ", " + a + ", " + b + ", " + c + "}");
+        }
+    }
+
+    setStarts.push_back("0");
+    for (const antlr4::misc::IntervalSet &set : sets) {
+        for (const antlr4::misc::Interval &interval : set.getIntervals())
+            intervals.push_back("{" + std::to_string(interval.a) + ", " + std::to_string(interval.b) + "}");
+        setStarts.push_back(std::to_string(intervals.size()));
+    }
+
+    std::vector<std::string> ruleStarts, ruleStops, ruleTokenTypes, modes, decisions, actions, data;
+    for (size_t r = 0; r < atn.ruleToStartState.size(); r++) {
+        ruleStarts.push_back(state(atn.ruleToStartState[r]));
+        ruleStops.push_back(state(atn.ruleToStopState[r]));
+    }
+    for (size_t tokenType : atn.ruleToTokenType)
+        ruleTokenTypes.push_back(number(tokenType));
+    for (const TokensStartState *mode : atn.modeToStartState)
+        modes.push_back(state(mode));
+    for (const DecisionState *decision : atn.decisionToState)
+        decisions.push_back(state(decision));
+    for (const Ref<LexerAction> &action : atn.lexerActions) {
+        int data1 = 0, data2 = 0;
+        switch (action->getActionType()) {
+            case LexerActionType::CHANNEL:
+                data1 = std::static_pointer_cast<LexerChannelAction>(action)->getChannel();
+                break;
+            case LexerActionType::CUSTOM:
+                data1 = static_cast<int>(std::static_pointer_cast<LexerCustomAction>(action)->getRuleIndex());
+                data2 = static_cast<int>(std::static_pointer_cast<LexerCustomAction>(action)->getActionIndex());
+                break;
+            case LexerActionType::MODE:
+                data1 = std::static_pointer_cast<LexerModeAction>(action)->getMode();
+                break;
+            case LexerActionType::PUSH_MODE:
+                data1 = std::static_pointer_cast<LexerPushModeAction>(action)->getMode();
+                break;
+            case LexerActionType::TYPE:
+                data1 = std::static_pointer_cast<LexerTypeAction>(action)->getType();
+                break;
+            default:
+                break;
+        }
+        actions.push_back("{" + std::to_string(static_cast<int>(action->getActionType())) + ", " +
+                          std::to_string(data1) + ", " + std::to_string(data2) + "}");
+    }
+    for (uint16_t value : serialized)
+        data.push_back(std::to_string(value));
+
+    std::string p = name + "Atn";
+    std::ostringstream out;
+    std::string source = argv[1];
+    out << "// The ATN of " << name << ", made from " << source.substr(source.find_last_of('/') + 1)
+        << " by atn_image. Do not edit.\n\n"
+        << "#include \"AtnImage.h\"\n\n";
+    std::string statesArray = array(out, "AtnImage::State", p + "States", states);
+    std::string transitionsArray = array(out, "AtnImage::Transition", p + "Transitions", transitions);
+    std::string intervalsArray = array(out, "AtnImage::Interval", p + "Intervals", intervals);
+    std::string setStartsArray = array(out, "uint32_t", p + "SetStarts", setStarts);
+    std::string ruleStartsArray = array(out, "uint16_t", p + "RuleStartStates", ruleStarts);
+    std::string ruleStopsArray = array(out, "uint16_t", p + "RuleStopStates", ruleStops);
+    std::string ruleTokenTypesArray = array(out, "int32_t", p + "RuleTokenTypes", ruleTokenTypes);
+    std::string modesArray = array(out, "uint16_t", p + "ModeStartStates", modes);
+    std::string decisionsArray = array(out, "uint16_t", p + "DecisionStates", decisions);
+    std::string actionsArray = array(out, "AtnImage::LexerAction", p + "LexerActions", actions);
+    std::string serializedArray = array(out, "uint16_t", p + "Serialized", data);
+    out << "static constexpr AtnImage " << p << " = {\n"
+        << "    " << static_cast<int>(atn.grammarType) << ", " << atn.maxTokenType << ",\n"
+        << "    " << statesArray << ", " << states.size() << ",\n"
+        << "    " << transitionsArray << ", " << transitions.size() << ",\n"
+        << "    " << intervalsArray << ", " << setStartsArray << ", " << sets.size() << ",\n"
+        << "    " << ruleStartsArray << ", " << ruleStopsArray << ", " << ruleTokenTypesArray << ", "
+        << ruleStarts.size() << ",\n"
+        << "    " << modesArray << ", " << modes.size() << ",\n"
+        << "    " << decisionsArray << ", " << decisions.size() << ",\n"
+        << "    " << actionsArray << ", " << actions.size() << ",\n"
+        << "    " << serializedArray << ", " << data.size() << "\n"
+        << "};\n";
+
+    std::ofstream output(argv[2], std::ios::trunc);
+    output << out.str();
+    if (!output) {
+        fprintf(stderr, "%s: could not be written\n", argv[2]);
+        return 1;
+    }
+    return 0;
+}